@@ -20,6 +20,12 @@
 
 #include "string.h"
 
+/*
+ * Below this size fast strings don't pay off even with ERMS, for memset()
+ * as well as memcpy().
+ */
+#define MEMCPY_ERMS_THRESHOLD	256
+
 typedef uint32_t op_t;
 
 void *memset(void *dstpp, int c, size_t len)
@@ -35,6 +41,18 @@ void *memset(void *dstpp, int c, size_t len)
 	/* Clear the direction flag, so filling will move forward.  */
 	asm volatile("cld");
 
+	/* With fast strings a single byte-granular fill is fastest. */
+	if (IS_ENABLED(CONFIG_LP_ARCH_X86_ERMS) &&
+	    len >= MEMCPY_ERMS_THRESHOLD) {
+		asm volatile(
+			"rep\n"
+			"stosb" /* %0, %2, %3 */ :
+			"=D" (dstp), "=c" (d0) :
+			"0" (dstp), "1" (len), "a" (x) :
+			"memory");
+		return dstpp;
+	}
+
 	/* This threshold value is optimal.  */
 	if (len >= 12) {
 		/* Fill X with four copies of the char we want to fill with. */
@@ -78,16 +96,82 @@ void *memset(void *dstpp, int c, size_t len)
 	return dstpp;
 }
 
+/*
+ * rep movs has a startup cost of a few dozen cycles, so tiny copies are
+ * done with plain (possibly overlapping) register moves instead.
+ */
+#define MEMCPY_SMALL		16
+
+typedef uint32_t __attribute__((may_alias)) u32_alias_t;
+
+static inline void memcpy_small(uint8_t *d, const uint8_t *s, size_t n)
+{
+	uint32_t a, b, c, e;
+
+	if (n >= 8) {
+		a = *(const u32_alias_t *)s;
+		b = *(const u32_alias_t *)(s + 4);
+		c = *(const u32_alias_t *)(s + n - 8);
+		e = *(const u32_alias_t *)(s + n - 4);
+		*(u32_alias_t *)d = a;
+		*(u32_alias_t *)(d + 4) = b;
+		*(u32_alias_t *)(d + n - 8) = c;
+		*(u32_alias_t *)(d + n - 4) = e;
+	} else if (n >= 4) {
+		a = *(const u32_alias_t *)s;
+		b = *(const u32_alias_t *)(s + n - 4);
+		*(u32_alias_t *)d = a;
+		*(u32_alias_t *)(d + n - 4) = b;
+	} else if (n) {
+		/* Covers 1, 2 and 3 bytes. */
+		d[0] = s[0];
+		d[n / 2] = s[n / 2];
+		d[n - 1] = s[n - 1];
+	}
+}
+
 void *memcpy(void *dest, const void *src, size_t n)
 {
 	unsigned long d0, d1, d2;
+	size_t head;
+
+	if (n < MEMCPY_SMALL) {
+		memcpy_small(dest, src, n);
+		return dest;
+	}
+
+	if (IS_ENABLED(CONFIG_LP_ARCH_X86_ERMS) &&
+	    n >= MEMCPY_ERMS_THRESHOLD) {
+		asm volatile(
+			"rep ; movsb\n\t"
+			: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+			: "0" (n), "1" (dest), "2" (src)
+			: "memory"
+		);
+		return dest;
+	}
+
+	/*
+	 * Align the destination so the dword moves below never straddle
+	 * a cache line on the store side (this matters a lot for uncached
+	 * framebuffers). The head is copied with one unaligned dword move.
+	 */
+	head = -(unsigned long)dest & 3;
+	d1 = (unsigned long)dest;
+	d2 = (unsigned long)src;
+	if (head) {
+		*(u32_alias_t *)dest = *(const u32_alias_t *)src;
+		d1 += head;
+		d2 += head;
+		n -= head;
+	}
 
 	asm volatile(
 		"rep ; movsl\n\t"
 		"movl %4,%%ecx\n\t"
 		"rep ; movsb\n\t"
 		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
-		: "0" (n >> 2), "g" (n & 3), "1" (dest), "2" (src)
+		: "0" (n >> 2), "g" (n & 3), "1" (d1), "2" (d2)
 		: "memory"
 	);
 
@@ -66,31 +66,66 @@ static unsigned long fbinfo;
 static unsigned long fbaddr;
 static unsigned long chars;
 
+/*
+ * Cache of rendered character cells in framebuffer pixel format, indexed by
+ * a hash of the character and its colors. Console output mostly uses a few
+ * color combinations, so a small direct mapped cache catches nearly all cells.
+ */
+#define GLYPH_CACHE_ENTRIES	512
+#define GLYPH_TAG_INVALID	0xffffffff
+static unsigned long glyphs;
+static unsigned long glyph_tags;
+
 #define FI ((struct cb_framebuffer *) phys_to_virt(fbinfo))
 #define FB ((unsigned char *) phys_to_virt(fbaddr))
 #define CHARS ((unsigned short *) phys_to_virt(chars))
+#define GLYPHS ((unsigned char *) phys_to_virt(glyphs))
+#define GLYPH_TAGS ((u32 *) phys_to_virt(glyph_tags))
+
+#define GLYPH_LINE (FONT_WIDTH * (FI->bits_per_pixel >> 3))
+#define GLYPH_SIZE (GLYPH_LINE * FONT_HEIGHT)
+
+/* Fill rows [y0, y1) of the framebuffer with black */
+static void corebootfb_erase(unsigned int y0, unsigned int y1)
+{
+	const size_t line = FI->x_resolution * (FI->bits_per_pixel >> 3);
+	unsigned char *dst = FB + y0 * FI->bytes_per_line;
+
+	if (line == FI->bytes_per_line) {
+		memset(dst, 0, (y1 - y0) * line);
+		return;
+	}
+
+	for (; y0 < y1; y0++) {
+		memset(dst, 0, line);
+		dst += FI->bytes_per_line;
+	}
+}
 
 static void corebootfb_scroll_up(void)
 {
+	const size_t line = FI->x_resolution * (FI->bits_per_pixel >> 3);
 	unsigned char *dst = FB;
 	unsigned char *src = FB + (FI->bytes_per_line * FONT_HEIGHT);
 	int y;
 
-	/* Scroll all lines up */
-	for(y = 0; y < FI->y_resolution - FONT_HEIGHT; y++) {
-		memcpy(dst, src, FI->x_resolution * (FI->bits_per_pixel >> 3));
+	/*
+	 * Scroll all lines up. Without padding between lines this is one
+	 * large block move, otherwise move line by line.
+	 */
+	if (line == FI->bytes_per_line) {
+		memmove(dst, src, (FI->y_resolution - FONT_HEIGHT) * line);
+	} else {
+		for (y = 0; y < FI->y_resolution - FONT_HEIGHT; y++) {
+			memmove(dst, src, line);
 
-		dst += FI->bytes_per_line;
-		src += FI->bytes_per_line;
+			dst += FI->bytes_per_line;
+			src += FI->bytes_per_line;
+		}
 	}
 
 	/* Erase last line */
-	dst = FB + (FI->y_resolution - FONT_HEIGHT) * FI->bytes_per_line;
-
-	for(; y < FI->y_resolution; y++) {
-		memset(dst, 0, FI->x_resolution * (FI->bits_per_pixel >> 3));
-		dst += FI->bytes_per_line;
-	}
+	corebootfb_erase(FI->y_resolution - FONT_HEIGHT, FI->y_resolution);
 
 	/* And update the char buffer */
 	dst = (unsigned char *) CHARS;
@@ -107,13 +142,9 @@ static void corebootfb_scroll_up(void)
 static void corebootfb_clear(void)
 {
 	int row, column;
-	unsigned char *ptr = FB;
 
 	/* Clear the screen */
-	for(row = 0; row < FI->y_resolution; row++) {
-		memset(ptr, 0, FI->x_resolution * (FI->bits_per_pixel >> 3));
-		ptr += FI->bytes_per_line;
-	}
+	corebootfb_erase(0, FI->y_resolution);
 
 	/* And update the char buffer */
 	for(row = 0; row < coreboot_video_console.rows; row++)
@@ -121,14 +152,16 @@ static void corebootfb_clear(void)
 			CHARS[row * coreboot_video_console.columns + column] = (VGA_COLOR_DEFAULT << 8);
 }
 
-static void corebootfb_putchar(u8 row, u8 col, unsigned int ch)
+/* Render a character cell to dst, with lines stride bytes apart */
+static void corebootfb_render(unsigned char *dst, size_t stride,
+			      unsigned int ch)
 {
-	unsigned char *dst;
 	unsigned char *glyph = font8x16 + ((ch & 0xFF) * FONT_HEIGHT);
 
 	unsigned char bg = (ch >> 12) & 0xF;
 	unsigned char fg = (ch >> 8) & 0xF;
 	u32 fgval = 0, bgval = 0;
+	u32 val;
 	u16 *dst16;
 	u32 *dst32;
 
@@ -143,44 +176,68 @@ static void corebootfb_putchar(u8 row, u8 col, unsigned int ch)
 			((((vga_colors[fg] >> 16) & 0xff) >> (8 - FI->red_mask_size)) << FI->red_mask_pos);
 	}
 
-
-	dst = FB + ((row * FONT_HEIGHT) * FI->bytes_per_line);
-	dst += (col * FONT_WIDTH * (FI->bits_per_pixel >> 3));
-
 	for(y = 0; y < FONT_HEIGHT; y++) {
-		for(x = FONT_WIDTH - 1; x >= 0; x--) {
+		/* Bit 7 of the glyph line is the leftmost pixel */
+		for(x = 0; x < FONT_WIDTH; x++) {
+			const int set = *glyph & (0x80 >> x);
 
 			switch (FI->bits_per_pixel) {
 			case 8: /* Indexed */
-				dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3)] = (*glyph & (1 << x)) ?  fg : bg;
+				dst[x] = set ? fg : bg;
 				break;
 			case 16: /* 16 bpp */
-				dst16 = (u16 *)(dst + (FONT_WIDTH - x) * (FI->bits_per_pixel >> 3));
-				*dst16 = (*glyph & (1 << x)) ? fgval : bgval;
+				dst16 = (u16 *)(dst + x * 2);
+				*dst16 = set ? fgval : bgval;
 				break;
 			case 24: /* 24 bpp */
-				if (*glyph & (1 << x)) {
-					dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3) + 0] = fgval & 0xff;
-					dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3) + 1] = (fgval >> 8) & 0xff;
-					dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3) + 2] = (fgval >> 16) & 0xff;
-				} else {
-					dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3) + 0] = bgval & 0xff;
-					dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3) + 1] = (bgval >> 8) & 0xff;
-					dst[(FONT_WIDTH - x) * (FI->bits_per_pixel >> 3) + 2] = (bgval >> 16) & 0xff;
-				}
+				val = set ? fgval : bgval;
+				dst[x * 3 + 0] = val & 0xff;
+				dst[x * 3 + 1] = (val >> 8) & 0xff;
+				dst[x * 3 + 2] = (val >> 16) & 0xff;
 				break;
 			case 32: /* 32 bpp */
-				dst32 = (u32 *)(dst + (FONT_WIDTH - x) * (FI->bits_per_pixel >> 3));
-				*dst32 = (*glyph & (1 << x)) ? fgval : bgval;
+				dst32 = (u32 *)(dst + x * 4);
+				*dst32 = set ? fgval : bgval;
 				break;
 			}
 		}
 
-		dst += FI->bytes_per_line;
+		dst += stride;
 		glyph++;
 	}
 }
 
+static void corebootfb_putchar(u8 row, u8 col, unsigned int ch)
+{
+	unsigned char *dst;
+	unsigned char *cell;
+	unsigned int index;
+	int y;
+
+	dst = FB + ((row * FONT_HEIGHT) * FI->bytes_per_line);
+	dst += (col * FONT_WIDTH * (FI->bits_per_pixel >> 3));
+
+	if (!glyphs) {
+		corebootfb_render(dst, FI->bytes_per_line, ch);
+		return;
+	}
+
+	ch &= 0xffff;
+	index = ((ch & 0xff) ^ ((ch >> 8) * 0x9d)) % GLYPH_CACHE_ENTRIES;
+	cell = GLYPHS + index * GLYPH_SIZE;
+	if (GLYPH_TAGS[index] != ch) {
+		corebootfb_render(cell, GLYPH_LINE, ch);
+		GLYPH_TAGS[index] = ch;
+	}
+
+	/* Copy whole lines of the cell so the framebuffer sees wide writes */
+	for (y = 0; y < FONT_HEIGHT; y++) {
+		memcpy(dst, cell, GLYPH_LINE);
+		dst += FI->bytes_per_line;
+		cell += GLYPH_LINE;
+	}
+}
+
 static void corebootfb_putc(u8 row, u8 col, unsigned int ch)
 {
 	CHARS[row * coreboot_video_console.columns + col] = ch;
@@ -245,6 +302,22 @@ static int corebootfb_init(void)
 	chars = virt_to_phys(malloc(coreboot_video_console.rows *
 				    coreboot_video_console.columns * 2));
 
+	/* Cells are rendered directly if there is no memory for the cache. */
+	glyphs = 0;
+	glyph_tags = 0;
+	void *cache = malloc(GLYPH_CACHE_ENTRIES * GLYPH_SIZE);
+	u32 *tags = malloc(GLYPH_CACHE_ENTRIES * sizeof(*tags));
+	if (cache && tags) {
+		int i;
+		for (i = 0; i < GLYPH_CACHE_ENTRIES; i++)
+			tags[i] = GLYPH_TAG_INVALID;
+		glyphs = virt_to_phys(cache);
+		glyph_tags = virt_to_phys(tags);
+	} else {
+		free(cache);
+		free(tags);
+	}
+
 	// clear boot splash screen if there is one.
 	corebootfb_clear();
 	return 0;
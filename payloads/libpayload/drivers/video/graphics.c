@@ -48,6 +48,18 @@ static struct rect screen;
 static struct cb_framebuffer *fbinfo;
 static uint8_t *fbaddr;
 
+/*
+ * All drawing goes to 'drawbuf'. Normally it's the framebuffer itself. When
+ * the graphics buffer is enabled, it points to a shadow copy of the screen in
+ * cached memory and 'dirty' tracks the area changed since the last flush.
+ */
+static uint8_t *drawbuf;
+static uint8_t *gfx_buffer;
+static struct rect dirty;
+
+/* Scratch row in cached memory used to build solid fills */
+static uint8_t *row_buf;
+
 #define LOG(x...)	printf("CBGFX: " x)
 #define PIVOT_H_MASK	(PIVOT_H_LEFT|PIVOT_H_CENTER|PIVOT_H_RIGHT)
 #define PIVOT_V_MASK	(PIVOT_V_TOP|PIVOT_V_CENTER|PIVOT_V_BOTTOM)
@@ -126,7 +138,7 @@ static inline void set_pixel(struct vector *coord, uint32_t color)
 {
 	const int bpp = fbinfo->bits_per_pixel;
 	int i;
-	uint8_t * const pixel = fbaddr + (coord->x +
+	uint8_t * const pixel = drawbuf + (coord->x +
 			coord->y * fbinfo->x_resolution) * bpp / 8;
 	for (i = 0; i < bpp / 8; i++)
 		pixel[i] = (color >> (i * 8));
@@ -148,6 +160,7 @@ static int cbgfx_init(void)
 	fbaddr = phys_to_virt((uint8_t *)(uintptr_t)(fbinfo->physical_address));
 	if (!fbaddr)
 		return CBGFX_ERROR_FRAMEBUFFER_ADDR;
+	drawbuf = fbaddr;
 
 	screen.size.width = fbinfo->x_resolution;
 	screen.size.height = fbinfo->y_resolution;
@@ -164,6 +177,9 @@ static int cbgfx_init(void)
 	canvas.offset.x = (screen.size.width - canvas.size.width) / 2;
 	canvas.offset.y = 0;
 
+	/* Without it, fill_rect() falls back to plotting pixels one by one. */
+	row_buf = malloc(screen.size.width * fbinfo->bits_per_pixel / 8);
+
 	initialized = 1;
 	LOG("cbgfx initialized: screen:width=%d, height=%d, offset=%d canvas:width=%d, height=%d, offset=%d\n",
 	    screen.size.width, screen.size.height, screen.offset.x,
@@ -172,11 +188,70 @@ static int cbgfx_init(void)
 	return 0;
 }
 
+/*
+ * Extend the dirty rectangle to cover the area at top_left of the given size.
+ * This is a no-op unless the graphics buffer is enabled.
+ */
+static void mark_dirty(const struct vector *top_left, const struct vector *size)
+{
+	struct vector br, dbr;
+
+	if (!gfx_buffer || size->width <= 0 || size->height <= 0)
+		return;
+
+	if (dirty.size.width == 0) {
+		dirty.offset = *top_left;
+		dirty.size = *size;
+		return;
+	}
+
+	add_vectors(&br, top_left, size);
+	add_vectors(&dbr, &dirty.offset, &dirty.size);
+	dirty.offset.x = MIN(dirty.offset.x, top_left->x);
+	dirty.offset.y = MIN(dirty.offset.y, top_left->y);
+	dirty.size.width = MAX(dbr.x, br.x) - dirty.offset.x;
+	dirty.size.height = MAX(dbr.y, br.y) - dirty.offset.y;
+}
+
+/*
+ * Fill the area from top_left (inclusive) to bottom_right (exclusive) with a
+ * color. One row of pixels is built in cached memory and then copied to each
+ * row of the area, so the framebuffer only sees wide sequential writes.
+ */
+static void fill_rect(const struct vector *top_left,
+		      const struct vector *bottom_right, uint32_t color)
+{
+	const int bpp = fbinfo->bits_per_pixel / 8;
+	const size_t line = screen.size.width * bpp;
+	const size_t n = (bottom_right->x - top_left->x) * bpp;
+	struct vector p;
+	size_t done;
+	int i;
+
+	if (top_left->x >= bottom_right->x || top_left->y >= bottom_right->y)
+		return;
+
+	if (!row_buf) {
+		for (p.y = top_left->y; p.y < bottom_right->y; p.y++)
+			for (p.x = top_left->x; p.x < bottom_right->x; p.x++)
+				set_pixel(&p, color);
+		return;
+	}
+
+	for (i = 0; i < bpp; i++)
+		row_buf[i] = (color >> (i * 8));
+	for (done = bpp; done < n; done *= 2)
+		memcpy(row_buf + done, row_buf, MIN(done, n - done));
+
+	for (p.y = top_left->y; p.y < bottom_right->y; p.y++)
+		memcpy(drawbuf + p.y * line + top_left->x * bpp, row_buf, n);
+}
+
 int draw_box(const struct rect *box, const struct rgb_color *rgb)
 {
 	struct vector top_left;
 	struct vector size;
-	struct vector p, t;
+	struct vector t;
 	const uint32_t color = calculate_color(rgb);
 	const struct scale top_left_s = {
 		.x = { .n = box->offset.x, .d = CANVAS_SCALE, },
@@ -198,9 +273,8 @@ int draw_box(const struct rect *box, const struct rgb_color *rgb)
 		return CBGFX_ERROR_BOUNDARY;
 	}
 
-	for (p.y = top_left.y; p.y < t.y; p.y++)
-		for (p.x = top_left.x; p.x < t.x; p.x++)
-			set_pixel(&p, color);
+	fill_rect(&top_left, &t, color);
+	mark_dirty(&top_left, &size);
 
 	return CBGFX_SUCCESS;
 }
@@ -224,32 +298,259 @@ int clear_canvas(const struct rgb_color *rgb)
 int clear_screen(const struct rgb_color *rgb)
 {
 	uint32_t color;
-	struct vector p;
+	struct vector br;
 
 	if (cbgfx_init())
 		return CBGFX_ERROR_INIT;
 
 	color = calculate_color(rgb);
-	for (p.y = 0; p.y < screen.size.height; p.y++)
-		for (p.x = 0; p.x < screen.size.width; p.x++)
-			set_pixel(&p, color);
+	add_vectors(&br, &screen.offset, &screen.size);
+	fill_rect(&screen.offset, &br, color);
+	mark_dirty(&screen.offset, &screen.size);
 
 	return CBGFX_SUCCESS;
 }
 
 /*
- * Bi-linear Interpolation
+ * Bitmaps are scaled with a separable bi-linear filter in fixed point. Weights
+ * are fractions of 1 << SCALE_SHIFT.
+ */
+#define SCALE_SHIFT	8
+#define SCALE_ONE	(1 << SCALE_SHIFT)
+
+/* Per output column: the two source columns to blend and the weight of s1 */
+struct scale_tap {
+	int32_t s0;
+	int32_t s1;
+	uint32_t w;
+};
+
+/*
+ * Compute where output coordinate d samples the source: between source
+ * coordinates s0 and s1 with the weight of s1 in *w.
+ */
+static void get_tap(int32_t d, const struct fraction *scale, int32_t max,
+		    struct scale_tap *tap)
+{
+	tap->s0 = d * scale->d / scale->n;
+	tap->s1 = tap->s0;
+	if (tap->s1 + 1 < max)
+		tap->s1++;
+	tap->w = (d * scale->d) % scale->n * SCALE_ONE / scale->n;
+}
+
+/*
+ * Scale a bitmap and convert it to the framebuffer pixel format. Rows are
+ * written top to bottom to dst, stride bytes apart.
  *
- * It estimates the value of a middle point (tx, ty) using the values from four
- * adjacent points (q00, q01, q10, q11).
+ * Each output row is produced in two passes. The two source rows it falls
+ * between are first blended vertically, once per source column that's
+ * actually sampled, and the result is then blended horizontally using the
+ * per column taps which are computed once per bitmap.
  */
-static uint32_t bli(uint32_t q00, uint32_t q10, uint32_t q01, uint32_t q11,
-		    struct fraction *tx, struct fraction *ty)
+static int scale_bitmap_v3(uint8_t *dst, size_t stride,
+			   const struct scale *scale,
+			   const struct vector *dim,
+			   const struct vector *dim_org,
+			   const struct bitmap_header_v3 *header,
+			   const struct bitmap_palette_element_v3 *pal,
+			   const uint8_t *pixel_array)
 {
-	uint32_t r0 = (tx->n * q10 + (tx->d - tx->n) * q00) / tx->d;
-	uint32_t r1 = (tx->n * q11 + (tx->d - tx->n) * q01) / tx->d;
-	uint32_t p = (ty->n * r1 + (ty->d - ty->n) * r0) / ty->d;
-	return p;
+	const int bpp = fbinfo->bits_per_pixel / 8;
+	const int32_t y_stride = ROUNDUP(dim_org->width, 4);
+	struct scale_tap *xtaps;
+	struct scale_tap ytap;
+	uint16_t *vrow;
+	int32_t last;
+	int32_t r, x;
+	int i, rv = CBGFX_SUCCESS;
+
+	xtaps = malloc(dim->width * sizeof(*xtaps) +
+		       dim_org->width * 3 * sizeof(*vrow));
+	if (!xtaps) {
+		LOG("Failed to allocate scaler buffers\n");
+		return CBGFX_ERROR_UNKNOWN;
+	}
+	vrow = (uint16_t *)(xtaps + dim->width);
+
+	for (x = 0; x < dim->width; x++)
+		get_tap(x, &scale->x, dim_org->width, &xtaps[x]);
+
+	for (r = 0; r < dim->height; r++) {
+		/*
+		 * header->height can be positive or negative. If it's
+		 * negative, pixel data is stored from top to bottom. If it's
+		 * positive, pixel data is stored from bottom to top.
+		 */
+		const int32_t d = header->height < 0 ? r : dim->height - 1 - r;
+		uint8_t *out = dst + r * stride;
+
+		get_tap(d, &scale->y, dim_org->height, &ytap);
+		const uint8_t *data0 = pixel_array + ytap.s0 * y_stride;
+		const uint8_t *data1 = pixel_array + ytap.s1 * y_stride;
+
+		/*
+		 * Since taps are monotonic, 'last' tells which source columns
+		 * of this row have already been blended vertically.
+		 */
+		last = -1;
+		for (x = 0; x < dim->width; x++) {
+			const struct scale_tap *t = &xtaps[x];
+			int32_t s;
+
+			for (s = MAX(last + 1, t->s0); s <= t->s1; s++) {
+				uint8_t c0 = data0[s];
+				uint8_t c1 = data1[s];
+				if (c0 >= header->colors_used ||
+				    c1 >= header->colors_used) {
+					LOG("Color index exceeds palette "
+					    "boundary\n");
+					rv = CBGFX_ERROR_BITMAP_DATA;
+					goto out;
+				}
+				vrow[s * 3 + 0] =
+					pal[c0].red * (SCALE_ONE - ytap.w) +
+					pal[c1].red * ytap.w;
+				vrow[s * 3 + 1] =
+					pal[c0].green * (SCALE_ONE - ytap.w) +
+					pal[c1].green * ytap.w;
+				vrow[s * 3 + 2] =
+					pal[c0].blue * (SCALE_ONE - ytap.w) +
+					pal[c1].blue * ytap.w;
+			}
+			last = MAX(last, t->s1);
+
+			const uint16_t *v0 = &vrow[t->s0 * 3];
+			const uint16_t *v1 = &vrow[t->s1 * 3];
+			const struct rgb_color rgb = {
+				.red = (v0[0] * (SCALE_ONE - t->w) +
+					v1[0] * t->w) >> (2 * SCALE_SHIFT),
+				.green = (v0[1] * (SCALE_ONE - t->w) +
+					  v1[1] * t->w) >> (2 * SCALE_SHIFT),
+				.blue = (v0[2] * (SCALE_ONE - t->w) +
+					 v1[2] * t->w) >> (2 * SCALE_SHIFT),
+			};
+			const uint32_t color = calculate_color(&rgb);
+			for (i = 0; i < bpp; i++)
+				out[x * bpp + i] = (color >> (i * 8));
+		}
+	}
+
+out:
+	free(xtaps);
+	return rv;
+}
+
+/*
+ * Cache of scaled bitmaps in the framebuffer pixel format, so that redrawing
+ * the same image at the same size is just a copy. Entries are looked up by
+ * the address and size of the bitmap data and the projected dimension.
+ */
+#define BITMAP_CACHE_ENTRIES	16
+
+struct bitmap_cache_entry {
+	const void *bitmap;
+	size_t size;
+	struct vector dim;
+	uint8_t *pixels;
+	uint32_t last_used;
+};
+
+static struct bitmap_cache_entry bitmap_cache[BITMAP_CACHE_ENTRIES];
+static size_t bitmap_cache_limit;
+static size_t bitmap_cache_used;
+static uint32_t bitmap_cache_clock;
+
+static void bitmap_cache_evict(struct bitmap_cache_entry *e)
+{
+	if (!e->pixels)
+		return;
+	free(e->pixels);
+	bitmap_cache_used -= e->dim.width * e->dim.height *
+			     fbinfo->bits_per_pixel / 8;
+	memset(e, 0, sizeof(*e));
+}
+
+static struct bitmap_cache_entry *bitmap_cache_lookup(const void *bitmap,
+						size_t size,
+						const struct vector *dim)
+{
+	int i;
+
+	for (i = 0; i < BITMAP_CACHE_ENTRIES; i++) {
+		struct bitmap_cache_entry *e = &bitmap_cache[i];
+		if (e->pixels && e->bitmap == bitmap && e->size == size &&
+		    e->dim.width == dim->width &&
+		    e->dim.height == dim->height) {
+			e->last_used = ++bitmap_cache_clock;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static struct bitmap_cache_entry *bitmap_cache_lru(void)
+{
+	struct bitmap_cache_entry *lru = NULL;
+	int i;
+
+	for (i = 0; i < BITMAP_CACHE_ENTRIES; i++) {
+		struct bitmap_cache_entry *e = &bitmap_cache[i];
+		if (e->pixels && (!lru || e->last_used < lru->last_used))
+			lru = e;
+	}
+
+	return lru;
+}
+
+/*
+ * Make room for 'bytes' of pixels, evicting the least recently used entries,
+ * and return a free slot. Returns NULL if the image can't be cached.
+ */
+static struct bitmap_cache_entry *bitmap_cache_alloc(size_t bytes)
+{
+	struct bitmap_cache_entry *e;
+	int i;
+
+	if (bytes > bitmap_cache_limit)
+		return NULL;
+
+	while (bitmap_cache_used + bytes > bitmap_cache_limit)
+		bitmap_cache_evict(bitmap_cache_lru());
+
+	for (i = 0; i < BITMAP_CACHE_ENTRIES; i++)
+		if (!bitmap_cache[i].pixels)
+			return &bitmap_cache[i];
+
+	e = bitmap_cache_lru();
+	bitmap_cache_evict(e);
+	return e;
+}
+
+int set_bitmap_cache_size(size_t size)
+{
+	if (cbgfx_init())
+		return CBGFX_ERROR_INIT;
+
+	bitmap_cache_limit = size;
+	while (bitmap_cache_used > bitmap_cache_limit)
+		bitmap_cache_evict(bitmap_cache_lru());
+
+	return CBGFX_SUCCESS;
+}
+
+static void copy_pixels(const struct vector *top_left,
+			const struct vector *dim, const uint8_t *pixels)
+{
+	const int bpp = fbinfo->bits_per_pixel / 8;
+	const size_t line = screen.size.width * bpp;
+	const size_t n = dim->width * bpp;
+	int32_t y;
+
+	for (y = 0; y < dim->height; y++)
+		memcpy(drawbuf + (top_left->y + y) * line + top_left->x * bpp,
+		       pixels + y * n, n);
 }
 
 static int draw_bitmap_v3(const struct vector *top_left,
@@ -258,11 +559,14 @@ static int draw_bitmap_v3(const struct vector *top_left,
 			  const struct vector *dim_org,
 			  const struct bitmap_header_v3 *header,
 			  const struct bitmap_palette_element_v3 *pal,
-			  const uint8_t *pixel_array)
+			  const uint8_t *pixel_array,
+			  const void *bitmap, size_t size)
 {
 	const int bpp = header->bits_per_pixel;
-	int32_t dir;
-	struct vector p;
+	const size_t line = screen.size.width * fbinfo->bits_per_pixel / 8;
+	struct bitmap_cache_entry *e;
+	size_t bytes;
+	int rv;
 
 	if (header->compression) {
 		LOG("Compressed bitmaps are not supported\n");
@@ -281,79 +585,45 @@ static int draw_bitmap_v3(const struct vector *top_left,
 		return CBGFX_ERROR_SCALE_OUT_OF_RANGE;
 	}
 
-	const int32_t y_stride = ROUNDUP(dim_org->width * bpp / 8, 4);
-	/*
-	 * header->height can be positive or negative.
-	 *
-	 * If it's negative, pixel data is stored from top to bottom. We render
-	 * image from the lowest row to the highest row.
-	 *
-	 * If it's positive, pixel data is stored from bottom to top. We render
-	 * image from the highest row to the lowest row.
-	 */
-	p.y = top_left->y;
-	if (header->height < 0) {
-		dir = 1;
-	} else {
-		p.y += dim->height - 1;
-		dir = -1;
+	mark_dirty(top_left, dim);
+
+	e = bitmap_cache_lookup(bitmap, size, dim);
+	if (e) {
+		copy_pixels(top_left, dim, e->pixels);
+		return CBGFX_SUCCESS;
 	}
+
 	/*
-	 * Plot pixels scaled by the bilinear interpolation. We scan over the
-	 * image on canvas (using d) and find the corresponding pixel in the
-	 * bitmap data (using s0, s1).
-	 *
-	 * When d hits the right bottom corner, s0 also hits the right bottom
-	 * corner of the pixel array because that's how scale->x and scale->y
-	 * have been set. Since the pixel array size is already validated in
-	 * parse_bitmap_header_v3, s0 is guranteed not to exceed pixel array
-	 * boundary.
+	 * When scale->x and scale->y have been set from dim and dim_org, the
+	 * last output pixel maps to the last source pixel. Since the pixel
+	 * array size is already validated in parse_bitmap_header_v3, sampling
+	 * is guaranteed not to exceed the pixel array boundary.
 	 */
-	struct vector s0, s1, d;
-	struct fraction tx, ty;
-	for (d.y = 0; d.y < dim->height; d.y++, p.y += dir) {
-		s0.y = d.y * scale->y.d / scale->y.n;
-		s1.y = s0.y;
-		if (s0.y + 1 < dim_org->height)
-			s1.y++;
-		ty.d = scale->y.n;
-		ty.n = (d.y * scale->y.d) % scale->y.n;
-		const uint8_t *data0 = pixel_array + s0.y * y_stride;
-		const uint8_t *data1 = pixel_array + s1.y * y_stride;
-		p.x = top_left->x;
-		for (d.x = 0; d.x < dim->width; d.x++, p.x++) {
-			s0.x = d.x * scale->x.d / scale->x.n;
-			s1.x = s0.x;
-			if (s1.x + 1 < dim_org->width)
-				s1.x++;
-			tx.d = scale->x.n;
-			tx.n = (d.x * scale->x.d) % scale->x.n;
-			uint8_t c00 = data0[s0.x];
-			uint8_t c10 = data0[s1.x];
-			uint8_t c01 = data1[s0.x];
-			uint8_t c11 = data1[s1.x];
-			if (c00 >= header->colors_used
-					|| c10 >= header->colors_used
-					|| c01 >= header->colors_used
-					|| c11 >= header->colors_used) {
-				LOG("Color index exceeds palette boundary\n");
-				return CBGFX_ERROR_BITMAP_DATA;
-			}
-			const struct rgb_color rgb = {
-				.red = bli(pal[c00].red, pal[c10].red,
-					   pal[c01].red, pal[c11].red,
-					   &tx, &ty),
-				.green = bli(pal[c00].green, pal[c10].green,
-					     pal[c01].green, pal[c11].green,
-					     &tx, &ty),
-				.blue = bli(pal[c00].blue, pal[c10].blue,
-					    pal[c01].blue, pal[c11].blue,
-					    &tx, &ty),
-			};
-			set_pixel(&p, calculate_color(&rgb));
-		}
+	bytes = dim->width * dim->height * fbinfo->bits_per_pixel / 8;
+	e = bitmap_cache_alloc(bytes);
+	if (e)
+		e->pixels = malloc(bytes);
+	if (!e || !e->pixels)
+		return scale_bitmap_v3(drawbuf + top_left->y * line +
+				       top_left->x * fbinfo->bits_per_pixel / 8,
+				       line, scale, dim, dim_org, header, pal,
+				       pixel_array);
+
+	rv = scale_bitmap_v3(e->pixels, dim->width * fbinfo->bits_per_pixel / 8,
+			     scale, dim, dim_org, header, pal, pixel_array);
+	if (rv) {
+		free(e->pixels);
+		e->pixels = NULL;
+		return rv;
 	}
 
+	e->bitmap = bitmap;
+	e->size = size;
+	e->dim = *dim;
+	e->last_used = ++bitmap_cache_clock;
+	bitmap_cache_used += bytes;
+	copy_pixels(top_left, dim, e->pixels);
+
 	return CBGFX_SUCCESS;
 }
 
@@ -583,7 +853,7 @@ int draw_bitmap(const void *bitmap, size_t size,
 	}
 
 	return draw_bitmap_v3(&top_left, &scale, &dim, &dim_org,
-			      &header, palette, pixel_array);
+			      &header, palette, pixel_array, bitmap, size);
 }
 
 int draw_bitmap_direct(const void *bitmap, size_t size,
@@ -618,7 +888,7 @@ int draw_bitmap_direct(const void *bitmap, size_t size,
 	}
 
 	return draw_bitmap_v3(top_left, &scale, &dim, &dim,
-			      &header, palette, pixel_array);
+			      &header, palette, pixel_array, bitmap, size);
 }
 
 int get_bitmap_dimension(const void *bitmap, size_t sz, struct scale *dim_rel)
@@ -651,3 +921,65 @@ int get_bitmap_dimension(const void *bitmap, size_t sz, struct scale *dim_rel)
 
 	return CBGFX_SUCCESS;
 }
+
+int enable_graphics_buffer(void)
+{
+	size_t size;
+
+	if (cbgfx_init())
+		return CBGFX_ERROR_INIT;
+
+	if (gfx_buffer)
+		return CBGFX_SUCCESS;
+
+	size = screen.size.width * screen.size.height *
+	       fbinfo->bits_per_pixel / 8;
+	gfx_buffer = malloc(size);
+	if (!gfx_buffer) {
+		LOG("Failed to allocate graphics buffer\n");
+		return CBGFX_ERROR_GRAPHICS_BUFFER;
+	}
+
+	/* Start from what's on the screen so partial redraws stay coherent. */
+	memcpy(gfx_buffer, fbaddr, size);
+	drawbuf = gfx_buffer;
+	dirty.size.width = 0;
+
+	return CBGFX_SUCCESS;
+}
+
+int flush_graphics_buffer(void)
+{
+	const int bpp = fbinfo ? fbinfo->bits_per_pixel / 8 : 0;
+	const size_t line = screen.size.width * bpp;
+	const size_t n = dirty.size.width * bpp;
+	size_t offset;
+	int y;
+
+	if (!gfx_buffer)
+		return CBGFX_ERROR_GRAPHICS_BUFFER;
+
+	for (y = dirty.offset.y; y < dirty.offset.y + dirty.size.height; y++) {
+		offset = y * line + dirty.offset.x * bpp;
+		memcpy(fbaddr + offset, gfx_buffer + offset, n);
+	}
+	dirty.size.width = 0;
+	dirty.size.height = 0;
+
+	return CBGFX_SUCCESS;
+}
+
+int disable_graphics_buffer(void)
+{
+	int rv;
+
+	rv = flush_graphics_buffer();
+	if (rv)
+		return rv;
+
+	free(gfx_buffer);
+	gfx_buffer = NULL;
+	drawbuf = fbaddr;
+
+	return CBGFX_SUCCESS;
+}
@@ -71,11 +71,12 @@ void video_get_rows_cols(unsigned int *rows, unsigned int *cols)
 	}
 }
 
-static void video_console_fixup_cursor(void)
+/*
+ * Wrap and scroll as needed after the cursor position has changed. This does
+ * not move the displayed cursor, see video_console_fixup_cursor().
+ */
+static void video_console_fixup_position(void)
 {
-	if (!console)
-		return;
-
 	if (cursorx < 0)
 		cursorx = 0;
 
@@ -91,6 +92,14 @@ static void video_console_fixup_cursor(void)
 		console->scroll_up();
 		cursory--;
 	}
+}
+
+static void video_console_fixup_cursor(void)
+{
+	if (!console)
+		return;
+
+	video_console_fixup_position();
 
 	if (console->set_cursor)
 		console->set_cursor(cursorx, cursory);
@@ -120,11 +129,9 @@ void video_console_putc(u8 row, u8 col, unsigned int ch)
 		console->putc(row, col, ch);
 }
 
-void video_console_putchar(unsigned int ch)
+/* Output a character without updating the displayed cursor */
+static void video_console_emit(unsigned int ch)
 {
-	if (!console)
-		return;
-
 	/* replace black-on-black with light-gray-on-black.
 	 * do it here, instead of in libc/console.c
 	 */
@@ -159,7 +166,36 @@ void video_console_putchar(unsigned int ch)
 		break;
 	}
 
-	video_console_fixup_cursor();
+	video_console_fixup_position();
+}
+
+void video_console_putchar(unsigned int ch)
+{
+	if (!console)
+		return;
+
+	video_console_emit(ch);
+
+	if (console->set_cursor)
+		console->set_cursor(cursorx, cursory);
+}
+
+/*
+ * Output a whole string and only move the displayed cursor at the end. This
+ * saves redrawing the cursor cell twice for every character.
+ */
+static void video_console_write(const void *buffer, size_t count)
+{
+	const unsigned char *ptr = buffer;
+
+	if (!console)
+		return;
+
+	while (count--)
+		video_console_emit(*ptr++);
+
+	if (console->set_cursor)
+		console->set_cursor(cursorx, cursory);
 }
 
 void video_printf(int foreground, int background, enum video_printf_align align,
@@ -204,7 +240,10 @@ void video_printf(int foreground, int background, enum video_printf_align align,
 	background <<= 12;
 
 	while (str[i])
-		video_console_putchar(str[i++] | foreground | background);
+		video_console_emit(str[i++] | foreground | background);
+
+	if (console->set_cursor)
+		console->set_cursor(cursorx, cursory);
 }
 
 void video_console_get_cursor(unsigned int *x, unsigned int *y, unsigned int *en)
@@ -228,7 +267,8 @@ void video_console_set_cursor(unsigned int x, unsigned int y)
 }
 
 static struct console_output_driver cons = {
-	.putchar = video_console_putchar
+	.putchar = video_console_putchar,
+	.write = video_console_write,
 };
 
 int video_init(void)
@@ -269,6 +269,27 @@ struct cbfs_file *cbfs_get_file(struct cbfs_media *media, const char *name);
 void *cbfs_get_file_content(struct cbfs_media *media, const char *name,
 			    int type, size_t *sz);
 
+/*
+ * Directory and content cache for CBFS_DEFAULT_MEDIA, see CONFIG_LP_CBFS_CACHE.
+ */
+
+/* Drop the cached directory and all cached contents. */
+void cbfs_cache_invalidate(void);
+
+/*
+ * Keep up to size bytes of decompressed file contents cached, evicting the
+ * least recently used files. cbfs_get_file_content() still returns a copy the
+ * caller owns. 0 (the default) disables the content cache.
+ */
+void cbfs_cache_set_budget(size_t size);
+
+/*
+ * Load and decompress the named files into the content cache. They are read
+ * in ascending flash offset order to minimize seeks on the boot media.
+ * Returns the number of files now cached.
+ */
+int cbfs_preload(const char * const names[], size_t count);
+
 /* returns decompressed size on success, 0 on failure */
 int cbfs_decompress(int algo, void *src, void *dst, int len);
 
@@ -57,6 +57,8 @@
 #define CBGFX_ERROR_FRAMEBUFFER_ADDR	0x15
 /* portrait screen not supported */
 #define CBGFX_ERROR_PORTRAIT_SCREEN	0x16
+/* graphics buffer not enabled or failed to allocate */
+#define CBGFX_ERROR_GRAPHICS_BUFFER	0x17
 
 struct fraction {
 	int32_t n;
@@ -184,3 +186,46 @@ int draw_bitmap_direct(const void *bitmap, size_t size,
  * in the original size are returned.
  */
 int get_bitmap_dimension(const void *bitmap, size_t sz, struct scale *dim_rel);
+
+/**
+ * Draw to a shadow buffer in cached memory instead of the framebuffer
+ *
+ * @return CBGFX_* error codes
+ *
+ * Once enabled, draw_* and clear_* calls only update the shadow buffer and
+ * nothing shows up on the screen until flush_graphics_buffer() is called.
+ * This avoids slow per-pixel accesses to an uncached framebuffer and lets a
+ * whole screen be composed before it's displayed.
+ */
+int enable_graphics_buffer(void);
+
+/**
+ * Copy the area changed since the last flush to the framebuffer
+ *
+ * @return CBGFX_* error codes
+ */
+int flush_graphics_buffer(void);
+
+/**
+ * Flush and release the shadow buffer, and draw to the framebuffer directly
+ *
+ * @return CBGFX_* error codes
+ */
+int disable_graphics_buffer(void);
+
+/**
+ * Set the memory budget for caching scaled bitmaps
+ *
+ * @param[in] size	Maximum number of bytes used for cached images. Zero
+ *			disables the cache and frees all entries.
+ *
+ * @return CBGFX_* error codes
+ *
+ * Bitmaps drawn by draw_bitmap() and draw_bitmap_direct() are kept scaled and
+ * converted to the framebuffer format, so drawing the same image at the same
+ * size again only copies pixels. Entries are identified by the address and
+ * size of the bitmap data, so callers must not modify or reuse a buffer for a
+ * different image while it may be cached. Call this with zero to drop all
+ * entries before doing so. The cache is disabled by default.
+ */
+int set_bitmap_cache_size(size_t size);
@@ -42,7 +42,18 @@ static void *default_memset(void *s, int c, size_t n)
 	for (i = 1; i < sizeof(unsigned long); i <<= 1)
 		w = (w << (i * 8)) | w;
 
-	for (i = 0; i < n / sizeof(unsigned long); i++)
+	/* Align the destination so all word stores below are aligned. */
+	for (; n && ((uintptr_t)s % sizeof(unsigned long)); n--)
+		*(u8 *)s++ = (u8)c;
+
+	for (i = 0; i + 4 <= n / sizeof(unsigned long); i += 4) {
+		((unsigned long *)s)[i + 0] = w;
+		((unsigned long *)s)[i + 1] = w;
+		((unsigned long *)s)[i + 2] = w;
+		((unsigned long *)s)[i + 3] = w;
+	}
+
+	for (; i < n / sizeof(unsigned long); i++)
 		((unsigned long *)s)[i] = w;
 
 	s += i * sizeof(unsigned long);
@@ -61,13 +72,28 @@ static void *default_memcpy(void *dst, const void *src, size_t n)
 	size_t i;
 	void *ret = dst;
 
-	for(i = 0; i < n / sizeof(unsigned long); i++)
+	/* Align the destination so all word stores below are aligned. */
+	for (; n && ((uintptr_t)dst % sizeof(unsigned long)); n--)
+		*(u8 *)dst++ = *(const u8 *)src++;
+
+	for (i = 0; i + 4 <= n / sizeof(unsigned long); i += 4) {
+		unsigned long a = ((unsigned long *)src)[i + 0];
+		unsigned long b = ((unsigned long *)src)[i + 1];
+		unsigned long c = ((unsigned long *)src)[i + 2];
+		unsigned long d = ((unsigned long *)src)[i + 3];
+		((unsigned long *)dst)[i + 0] = a;
+		((unsigned long *)dst)[i + 1] = b;
+		((unsigned long *)dst)[i + 2] = c;
+		((unsigned long *)dst)[i + 3] = d;
+	}
+
+	for (; i < n / sizeof(unsigned long); i++)
 		((unsigned long *)dst)[i] = ((unsigned long *)src)[i];
 
 	src += i * sizeof(unsigned long);
 	dst += i * sizeof(unsigned long);
 
-	for(i = 0; i < n % sizeof(unsigned long); i++)
+	for (i = 0; i < n % sizeof(unsigned long); i++)
 		((u8 *)dst)[i] = ((u8 *)src)[i];
 
 	return ret;
@@ -135,31 +135,24 @@ static int get_cbfs_range(uint32_t *offset, uint32_t *cbfs_end,
 	return 0;
 }
 
-/* public API starts here*/
-struct cbfs_file *cbfs_get_file(struct cbfs_media *media, const char *name)
+/*
+ * Walk all files in the CBFS and call fn() for each one with the offset of
+ * its header, the header itself and its mapped name. The walk stops when fn()
+ * returns non-zero and that value is returned. fn() is responsible for
+ * unmapping the name if it returns non-zero.
+ */
+static int cbfs_walk(struct cbfs_media *media, uint32_t offset,
+		     uint32_t cbfs_end,
+		     int (*fn)(struct cbfs_media *media, uint32_t offset,
+			       const struct cbfs_file *file,
+			       const char *name, void *arg),
+		     void *arg)
 {
 	const char *vardata;
-	uint32_t offset, cbfs_end, vardata_len;
-	struct cbfs_file file, *file_ptr;
-	struct cbfs_media default_media;
-
-	if (get_cbfs_range(&offset, &cbfs_end, media)) {
-		ERROR("Failed to find cbfs range\n");
-		return NULL;
-	}
-
-	if (media == CBFS_DEFAULT_MEDIA) {
-		media = &default_media;
-		if (init_default_cbfs_media(media) != 0) {
-			ERROR("Failed to initialize default media.\n");
-			return NULL;
-		}
-	}
+	uint32_t vardata_len;
+	struct cbfs_file file;
+	int ret;
 
-	DEBUG("CBFS location: 0x%x~0x%x\n", offset, cbfs_end);
-	DEBUG("Looking for '%s' starting from 0x%x.\n", name, offset);
-
-	media->open(media);
 	while (offset < cbfs_end &&
 	       media->read(media, &file, offset, sizeof(file)) == sizeof(file)) {
 		if (memcmp(CBFS_FILE_MAGIC, file.magic,
@@ -183,19 +176,10 @@ struct cbfs_file *cbfs_get_file(struct cbfs_media *media, const char *name)
 				media, offset + sizeof(file), vardata_len);
 		if (vardata == CBFS_MEDIA_INVALID_MAP_ADDRESS) {
 			ERROR("ERROR: Failed to get filename: 0x%x.\n", offset);
-		} else if (strcmp(vardata, name) == 0) {
-			int file_offset = ntohl(file.offset),
-			    file_len = ntohl(file.len);
-			DEBUG("Found file (offset=0x%x, len=%d).\n",
-			    offset + file_offset, file_len);
-			media->unmap(media, vardata);
-			file_ptr = media->map(media, offset,
-					      file_offset + file_len);
-			media->close(media);
-			return file_ptr;
 		} else {
-			DEBUG(" (unmatched file @0x%x: %s)\n", offset,
-			      vardata);
+			ret = fn(media, offset, &file, vardata, arg);
+			if (ret)
+				return ret;
 			media->unmap(media, vardata);
 		}
 
@@ -204,6 +188,363 @@ struct cbfs_file *cbfs_get_file(struct cbfs_media *media, const char *name)
 		if (offset % CBFS_ALIGNMENT)
 			offset += CBFS_ALIGNMENT - (offset % CBFS_ALIGNMENT);
 	}
+
+	return 0;
+}
+
+struct cbfs_find_arg {
+	const char *name;
+	struct cbfs_file *file;
+};
+
+static int cbfs_find_fn(struct cbfs_media *media, uint32_t offset,
+			const struct cbfs_file *file, const char *name,
+			void *arg)
+{
+	struct cbfs_find_arg *find = arg;
+
+	if (strcmp(name, find->name) != 0) {
+		DEBUG(" (unmatched file @0x%x: %s)\n", offset, name);
+		return 0;
+	}
+
+	int file_offset = ntohl(file->offset),
+	    file_len = ntohl(file->len);
+	DEBUG("Found file (offset=0x%x, len=%d).\n",
+	    offset + file_offset, file_len);
+	media->unmap(media, name);
+	find->file = media->map(media, offset, file_offset + file_len);
+	return 1;
+}
+
+#if IS_ENABLED(CONFIG_LP_CBFS_CACHE)
+/*
+ * Directory of the default media, built on first access so that lookups
+ * don't have to walk the CBFS through the media callbacks again. Entries can
+ * also hold a decompressed copy of the file content.
+ */
+struct cbfs_dir_entry {
+	char *name;
+	uint32_t offset;	/* of the file header */
+	uint32_t header_len;	/* header, name and attributes */
+	uint32_t len;
+	uint32_t type;
+	uint32_t compression;
+	uint32_t decompressed_size;
+	void *content;
+	uint32_t last_used;
+};
+
+static struct cbfs_dir_entry *cbfs_dir;
+static size_t cbfs_dir_count;
+static int cbfs_dir_valid;
+
+static size_t cbfs_content_budget;
+static size_t cbfs_content_used;
+static uint32_t cbfs_content_clock;
+
+static int cbfs_dir_add_fn(struct cbfs_media *media, uint32_t offset,
+			   const struct cbfs_file *file, const char *name,
+			   void *arg)
+{
+	struct cbfs_dir_entry *e, *dir;
+	struct cbfs_file *header;
+	struct cbfs_file_attr_compression *comp;
+	size_t *allocated = arg;
+
+	if (cbfs_dir_count == *allocated) {
+		*allocated = *allocated ? *allocated * 2 : 64;
+		dir = realloc(cbfs_dir, *allocated * sizeof(*dir));
+		if (!dir)
+			goto err;
+		cbfs_dir = dir;
+	}
+
+	e = &cbfs_dir[cbfs_dir_count];
+	memset(e, 0, sizeof(*e));
+	e->offset = offset;
+	e->header_len = ntohl(file->offset);
+	e->len = ntohl(file->len);
+	e->type = ntohl(file->type);
+	e->compression = CBFS_COMPRESS_NONE;
+	e->decompressed_size = e->len;
+
+	/* Attributes are covered by the header, so this is a small mapping. */
+	header = media->map(media, offset, e->header_len);
+	if (header == CBFS_MEDIA_INVALID_MAP_ADDRESS)
+		goto err;
+	comp = (struct cbfs_file_attr_compression *)
+		cbfs_file_find_attr(header, CBFS_FILE_ATTR_TAG_COMPRESSION);
+	if (comp) {
+		e->compression = ntohl(comp->compression);
+		e->decompressed_size = ntohl(comp->decompressed_size);
+	}
+	media->unmap(media, header);
+
+	e->name = strdup(name);
+	if (!e->name)
+		goto err;
+
+	cbfs_dir_count++;
+	return 0;
+
+err:
+	ERROR("Failed to cache CBFS directory entry at 0x%x.\n", offset);
+	media->unmap(media, name);
+	return -1;
+}
+
+void cbfs_cache_invalidate(void)
+{
+	size_t i;
+
+	for (i = 0; i < cbfs_dir_count; i++) {
+		free(cbfs_dir[i].name);
+		free(cbfs_dir[i].content);
+	}
+	free(cbfs_dir);
+	cbfs_dir = NULL;
+	cbfs_dir_count = 0;
+	cbfs_dir_valid = 0;
+	cbfs_content_used = 0;
+}
+
+static int cbfs_dir_build(struct cbfs_media *media, uint32_t offset,
+			  uint32_t cbfs_end)
+{
+	size_t allocated = 0;
+
+	if (cbfs_dir_valid)
+		return 0;
+
+	if (cbfs_walk(media, offset, cbfs_end, cbfs_dir_add_fn, &allocated)) {
+		cbfs_cache_invalidate();
+		return -1;
+	}
+
+	cbfs_dir_valid = 1;
+	return 0;
+}
+
+static struct cbfs_dir_entry *cbfs_dir_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < cbfs_dir_count; i++)
+		if (strcmp(cbfs_dir[i].name, name) == 0)
+			return &cbfs_dir[i];
+
+	return NULL;
+}
+
+/* Look up name in the directory of the default media, building it first. */
+static struct cbfs_dir_entry *cbfs_dir_lookup(const char *name)
+{
+	struct cbfs_media media;
+	uint32_t offset, cbfs_end;
+	int ret;
+
+	if (!cbfs_dir_valid) {
+		if (get_cbfs_range(&offset, &cbfs_end, CBFS_DEFAULT_MEDIA))
+			return NULL;
+		if (init_default_cbfs_media(&media) != 0)
+			return NULL;
+		media.open(&media);
+		ret = cbfs_dir_build(&media, offset, cbfs_end);
+		media.close(&media);
+		if (ret)
+			return NULL;
+	}
+
+	return cbfs_dir_find(name);
+}
+
+static void cbfs_content_evict(struct cbfs_dir_entry *e)
+{
+	free(e->content);
+	e->content = NULL;
+	cbfs_content_used -= e->decompressed_size;
+}
+
+/* Free the least recently used content until size more bytes fit. */
+static int cbfs_content_make_room(size_t size)
+{
+	struct cbfs_dir_entry *lru;
+	size_t i;
+
+	if (size > cbfs_content_budget)
+		return -1;
+
+	while (cbfs_content_used + size > cbfs_content_budget) {
+		lru = NULL;
+		for (i = 0; i < cbfs_dir_count; i++)
+			if (cbfs_dir[i].content && (!lru ||
+			    cbfs_dir[i].last_used < lru->last_used))
+				lru = &cbfs_dir[i];
+		if (!lru)
+			return -1;
+		cbfs_content_evict(lru);
+	}
+
+	return 0;
+}
+
+static void cbfs_content_store(struct cbfs_dir_entry *e, void *content)
+{
+	e->content = content;
+	e->last_used = ++cbfs_content_clock;
+	cbfs_content_used += e->decompressed_size;
+}
+
+/* Load and decompress the content of e into the cache. */
+static int cbfs_content_fill(struct cbfs_media *media,
+			     struct cbfs_dir_entry *e)
+{
+	struct cbfs_file *file;
+	void *dst;
+
+	if (e->content)
+		return 0;
+
+	if (cbfs_content_make_room(e->decompressed_size))
+		return -1;
+
+	dst = malloc(e->decompressed_size);
+	if (!dst)
+		return -1;
+
+	file = media->map(media, e->offset, e->header_len + e->len);
+	if (file == CBFS_MEDIA_INVALID_MAP_ADDRESS) {
+		free(dst);
+		return -1;
+	}
+
+	if (!cbfs_decompress(e->compression, CBFS_SUBHEADER(file), dst,
+			     e->decompressed_size)) {
+		media->unmap(media, file);
+		free(dst);
+		return -1;
+	}
+	media->unmap(media, file);
+
+	cbfs_content_store(e, dst);
+	return 0;
+}
+
+void cbfs_cache_set_budget(size_t size)
+{
+	cbfs_content_budget = size;
+	cbfs_content_make_room(0);
+	if (!size) {
+		size_t i;
+		for (i = 0; i < cbfs_dir_count; i++)
+			if (cbfs_dir[i].content)
+				cbfs_content_evict(&cbfs_dir[i]);
+	}
+}
+
+static int cbfs_dir_offset_cmp(const void *a, const void *b)
+{
+	const struct cbfs_dir_entry *ea = *(const struct cbfs_dir_entry **)a;
+	const struct cbfs_dir_entry *eb = *(const struct cbfs_dir_entry **)b;
+
+	return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+int cbfs_preload(const char * const names[], size_t count)
+{
+	struct cbfs_dir_entry **entries;
+	struct cbfs_media media;
+	size_t i, n = 0;
+	int loaded = 0;
+
+	if (!count)
+		return 0;
+
+	/* Make sure the directory has been built. */
+	cbfs_dir_lookup(names[0]);
+	if (!cbfs_dir_valid)
+		return 0;
+
+	entries = malloc(count * sizeof(*entries));
+	if (!entries)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		struct cbfs_dir_entry *e = cbfs_dir_find(names[i]);
+		if (e && !e->content)
+			entries[n++] = e;
+	}
+
+	/* Read in flash order so the boot media sees one sequential pass. */
+	qsort(entries, n, sizeof(*entries), cbfs_dir_offset_cmp);
+
+	if (n && init_default_cbfs_media(&media) == 0) {
+		media.open(&media);
+		for (i = 0; i < n; i++)
+			if (!cbfs_content_fill(&media, entries[i]))
+				loaded++;
+		media.close(&media);
+	}
+
+	free(entries);
+	return loaded;
+}
+#endif /* CONFIG_LP_CBFS_CACHE */
+
+/* public API starts here*/
+struct cbfs_file *cbfs_get_file(struct cbfs_media *media, const char *name)
+{
+	uint32_t offset, cbfs_end;
+	struct cbfs_media default_media;
+	struct cbfs_find_arg find = {
+		.name = name,
+		.file = NULL,
+	};
+
+#if IS_ENABLED(CONFIG_LP_CBFS_CACHE)
+	if (media == CBFS_DEFAULT_MEDIA) {
+		struct cbfs_dir_entry *e = cbfs_dir_lookup(name);
+
+		if (cbfs_dir_valid) {
+			if (!e) {
+				LOG("WARNING: '%s' not found.\n", name);
+				return NULL;
+			}
+			if (init_default_cbfs_media(&default_media) != 0) {
+				ERROR("Failed to initialize default media.\n");
+				return NULL;
+			}
+			default_media.open(&default_media);
+			find.file = default_media.map(&default_media,
+					e->offset, e->header_len + e->len);
+			default_media.close(&default_media);
+			return find.file;
+		}
+	}
+#endif
+
+	if (get_cbfs_range(&offset, &cbfs_end, media)) {
+		ERROR("Failed to find cbfs range\n");
+		return NULL;
+	}
+
+	if (media == CBFS_DEFAULT_MEDIA) {
+		media = &default_media;
+		if (init_default_cbfs_media(media) != 0) {
+			ERROR("Failed to initialize default media.\n");
+			return NULL;
+		}
+	}
+
+	DEBUG("CBFS location: 0x%x~0x%x\n", offset, cbfs_end);
+	DEBUG("Looking for '%s' starting from 0x%x.\n", name, offset);
+
+	media->open(media);
+	if (cbfs_walk(media, offset, cbfs_end, cbfs_find_fn, &find)) {
+		media->close(media);
+		return find.file;
+	}
 	media->close(media);
 	LOG("WARNING: '%s' not found.\n", name);
 	return NULL;
@@ -212,6 +553,24 @@ struct cbfs_file *cbfs_get_file(struct cbfs_media *media, const char *name)
 void *cbfs_get_file_content(struct cbfs_media *media, const char *name,
 			    int type, size_t *sz)
 {
+#if IS_ENABLED(CONFIG_LP_CBFS_CACHE)
+	struct cbfs_dir_entry *e = NULL;
+
+	if (media == CBFS_DEFAULT_MEDIA && cbfs_content_budget) {
+		e = cbfs_dir_lookup(name);
+		if (e && e->content && e->type == type) {
+			void *copy = malloc(e->decompressed_size);
+			if (!copy)
+				return NULL;
+			memcpy(copy, e->content, e->decompressed_size);
+			e->last_used = ++cbfs_content_clock;
+			if (sz)
+				*sz = e->decompressed_size;
+			return copy;
+		}
+	}
+#endif
+
 	/*
 	 * get file (possibly compressed) data. we pass through 'media' to
 	 * cbfs_get_file (don't call init_default_cbfs_media) here so that
@@ -262,6 +621,18 @@ void *cbfs_get_file_content(struct cbfs_media *media, const char *name,
 	if (sz)
 		*sz = final_size;
 
+#if IS_ENABLED(CONFIG_LP_CBFS_CACHE)
+	/* Keep a copy for later calls if it fits in the budget. */
+	if (e && !e->content && e->decompressed_size == final_size &&
+	    !cbfs_content_make_room(final_size)) {
+		void *copy = malloc(final_size);
+		if (copy) {
+			memcpy(copy, dst, final_size);
+			cbfs_content_store(e, copy);
+		}
+	}
+#endif
+
 	return dst;
 
 err:
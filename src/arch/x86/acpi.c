@@ -39,6 +39,7 @@
 #include <string.h>
 #include <arch/acpi.h>
 #include <arch/acpigen.h>
+#include <arch/table_cache.h>
 #include <device/pci.h>
 #include <cbmem.h>
 #include <cpu/x86/lapic_def.h>
@@ -918,7 +919,9 @@ unsigned long write_acpi_tables(unsigned long start)
 
 	printk(BIOS_DEBUG, "ACPI:     * SSDT\n");
 	ssdt = (acpi_header_t *)current;
-	acpi_create_ssdt_generator(ssdt, ACPI_TABLE_CREATOR);
+	if (!table_cache_restore_ssdt(ssdt))
+		acpi_create_ssdt_generator(ssdt, ACPI_TABLE_CREATOR);
+	table_cache_record_ssdt(ssdt);
 	if (ssdt->length > sizeof(acpi_header_t)) {
 		current += ssdt->length;
 		acpi_add_table(rsdp, ssdt);
@@ -0,0 +1,20 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef ARCH_X86_STRING_H
+#define ARCH_X86_STRING_H
+
+/* Below this size fast strings don't pay off even with ERMS. */
+#define MEMCPY_ERMS_THRESHOLD	256
+
+#endif /* ARCH_X86_STRING_H */
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef ARCH_X86_TABLE_CACHE_H
+#define ARCH_X86_TABLE_CACHE_H
+
+#include <arch/acpi.h>
+
+/*
+ * The generated SSDT and SMBIOS tables are kept in the RW_TABLE_CACHE FMAP
+ * region together with a hash of everything they are generated from. On a
+ * boot with the same hash they are copied from there instead of being
+ * generated again.
+ *
+ * The restore functions return 0 when the tables have to be generated.
+ * Either way the record functions have to be called with the tables that
+ * end up being used, the cache is written back after BS_WRITE_TABLES if
+ * they differ from what was cached.
+ */
+
+/*
+ * MSRs the CPU code computes its part of the SSDT from, e.g. the P-states.
+ * They are folded into the hash, the default covers only CPUID.
+ */
+const u32 *table_cache_cpu_msrs(size_t *count);
+
+#if IS_ENABLED(CONFIG_TABLE_CACHE)
+/* Returns 1 if a valid SSDT was copied to ssdt. */
+int table_cache_restore_ssdt(acpi_header_t *ssdt);
+void table_cache_record_ssdt(const acpi_header_t *ssdt);
+/* Returns the end of the SMBIOS tables copied to start. */
+unsigned long table_cache_restore_smbios(unsigned long start);
+void table_cache_record_smbios(unsigned long start, unsigned long end);
+#else
+static inline int table_cache_restore_ssdt(acpi_header_t *ssdt)
+{
+	return 0;
+}
+static inline void table_cache_record_ssdt(const acpi_header_t *ssdt) {}
+static inline unsigned long table_cache_restore_smbios(unsigned long start)
+{
+	return 0;
+}
+static inline void table_cache_record_smbios(unsigned long start,
+					     unsigned long end) {}
+#endif
+
+#endif /* ARCH_X86_TABLE_CACHE_H */
@@ -11,15 +11,83 @@
  * GNU General Public License for more details.
  */
 
+#include <arch/string.h>
+#include <stdint.h>
 #include <string.h>
 
+/*
+ * rep movs has a startup cost of a few dozen cycles, so tiny copies are
+ * done with plain (possibly overlapping) register moves instead.
+ */
+#define MEMCPY_SMALL		16
+
+typedef uint32_t __attribute__((may_alias)) u32_alias_t;
+
+static inline void memcpy_small(uint8_t *d, const uint8_t *s, size_t n)
+{
+	uint32_t a, b, c, e;
+
+	if (n >= 8) {
+		a = *(const u32_alias_t *)s;
+		b = *(const u32_alias_t *)(s + 4);
+		c = *(const u32_alias_t *)(s + n - 8);
+		e = *(const u32_alias_t *)(s + n - 4);
+		*(u32_alias_t *)d = a;
+		*(u32_alias_t *)(d + 4) = b;
+		*(u32_alias_t *)(d + n - 8) = c;
+		*(u32_alias_t *)(d + n - 4) = e;
+	} else if (n >= 4) {
+		a = *(const u32_alias_t *)s;
+		b = *(const u32_alias_t *)(s + n - 4);
+		*(u32_alias_t *)d = a;
+		*(u32_alias_t *)(d + n - 4) = b;
+	} else if (n) {
+		/* Covers 1, 2 and 3 bytes. */
+		d[0] = s[0];
+		d[n / 2] = s[n / 2];
+		d[n - 1] = s[n - 1];
+	}
+}
+
 void *memcpy(void *dest, const void *src, size_t n)
 {
 	unsigned long d0, d1, d2;
+	size_t head;
+
+	if (n < MEMCPY_SMALL) {
+		memcpy_small(dest, src, n);
+		return dest;
+	}
+
+	if (IS_ENABLED(CONFIG_X86_ERMS) && n >= MEMCPY_ERMS_THRESHOLD) {
+		asm volatile(
+			"rep ; movsb\n\t"
+			: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+			: "0" (n), "1" (dest), "2" (src)
+			: "memory"
+		);
+		return dest;
+	}
+
+	/*
+	 * Align the destination so the dword moves below never straddle
+	 * a cache line on the store side. The head is copied with a single
+	 * unaligned dword move, which is fine since n >= MEMCPY_SMALL.
+	 */
+	head = -(uintptr_t)dest & 3;
+	if (head) {
+		*(u32_alias_t *)dest = *(const u32_alias_t *)src;
+		d1 = (unsigned long)dest + head;
+		d2 = (unsigned long)src + head;
+		n -= head;
+	} else {
+		d1 = (unsigned long)dest;
+		d2 = (unsigned long)src;
+	}
 
 	asm volatile(
 #ifdef __x86_64__
-		"rep ; movsd\n\t"
+		"rep ; movsl\n\t"
 		"mov %4,%%rcx\n\t"
 #else
 		"rep ; movsl\n\t"
@@ -27,7 +95,7 @@ void *memcpy(void *dest, const void *src, size_t n)
 #endif
 		"rep ; movsb\n\t"
 		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
-		: "0" (n >> 2), "g" (n & 3), "1" (dest), "2" (src)
+		: "0" (n >> 2), "g" (n & 3), "1" (d1), "2" (d2)
 		: "memory"
 	);
 
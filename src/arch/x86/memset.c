@@ -15,6 +15,7 @@
 
 /* From glibc-2.14, sysdeps/i386/memset.c */
 
+#include <arch/string.h>
 #include <string.h>
 #include <stdint.h>
 
@@ -33,6 +34,17 @@ void *memset(void *dstpp, int c, size_t len)
 	/* Clear the direction flag, so filling will move forward.  */
 	asm volatile("cld");
 
+	/* With fast strings a single byte-granular fill is fastest. */
+	if (IS_ENABLED(CONFIG_X86_ERMS) && len >= MEMCPY_ERMS_THRESHOLD) {
+		asm volatile(
+			"rep\n"
+			"stosb" /* %0, %2, %3 */ :
+			"=D" (dstp), "=c" (d0) :
+			"0" (dstp), "1" (len), "a" (x) :
+			"memory");
+		return dstpp;
+	}
+
 	/* This threshold value is optimal.  */
 	if (len >= 12) {
 		/* Fill X with four copies of the char we want to fill with. */
@@ -0,0 +1,426 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/acpi.h>
+#include <arch/cpu.h>
+#include <arch/table_cache.h>
+#include <bootstate.h>
+#include <cbmem.h>
+#include <commonlib/fnv.h>
+#include <console/console.h>
+#include <cpu/x86/msr.h>
+#include <device/device.h>
+#include <fmap.h>
+#include <pc80/mc146818rtc.h>
+#include <smbios.h>
+#include <spi_flash.h>
+#include <string.h>
+#include <version.h>
+
+#if IS_ENABLED(CONFIG_USE_OPTION_TABLE)
+#include "option_table.h"
+#endif
+
+#define TABLE_CACHE_REGION	"RW_TABLE_CACHE"
+#define TABLE_CACHE_SIGNATURE	(('T'<<0)|('B'<<8)|('L'<<16)|('C'<<24))
+#define TABLE_CACHE_VERSION	1
+
+struct table_cache_header {
+	uint32_t signature;
+	uint32_t version;
+	uint64_t key;		/* hash of the table generation inputs */
+	uint64_t checksum;	/* of the data following the header */
+	uint32_t smbios_addr;	/* SMBIOS tables contain absolute pointers */
+	uint32_t ssdt_size;
+	uint32_t smbios_size;
+	uint32_t reserved;
+} __attribute__((packed));
+
+enum table_cache_state {
+	TABLE_CACHE_UNKNOWN,	/* not looked up yet */
+	TABLE_CACHE_MISS,	/* tables are generated and written back */
+	TABLE_CACHE_HIT,	/* tables are copied from the cache */
+	TABLE_CACHE_BROKEN,	/* no usable region, do nothing */
+};
+
+static struct {
+	enum table_cache_state state;
+	struct region_device rdev;
+	struct table_cache_header hdr;
+	const uint8_t *data;
+	uint64_t key;
+	const void *ssdt;
+	size_t ssdt_size;
+	unsigned long smbios;
+	size_t smbios_size;
+} tc;
+
+__attribute__((weak)) const u32 *table_cache_cpu_msrs(size_t *count)
+{
+	*count = 0;
+	return NULL;
+}
+
+static uint64_t table_cache_key_cpu(uint64_t h)
+{
+	static const uint32_t leaves[] = {
+		0, 1, 6, 0x80000000, 0x80000002, 0x80000003, 0x80000004,
+	};
+	const u32 *msrs;
+	size_t count;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(leaves); i++) {
+		struct cpuid_result r = cpuid(leaves[i]);
+
+		/* Leave out the initial APIC ID of the CPU running this. */
+		if (leaves[i] == 1)
+			r.ebx &= 0x00ffffff;
+		h = fnv1a64(h, &r, sizeof(r));
+	}
+
+	msrs = table_cache_cpu_msrs(&count);
+	for (i = 0; i < count; i++) {
+		msr_t msr = rdmsr(msrs[i]);
+
+		h = fnv1a64(h, &msr, sizeof(msr));
+	}
+
+	return h;
+}
+
+static uint64_t fnv1a64_str(uint64_t h, const char *s)
+{
+	if (s == NULL)
+		return h;
+
+	return fnv1a64(h, s, strlen(s) + 1);
+}
+
+/* The board strings may come from VPD or the EC, e.g. the serial number. */
+static uint64_t table_cache_key_smbios(uint64_t h)
+{
+	u8 uuid[16];
+	u8 enclosure;
+
+	if (!IS_ENABLED(CONFIG_GENERATE_SMBIOS_TABLES))
+		return h;
+
+	h = fnv1a64_str(h, smbios_mainboard_manufacturer());
+	h = fnv1a64_str(h, smbios_mainboard_product_name());
+	h = fnv1a64_str(h, smbios_mainboard_serial_number());
+	h = fnv1a64_str(h, smbios_mainboard_version());
+	h = fnv1a64_str(h, smbios_mainboard_bios_version());
+#ifdef CONFIG_MAINBOARD_FAMILY
+	h = fnv1a64_str(h, smbios_mainboard_family());
+#endif
+
+	memset(uuid, 0, sizeof(uuid));
+	smbios_mainboard_set_uuid(uuid);
+	h = fnv1a64(h, uuid, sizeof(uuid));
+
+	enclosure = smbios_mainboard_enclosure_type();
+	return fnv1a64(h, &enclosure, sizeof(enclosure));
+}
+
+/*
+ * The SSDT carries the addresses of CBMEM entries, e.g. GNVS, and the ones
+ * added while generating it land at an offset from cbmem_top().
+ */
+static uint64_t table_cache_key_cbmem(uint64_t h)
+{
+	static const uint32_t placed_ids[] = {
+		CBMEM_ID_ACPI,
+		CBMEM_ID_ACPI_GNVS,
+		CBMEM_ID_CONSOLE,
+		CBMEM_ID_POWER_STATE,
+		CBMEM_ID_RAM_OOPS,
+		CBMEM_ID_TCPA_LOG,
+		CBMEM_ID_VBOOT_HANDOFF,
+	};
+	static const uint32_t content_ids[] = {
+		CBMEM_ID_MEMINFO,
+		CBMEM_ID_AMDMCT_MEMINFO,
+		CBMEM_ID_VPD,
+	};
+	uint64_t top = (uintptr_t)cbmem_top();
+	int i;
+
+	h = fnv1a64(h, &top, sizeof(top));
+
+	for (i = 0; i < ARRAY_SIZE(placed_ids); i++) {
+		const struct cbmem_entry *e = cbmem_entry_find(placed_ids[i]);
+		uint64_t loc[3] = { placed_ids[i] };
+
+		if (e) {
+			loc[1] = (uintptr_t)cbmem_entry_start(e);
+			loc[2] = cbmem_entry_size(e);
+		}
+		h = fnv1a64(h, loc, sizeof(loc));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(content_ids); i++) {
+		const struct cbmem_entry *e = cbmem_entry_find(content_ids[i]);
+
+		if (e)
+			h = fnv1a64(h, cbmem_entry_start(e),
+				    cbmem_entry_size(e));
+	}
+
+	return h;
+}
+
+static uint64_t table_cache_key_cmos(uint64_t h)
+{
+#if IS_ENABLED(CONFIG_USE_OPTION_TABLE)
+	int i;
+
+	for (i = LB_CKS_RANGE_START; i <= LB_CKS_RANGE_END; i++) {
+		uint8_t b = cmos_read(i);
+
+		h = fnv1a64(h, &b, sizeof(b));
+	}
+#endif
+
+	return h;
+}
+
+/*
+ * Everything the SSDT and SMBIOS generators look at: the build, the CPU, the
+ * device tree with its final resources, the board strings, the CBMEM layout
+ * and contents such as the memory configuration and VPD, and the CMOS
+ * options. Board code that feeds the tables from anywhere else is not
+ * covered, see the TABLE_CACHE help.
+ */
+static uint64_t table_cache_key(void)
+{
+	uint64_t h = FNV64_OFFSET;
+	struct device *dev;
+	struct resource *res;
+
+	h = fnv1a64(h, coreboot_version, strlen(coreboot_version));
+	h = fnv1a64(h, coreboot_build, strlen(coreboot_build));
+
+	h = table_cache_key_cpu(h);
+
+	for (dev = all_devices; dev; dev = dev->next) {
+		uint32_t id[] = {
+			dev->path.type, dev->enabled,
+			dev->vendor, dev->device, dev->class,
+			dev->subsystem_vendor, dev->subsystem_device,
+		};
+
+		h = fnv1a64(h, dev_path(dev), strlen(dev_path(dev)));
+		h = fnv1a64(h, id, sizeof(id));
+		for (res = dev->resource_list; res; res = res->next) {
+			uint64_t r[] = {
+				res->base, res->size, res->flags, res->index,
+			};
+
+			h = fnv1a64(h, r, sizeof(r));
+		}
+	}
+
+	h = table_cache_key_smbios(h);
+	h = table_cache_key_cbmem(h);
+
+	return table_cache_key_cmos(h);
+}
+
+/* Look up the cached tables the first time they are asked for. */
+static int table_cache_hit(void)
+{
+	struct table_cache_header *hdr = &tc.hdr;
+	size_t size;
+
+	if (tc.state != TABLE_CACHE_UNKNOWN)
+		return tc.state == TABLE_CACHE_HIT;
+
+	tc.state = TABLE_CACHE_BROKEN;
+	if (fmap_locate_area_as_rdev(TABLE_CACHE_REGION, &tc.rdev)) {
+		printk(BIOS_DEBUG, "Table cache: no %s region\n",
+		       TABLE_CACHE_REGION);
+		return 0;
+	}
+
+	tc.state = TABLE_CACHE_MISS;
+	tc.key = table_cache_key();
+
+	if (rdev_readat(&tc.rdev, hdr, 0, sizeof(*hdr)) != sizeof(*hdr))
+		return 0;
+
+	size = hdr->ssdt_size + hdr->smbios_size;
+	if (hdr->signature != TABLE_CACHE_SIGNATURE ||
+	    hdr->version != TABLE_CACHE_VERSION ||
+	    hdr->ssdt_size > region_device_sz(&tc.rdev) ||
+	    hdr->smbios_size > region_device_sz(&tc.rdev) ||
+	    size > region_device_sz(&tc.rdev) - sizeof(*hdr)) {
+		printk(BIOS_DEBUG, "Table cache: empty\n");
+		return 0;
+	}
+
+	if (hdr->key != tc.key) {
+		printk(BIOS_DEBUG, "Table cache: inputs changed\n");
+		return 0;
+	}
+
+	tc.data = rdev_mmap(&tc.rdev, sizeof(*hdr), size);
+	if (tc.data == NULL)
+		return 0;
+
+	if (fnv1a64(FNV64_OFFSET, tc.data, size) != hdr->checksum) {
+		printk(BIOS_ERR, "Table cache: checksum mismatch\n");
+		rdev_munmap(&tc.rdev, (void *)tc.data);
+		return 0;
+	}
+
+	printk(BIOS_DEBUG, "Table cache: using cached tables\n");
+	tc.state = TABLE_CACHE_HIT;
+	return 1;
+}
+
+/* A cached table failed validation, regenerate everything not yet used. */
+static void table_cache_invalidate(const char *what)
+{
+	printk(BIOS_ERR, "Table cache: invalid %s, regenerating\n", what);
+	tc.state = TABLE_CACHE_MISS;
+}
+
+int table_cache_restore_ssdt(acpi_header_t *ssdt)
+{
+	if (!table_cache_hit())
+		return 0;
+
+	if (tc.hdr.ssdt_size < sizeof(*ssdt)) {
+		table_cache_invalidate("SSDT");
+		return 0;
+	}
+
+	memcpy(ssdt, tc.data, tc.hdr.ssdt_size);
+
+	if (memcmp(ssdt->signature, "SSDT", 4) ||
+	    ssdt->length != tc.hdr.ssdt_size ||
+	    acpi_checksum((u8 *)ssdt, ssdt->length) != 0) {
+		table_cache_invalidate("SSDT");
+		return 0;
+	}
+
+	return 1;
+}
+
+void table_cache_record_ssdt(const acpi_header_t *ssdt)
+{
+	tc.ssdt = ssdt;
+	tc.ssdt_size = ssdt->length;
+}
+
+static u8 smbios_sum(const void *p, size_t length)
+{
+	const u8 *b = p;
+	u8 sum = 0;
+
+	while (length--)
+		sum += *b++;
+
+	return sum;
+}
+
+unsigned long table_cache_restore_smbios(unsigned long start)
+{
+	const struct smbios_entry *se = (void *)start;
+	size_t size = tc.hdr.smbios_size;
+
+	if (!table_cache_hit())
+		return 0;
+
+	if (tc.hdr.smbios_addr != start || size < sizeof(*se)) {
+		table_cache_invalidate("SMBIOS location");
+		return 0;
+	}
+
+	memcpy((void *)start, tc.data + tc.hdr.ssdt_size, size);
+
+	if (memcmp(se->anchor, "_SM_", 4) || se->length != sizeof(*se) ||
+	    smbios_sum(se, se->length) != 0 ||
+	    smbios_sum((u8 *)se + 0x10, se->length - 0x10) != 0 ||
+	    se->struct_table_address < start ||
+	    se->struct_table_address + se->struct_table_length >
+	    start + size) {
+		table_cache_invalidate("SMBIOS tables");
+		return 0;
+	}
+
+	return start + size;
+}
+
+void table_cache_record_smbios(unsigned long start, unsigned long end)
+{
+	tc.smbios = start;
+	tc.smbios_size = end - start;
+}
+
+static void table_cache_update(void *unused)
+{
+	struct table_cache_header hdr;
+	struct spi_flash *flash;
+	struct region r;
+	size_t size;
+
+	if (tc.state != TABLE_CACHE_MISS)
+		return;
+
+	/* Some table was not generated the usual way, e.g. by fw_cfg. */
+	if ((IS_ENABLED(CONFIG_HAVE_ACPI_TABLES) && !tc.ssdt) ||
+	    (IS_ENABLED(CONFIG_GENERATE_SMBIOS_TABLES) && !tc.smbios))
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.signature = TABLE_CACHE_SIGNATURE;
+	hdr.version = TABLE_CACHE_VERSION;
+	hdr.key = tc.key;
+	hdr.smbios_addr = tc.smbios;
+	hdr.ssdt_size = tc.ssdt_size;
+	hdr.smbios_size = tc.smbios_size;
+	hdr.checksum = fnv1a64(FNV64_OFFSET, tc.ssdt, tc.ssdt_size);
+	hdr.checksum = fnv1a64(hdr.checksum, (void *)tc.smbios, tc.smbios_size);
+
+	size = sizeof(hdr) + tc.ssdt_size + tc.smbios_size;
+	if (fmap_locate_area(TABLE_CACHE_REGION, &r) || size > region_sz(&r)) {
+		printk(BIOS_ERR, "Table cache: %zu bytes don't fit\n", size);
+		return;
+	}
+
+	flash = spi_flash_probe(CONFIG_BOOT_MEDIA_SPI_BUS, 0);
+	if (flash == NULL) {
+		printk(BIOS_ERR, "Table cache: no SPI flash\n");
+		return;
+	}
+
+	printk(BIOS_DEBUG, "Table cache: updating, %zu bytes\n", size);
+
+	/* The header goes last so that a partial update is never valid. */
+	if (flash->erase(flash, region_offset(&r),
+			 ALIGN_UP(size, flash->sector_size)) ||
+	    (tc.ssdt_size && flash->write(flash,
+			region_offset(&r) + sizeof(hdr), tc.ssdt_size,
+			tc.ssdt)) ||
+	    (tc.smbios_size && flash->write(flash,
+			region_offset(&r) + sizeof(hdr) + tc.ssdt_size,
+			tc.smbios_size, (void *)tc.smbios)) ||
+	    flash->write(flash, region_offset(&r), sizeof(hdr), &hdr))
+		printk(BIOS_ERR, "Table cache: flash update failed\n");
+}
+
+BOOT_STATE_INIT_ENTRY(BS_WRITE_TABLES, BS_ON_EXIT, table_cache_update, NULL);
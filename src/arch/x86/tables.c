@@ -22,6 +22,7 @@
 #include <arch/pirq_routing.h>
 #include <arch/smp/mpspec.h>
 #include <arch/acpi.h>
+#include <arch/table_cache.h>
 #include <string.h>
 #include <cbmem.h>
 #include <smbios.h>
@@ -162,7 +163,13 @@ void write_tables(void)
 	if (high_table_pointer) {
 		unsigned long new_high_table_pointer;
 
-		new_high_table_pointer = smbios_write_tables(high_table_pointer);
+		new_high_table_pointer =
+			table_cache_restore_smbios(high_table_pointer);
+		if (!new_high_table_pointer)
+			new_high_table_pointer =
+				smbios_write_tables(high_table_pointer);
+		table_cache_record_smbios(high_table_pointer,
+					  new_high_table_pointer);
 		rom_table_end = ALIGN(rom_table_end, 16);
 		memcpy((void *)rom_table_end, (void *)high_table_pointer, sizeof(struct smbios_entry));
 		rom_table_end += sizeof(struct smbios_entry);
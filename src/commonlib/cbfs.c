@@ -184,13 +184,79 @@ int cbfs_locate(struct cbfsf *fh, const struct region_device *cbfs,
 	return -1;
 }
 
-static int cbfs_extend_hash_buffer(struct vb2_digest_context *ctx,
-					void *buf, size_t sz)
+/*
+ * Look up the hash attribute of a file, returning the digest size and filling
+ * in the algorithm and digest. Returns < 0 if the file carries none.
+ */
+int cbfsf_file_hash(const struct cbfsf *fh, enum vb2_hash_algorithm *hash_alg,
+			void *digest, size_t digest_sz)
+{
+	struct cbfs_file file;
+	struct cbfs_file_attr_hash hash;
+	size_t offset;
+	size_t end;
+
+	if (rdev_readat(&fh->metadata, &file, 0, sizeof(file)) != sizeof(file))
+		return -1;
+
+	offset = read_be32(&file.attributes_offset);
+	end = region_device_sz(&fh->metadata);
+
+	/* No attributes. */
+	if (offset == 0)
+		return -1;
+
+	while (offset + sizeof(struct cbfs_file_attribute) <= end) {
+		struct cbfs_file_attribute attr;
+		size_t len;
+		size_t sz;
+
+		if (rdev_readat(&fh->metadata, &attr, offset, sizeof(attr)) !=
+				sizeof(attr))
+			return -1;
+
+		attr.tag = read_be32(&attr.tag);
+		len = read_be32(&attr.len);
+
+		if (attr.tag == CBFS_FILE_ATTR_TAG_UNUSED ||
+		    attr.tag == CBFS_FILE_ATTR_TAG_UNUSED2)
+			break;
+
+		if (len < sizeof(attr) || len > end - offset)
+			break;
+
+		if (attr.tag != CBFS_FILE_ATTR_TAG_HASH) {
+			offset += len;
+			continue;
+		}
+
+		if (len < sizeof(hash) ||
+		    rdev_readat(&fh->metadata, &hash, offset, sizeof(hash)) !=
+				sizeof(hash))
+			return -1;
+
+		*hash_alg = read_be32(&hash.hash_type);
+		sz = vb2_digest_size(*hash_alg);
+
+		if (sz == 0 || sz != len - sizeof(hash) || sz > digest_sz)
+			return -1;
+
+		if (rdev_readat(&fh->metadata, digest, offset + sizeof(hash),
+				sz) != sz)
+			return -1;
+
+		return sz;
+	}
+
+	return -1;
+}
+
+static int cbfs_extend_digest(void *arg, const void *buf, size_t sz)
 {
-	return vb2_digest_extend(ctx, buf, sz);
+	return vb2_digest_extend(arg, buf, sz);
 }
 
-static int cbfs_extend_hash(struct vb2_digest_context *ctx,
+static int cbfs_extend_hash(cbfs_extend_fn extend, void *arg,
 				const struct region_device *rdev)
 {
 	uint8_t buffer[1024];
@@ -207,7 +273,7 @@ static int cbfs_extend_hash(struct vb2_digest_context *ctx,
 		if (rdev_readat(rdev, buffer, offset, block_sz) != block_sz)
 			return VB2_ERROR_UNKNOWN;
 
-		rv = cbfs_extend_hash_buffer(ctx, buffer, block_sz);
+		rv = extend(arg, buffer, block_sz);
 
 		if (rv)
 			return rv;
@@ -220,7 +286,7 @@ static int cbfs_extend_hash(struct vb2_digest_context *ctx,
 }
 
 /* Include offsets of child regions within the parent into the hash. */
-static int cbfs_extend_hash_with_offset(struct vb2_digest_context *ctx,
+static int cbfs_extend_hash_with_offset(cbfs_extend_fn extend, void *arg,
 					const struct region_device *p,
 					const struct region_device *c)
 {
@@ -235,17 +301,17 @@ static int cbfs_extend_hash_with_offset(struct vb2_digest_context *ctx,
 	/* All offsets in big endian format. */
 	write_be32(&soffset, soffset);
 
-	rv = cbfs_extend_hash_buffer(ctx, &soffset, sizeof(soffset));
+	rv = extend(arg, &soffset, sizeof(soffset));
 
 	if (rv)
 		return rv;
 
-	return cbfs_extend_hash(ctx, c);
+	return cbfs_extend_hash(extend, arg, c);
 }
 
 /* Hash in the potential CBFS header sitting at the beginning of the CBFS
  * region as well as relative offset at the end. */
-static int cbfs_extend_hash_master_header(struct vb2_digest_context *ctx,
+static int cbfs_extend_hash_master_header(cbfs_extend_fn extend, void *arg,
 					const struct region_device *cbfs)
 {
 	struct region_device rdev;
@@ -254,7 +320,7 @@ static int cbfs_extend_hash_master_header(struct vb2_digest_context *ctx,
 	if (rdev_chain(&rdev, cbfs, 0, sizeof(struct cbfs_header)))
 		return VB2_ERROR_UNKNOWN;
 
-	rv = cbfs_extend_hash_with_offset(ctx, cbfs, &rdev);
+	rv = cbfs_extend_hash_with_offset(extend, arg, cbfs, &rdev);
 
 	if (rv)
 		return rv;
@@ -264,25 +330,21 @@ static int cbfs_extend_hash_master_header(struct vb2_digest_context *ctx,
 			sizeof(int32_t)))
 		return VB2_ERROR_UNKNOWN;
 
-	return cbfs_extend_hash_with_offset(ctx, cbfs, &rdev);
+	return cbfs_extend_hash_with_offset(extend, arg, cbfs, &rdev);
 }
 
-int cbfs_vb2_hash_contents(const struct region_device *cbfs,
-				enum vb2_hash_algorithm hash_alg, void *digest,
-				size_t digest_sz)
+/* Walk the CBFS feeding extend(). With metadata_only set the contents of
+ * files are left out, but each of them needs to carry a hash attribute. */
+static int cbfs_extend_walk(cbfs_extend_fn extend, void *arg,
+				const struct region_device *cbfs,
+				int metadata_only)
 {
-	struct vb2_digest_context ctx;
 	int rv;
 	struct cbfsf f;
 	struct cbfsf *prev;
 	struct cbfsf *fh;
 
-	rv = vb2_digest_init(&ctx, hash_alg);
-
-	if (rv)
-		return rv;
-
-	rv = cbfs_extend_hash_master_header(&ctx, cbfs);
+	rv = cbfs_extend_hash_master_header(extend, arg, cbfs);
 	if (rv)
 		return rv;
 
@@ -302,7 +364,8 @@ int cbfs_vb2_hash_contents(const struct region_device *cbfs,
 		if (rv > 0)
 			break;
 
-		rv = cbfs_extend_hash_with_offset(&ctx, cbfs, &fh->metadata);
+		rv = cbfs_extend_hash_with_offset(extend, arg, cbfs,
+							&fh->metadata);
 
 		if (rv)
 			return rv;
@@ -314,11 +377,51 @@ int cbfs_vb2_hash_contents(const struct region_device *cbfs,
 		if (ftype == CBFS_TYPE_DELETED || ftype == CBFS_TYPE_DELETED2)
 			continue;
 
-		rv = cbfs_extend_hash_with_offset(&ctx, cbfs, &fh->data);
+		if (metadata_only) {
+			uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+			enum vb2_hash_algorithm hash_alg;
+
+			if (cbfsf_file_hash(fh, &hash_alg, digest,
+						sizeof(digest)) < 0) {
+				ERROR("File at %zx has no hash attribute.\n",
+					rdev_relative_offset(cbfs,
+							&fh->metadata));
+				return VB2_ERROR_UNKNOWN;
+			}
+			continue;
+		}
+
+		rv = cbfs_extend_hash_with_offset(extend, arg, cbfs, &fh->data);
 
 		if (rv)
 			return rv;
 	}
 
+	return VB2_SUCCESS;
+}
+
+int cbfs_vb2_hash_contents(const struct region_device *cbfs,
+				enum vb2_hash_algorithm hash_alg, void *digest,
+				size_t digest_sz)
+{
+	struct vb2_digest_context ctx;
+	int rv;
+
+	rv = vb2_digest_init(&ctx, hash_alg);
+
+	if (rv)
+		return rv;
+
+	rv = cbfs_extend_walk(cbfs_extend_digest, &ctx, cbfs, 0);
+
+	if (rv)
+		return rv;
+
 	return vb2_digest_finalize(&ctx, digest, digest_sz);
 }
+
+int cbfs_extend_metadata(const struct region_device *cbfs,
+				cbfs_extend_fn extend, void *arg)
+{
+	return cbfs_extend_walk(extend, arg, cbfs, 1);
+}
@@ -64,4 +64,26 @@ int cbfs_vb2_hash_contents(const struct region_device *cbfs,
 				enum vb2_hash_algorithm hash_alg, void *digest,
 				size_t digest_sz);
 
+/* Consumer of the byte stream produced while walking a CBFS. Returns 0 on
+ * success or non-zero to stop the walk. */
+typedef int (*cbfs_extend_fn)(void *arg, const void *buf, size_t sz);
+
+/*
+ * Feed the metadata stream of the CBFS region to extend(): the same stream
+ * cbfs_vb2_hash_contents() hashes, but without the contents of any file.
+ * Every file that isn't deleted must carry a hash attribute so its contents
+ * can be verified when it is loaded. Return 0 on success or non-zero on
+ * error.
+ */
+int cbfs_extend_metadata(const struct region_device *cbfs,
+				cbfs_extend_fn extend, void *arg);
+
+/*
+ * Look up the hash attribute of a file. Fill in the hash algorithm, copy the
+ * digest to a buffer of digest_sz bytes and return its size. Return < 0 if the
+ * file carries no usable hash attribute.
+ */
+int cbfsf_file_hash(const struct cbfsf *fh, enum vb2_hash_algorithm *hash_alg,
+			void *digest, size_t digest_sz);
+
 #endif
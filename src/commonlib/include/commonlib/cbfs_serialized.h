@@ -133,10 +133,26 @@ struct cbfs_file {
 	char magic[8];
 	uint32_t len;
 	uint32_t type;
-	uint32_t checksum;
+	/* offset to struct cbfs_file_attribute or 0 */
+	uint32_t attributes_offset;
 	uint32_t offset;
 } __attribute__((packed));
 
+/* The common fields of extended cbfs file attributes.
+   Attributes are expected to start with tag/len, then append their
+   specific fields. */
+struct cbfs_file_attribute {
+	uint32_t tag;
+	/* len covers the whole structure, incl. tag and len */
+	uint32_t len;
+} __attribute__((packed));
+
+/* Depending on how the header was initialized, it may be backed with 0x00 or
+ * 0xff. Support both. */
+#define CBFS_FILE_ATTR_TAG_UNUSED 0
+#define CBFS_FILE_ATTR_TAG_UNUSED2 0xffffffff
+#define CBFS_FILE_ATTR_TAG_HASH 0x68736148
+
 /*
  * ROMCC does not understand uint64_t, so we hide future definitions as they are
  * unlikely to be ever needed from ROMCC
@@ -186,6 +202,14 @@ struct cbfs_optionrom {
 	uint32_t len;
 } __attribute__((packed));
 
+struct cbfs_file_attr_hash {
+	uint32_t tag;
+	uint32_t len;
+	uint32_t hash_type;
+	/* hash_data is len - sizeof(struct) bytes */
+	uint8_t  hash_data[];
+} __attribute__((packed));
+
 #endif /* __ROMCC__ */
 
 #endif /* _CBFS_SERIALIZED_H_ */
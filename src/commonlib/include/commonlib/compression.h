@@ -31,4 +31,19 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 /* Same as ulz4fn() but does not perform any bounds checks. */
 size_t ulz4f(const void *src, void *dst);
 
+/* Decompresses a single raw LZ4 block (no frame header) of exactly srcn bytes
+ * from src to dst, writing no more than dstn bytes. Returns amount of
+ * decompressed bytes, or 0 on error.
+ */
+size_t ulz4n(const void *src, size_t srcn, void *dst, size_t dstn);
+
+/* Compresses srcn bytes from src into a single raw LZ4 block at dst, as read
+ * by ulz4n(). This is a simple greedy compressor meant for caching data in
+ * memory, not for building images. With dst == NULL nothing is written and
+ * only the compressed size is computed. Returns the compressed size, or 0 if
+ * it would exceed dstn. Buffer sizes must stay below 2GB.
+ */
+size_t lz4_compress_block(const void *src, size_t srcn, void *dst,
+			  size_t dstn);
+
 #endif	/* _COMMONLIB_COMPRESSION_H_ */
@@ -0,0 +1,69 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _COMMONLIB_FNV_H_
+#define _COMMONLIB_FNV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * FNV-1a hashes for telling cached data apart from stale or overwritten data.
+ * They are not cryptographic: anyone who can change the data can recompute
+ * them. Start with the offset basis and feed the result of one call into the
+ * next to hash data in pieces.
+ */
+
+#define FNV32_OFFSET	2166136261U
+#define FNV32_PRIME	16777619U
+#define FNV64_OFFSET	0xcbf29ce484222325ULL
+#define FNV64_PRIME	0x100000001b3ULL
+
+static inline uint32_t fnv1a32(uint32_t h, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size--)
+		h = (h ^ *p++) * FNV32_PRIME;
+
+	return h;
+}
+
+/* A faster variant mixing in 32-bit words, the tail goes bytewise. */
+static inline uint32_t fnv1a32_words(uint32_t h, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	uint32_t w;
+
+	for (; size >= sizeof(w); size -= sizeof(w), p += sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		h = (h ^ w) * FNV32_PRIME;
+	}
+
+	return fnv1a32(h, p, size);
+}
+
+static inline uint64_t fnv1a64(uint64_t h, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size--)
+		h = (h ^ *p++) * FNV64_PRIME;
+
+	return h;
+}
+
+#endif
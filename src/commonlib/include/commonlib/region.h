@@ -148,8 +148,28 @@ extern const struct region_device_ops mem_rdev_ops;
 		.rdev = REGION_DEV_INIT(&mem_rdev_ops, 0, (size_)),	\
 	}
 
+/* A mapping handed out by an mmap_helper_region_device. */
+struct mmap_helper_mapping {
+	uint8_t *data;		/* NULL if the slot is unused */
+	size_t offset;
+	size_t size;
+	unsigned int refs;	/* mapped but unreferenced data is kept */
+};
+
+#define MMAP_HELPER_MAPPINGS	8
+
+/*
+ * Mappings are reference counted and kept after being unmapped, so that
+ * mapping the same data again, or any part of it, doesn't read it again.
+ * Unreferenced mappings are dropped when the pool runs out of space, which
+ * reclaims the space of all mappings above the highest one still in use,
+ * regardless of the order they were unmapped in.
+ */
 struct mmap_helper_region_device {
 	struct mem_pool pool;
+	struct mmap_helper_mapping mappings[MMAP_HELPER_MAPPINGS];
+	size_t untracked_end;	/* pool bytes that can't be reclaimed */
+	size_t peak_usage;	/* highest number of pool bytes in use */
 	struct region_device rdev;
 };
 
@@ -187,4 +207,53 @@ extern const struct region_device_ops xlate_rdev_ops;
 		.rdev = REGION_DEV_INIT(&xlate_rdev_ops, 0,  (parent_sz_)),\
 	}
 
+/* A cache line of a cache_region_device. */
+struct cache_region_line {
+	size_t offset;		/* of the cached block, or ~0 if unused */
+	size_t size;		/* valid bytes, short at the end of the device */
+	unsigned int last_use;	/* for LRU replacement */
+};
+
+/*
+ * A caching region device keeps the most recently read blocks of access_dev
+ * in memory, so that the many small reads done while walking metadata
+ * become memory accesses. Reads of a block or more bypass the cache. Only
+ * suitable for read-only access devices. mmap() is provided through an
+ * mmap_helper_region_device, so it is backed by cached reads as well.
+ */
+struct cache_region_device {
+	const struct region_device *access_dev;
+	struct cache_region_line *lines;
+	uint8_t *data;
+	size_t block_size;
+	size_t num_lines;
+	unsigned int clock;
+	size_t hits;
+	size_t misses;
+	struct mmap_helper_region_device mdev;
+};
+
+extern const struct region_device_ops cache_rdev_ops;
+
+/*
+ * Initialize a caching region device covering all of access_dev. The cache
+ * lines and their data are placed in cache, which holds as many lines of
+ * block_size bytes as fit. mmap_cache and mmap_cache_size back the mmap()
+ * buffers, like for mmap_helper_device_init(). Returns < 0 if cache can't
+ * hold a single line.
+ */
+int cache_region_device_init(struct cache_region_device *cdev,
+			const struct region_device *access_dev,
+			void *cache, size_t cache_size, size_t block_size,
+			void *mmap_cache, size_t mmap_cache_size);
+
+/* Forget all cached blocks, e.g. after the cache memory is moved. */
+void cache_region_device_invalidate(struct cache_region_device *cdev);
+
+static inline const struct region_device *cache_region_device_rdev(
+				const struct cache_region_device *cdev)
+{
+	return &cdev->mdev.rdev;
+}
+
 #endif /* _REGION_H_ */
@@ -49,6 +49,11 @@ enum timestamp_id {
 	TS_END_ULZMA = 16,
 	TS_START_ULZ4F = 17,
 	TS_END_ULZ4F = 18,
+	TS_START_STAGE_CACHE = 19,
+	TS_END_STAGE_CACHE = 20,
+	TS_START_MP_INIT = 21,
+	TS_MP_APS_STARTED = 22,
+	TS_END_MP_INIT = 23,
 	TS_DEVICE_ENUMERATE = 30,
 	TS_DEVICE_CONFIGURE = 40,
 	TS_DEVICE_ENABLE = 50,
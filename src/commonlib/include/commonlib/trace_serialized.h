@@ -0,0 +1,55 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __TRACE_SERIALIZED_H__
+#define __TRACE_SERIALIZED_H__
+
+#include <stdint.h>
+
+enum trace_record_type {
+	TRACE_ENTER = 1,	/* func was called from caller */
+	TRACE_EXIT = 2,		/* func returned */
+	TRACE_SAMPLE = 3,	/* followed by depth TRACE_FRAME records */
+	TRACE_FRAME = 4,	/* func is on the stack of the last sample */
+};
+
+enum trace_mode {
+	TRACE_MODE_CALLS = 1,	/* every call is recorded */
+	TRACE_MODE_SAMPLES = 2,	/* the call stack is sampled periodically */
+};
+
+struct trace_record {
+	uint64_t	tsc;
+	uint32_t	func;
+	uint32_t	caller;
+	uint16_t	type;
+	/* Call depth of func. The outermost recorded function is at 0. */
+	uint16_t	depth;
+} __attribute__((packed));
+
+/*
+ * The records form a ring. The oldest one is at written % num_records once
+ * more than num_records have been written.
+ */
+struct trace_buffer {
+	uint32_t	num_records;
+	uint32_t	written;
+	uint16_t	mode;
+	uint16_t	tick_freq_mhz;
+	uint32_t	reserved;
+	struct trace_record records[0];
+} __attribute__((packed));
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <commonlib/compression.h>
+#include <commonlib/helpers.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Greedy single pass LZ4 block compressor. The match finder is a small hash
+ * table of the last position each 4 byte sequence was seen at, which is kept
+ * on the stack since this may run before .bss is usable. That costs some
+ * compression ratio against the reference implementation but keeps the
+ * footprint at 1KiB.
+ */
+
+#define HASH_LOG	8
+#define MIN_MATCH	4
+#define LAST_LITERALS	5	/* the block always ends in literals */
+#define MFLIMIT		12	/* no match may start after iend - MFLIMIT */
+#define MAX_OFFSET	65535
+#define RUN_MASK	15
+
+struct lz4_out {
+	uint8_t *buf;
+	size_t pos;
+	size_t size;
+};
+
+static uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash4(const uint8_t *p)
+{
+	return (read32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* Past the end of the buffer only the size is tracked. */
+static void out_byte(struct lz4_out *o, uint8_t b)
+{
+	if (o->buf && o->pos < o->size)
+		o->buf[o->pos] = b;
+	o->pos++;
+}
+
+static void out_copy(struct lz4_out *o, const uint8_t *p, size_t n)
+{
+	if (o->buf && o->pos + n <= o->size)
+		memcpy(o->buf + o->pos, p, n);
+	o->pos += n;
+}
+
+static void out_length(struct lz4_out *o, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		out_byte(o, 255);
+	out_byte(o, len);
+}
+
+/* A match_len of 0 emits the final, literals only sequence. */
+static void out_sequence(struct lz4_out *o, const uint8_t *lit, size_t lit_len,
+			 size_t offset, size_t match_len)
+{
+	size_t ml = match_len ? match_len - MIN_MATCH : 0;
+
+	out_byte(o, MIN(lit_len, RUN_MASK) << 4 | MIN(ml, RUN_MASK));
+	if (lit_len >= RUN_MASK)
+		out_length(o, lit_len - RUN_MASK);
+	out_copy(o, lit, lit_len);
+
+	if (!match_len)
+		return;
+
+	out_byte(o, offset & 0xff);
+	out_byte(o, offset >> 8);
+	if (ml >= RUN_MASK)
+		out_length(o, ml - RUN_MASK);
+}
+
+size_t lz4_compress_block(const void *src, size_t srcn, void *dst,
+			  size_t dstn)
+{
+	uint32_t table[1 << HASH_LOG];
+	const uint8_t *base = src;
+	const uint8_t *iend = base + srcn;
+	const uint8_t *ip = base;
+	const uint8_t *anchor = base;
+	struct lz4_out o = { .buf = dst, .pos = 0, .size = dstn };
+
+	memset(table, 0, sizeof(table));
+
+	while (srcn > MFLIMIT && ip < iend - MFLIMIT) {
+		uint32_t h = hash4(ip);
+		const uint8_t *ref = base + table[h];
+		size_t len;
+
+		table[h] = ip - base;
+
+		if (ref >= ip || ip - ref > MAX_OFFSET ||
+		    read32(ref) != read32(ip)) {
+			ip++;
+			continue;
+		}
+
+		len = MIN_MATCH;
+		while (ip + len < iend - LAST_LITERALS && ref[len] == ip[len])
+			len++;
+
+		out_sequence(&o, anchor, ip - anchor, ip - ref, len);
+		ip += len;
+		anchor = ip;
+	}
+
+	out_sequence(&o, anchor, iend - anchor, 0, 0);
+
+	if (dst && o.pos > dstn)
+		return 0;
+	return o.pos;
+}
@@ -191,3 +191,12 @@ size_t ulz4f(const void *src, void *dst)
 	/* LZ4 uses signed size parameters, so can't just use ((u32)-1) here. */
 	return ulz4fn(src, 1*GiB, dst, 1*GiB);
 }
+
+size_t ulz4n(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	/* constant folding essential, do not touch params! */
+	int ret = LZ4_decompress_generic(src, dst, srcn, dstn, endOnInputSize,
+					 full, 0, noDict, dst, NULL, 0);
+
+	return ret < 0 ? 0 : ret;
+}
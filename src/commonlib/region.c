@@ -171,36 +171,133 @@ void mmap_helper_device_init(struct mmap_helper_region_device *mdev,
 				void *cache, size_t cache_size)
 {
 	mem_pool_init(&mdev->pool, cache, cache_size);
+	memset(mdev->mappings, 0, sizeof(mdev->mappings));
+	mdev->untracked_end = 0;
+	mdev->peak_usage = 0;
+}
+
+/*
+ * Give back the pool space above the highest mapping still present. This
+ * is what allows unmapping in any order without leaking, as the pool itself
+ * only tracks its last allocation.
+ */
+static void mmap_helper_reclaim(struct mmap_helper_region_device *mdev)
+{
+	const struct mmap_helper_mapping *m;
+	size_t end, top = mdev->untracked_end;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(mdev->mappings); i++) {
+		m = &mdev->mappings[i];
+		if (m->data == NULL)
+			continue;
+		end = m->data - mdev->pool.buf + ALIGN_UP(m->size, 8);
+		top = MAX(top, end);
+	}
+
+	if (top < mdev->pool.free_offset) {
+		mdev->pool.free_offset = top;
+		mdev->pool.last_alloc = NULL;
+	}
+}
+
+/* Drop all unreferenced mappings and reclaim their space. */
+static void mmap_helper_evict(struct mmap_helper_region_device *mdev)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(mdev->mappings); i++)
+		if (mdev->mappings[i].refs == 0)
+			mdev->mappings[i].data = NULL;
+
+	mmap_helper_reclaim(mdev);
 }
 
 void *mmap_helper_rdev_mmap(const struct region_device *rd, size_t offset,
 				size_t size)
 {
 	struct mmap_helper_region_device *mdev;
+	struct mmap_helper_mapping *m, *slot = NULL;
 	void *mapping;
+	size_t i;
 
 	mdev = container_of((void *)rd, __typeof__(*mdev), rdev);
 
+	/* Hand out an existing mapping if it covers the request. */
+	for (i = 0; i < ARRAY_SIZE(mdev->mappings); i++) {
+		m = &mdev->mappings[i];
+		if (m->data == NULL) {
+			if (slot == NULL)
+				slot = m;
+			continue;
+		}
+		if (offset >= m->offset &&
+		    offset + size <= m->offset + m->size) {
+			m->refs++;
+			return &m->data[offset - m->offset];
+		}
+		if (m->refs == 0 && (slot == NULL || slot->data != NULL))
+			slot = m;
+	}
+
 	mapping = mem_pool_alloc(&mdev->pool, size);
+	if (mapping == NULL) {
+		mmap_helper_evict(mdev);
+		mapping = mem_pool_alloc(&mdev->pool, size);
+		if (mapping == NULL)
+			return NULL;
+		/* Eviction may have freed up a slot. */
+		for (i = 0; i < ARRAY_SIZE(mdev->mappings); i++)
+			if (mdev->mappings[i].data == NULL)
+				slot = &mdev->mappings[i];
+	}
 
-	if (mapping == NULL)
-		return NULL;
+	mdev->peak_usage = MAX(mdev->peak_usage, mdev->pool.free_offset);
 
 	if (rd->ops->readat(rd, mapping, offset, size) != size) {
 		mem_pool_free(&mdev->pool, mapping);
 		return NULL;
 	}
 
+	/*
+	 * Without a free slot the mapping is untracked, as it used to be, and
+	 * the pool is never reclaimed below it.
+	 */
+	if (slot == NULL) {
+		mdev->untracked_end = mdev->pool.free_offset;
+		return mapping;
+	}
+
+	slot->data = mapping;
+	slot->offset = offset;
+	slot->size = size;
+	slot->refs = 1;
+
 	return mapping;
 }
 
 int mmap_helper_rdev_munmap(const struct region_device *rd, void *mapping)
 {
 	struct mmap_helper_region_device *mdev;
+	struct mmap_helper_mapping *m;
+	uint8_t *p = mapping;
+	size_t i;
 
 	mdev = container_of((void *)rd, __typeof__(*mdev), rdev);
 
+	for (i = 0; i < ARRAY_SIZE(mdev->mappings); i++) {
+		m = &mdev->mappings[i];
+		if (m->data == NULL || m->refs == 0)
+			continue;
+		if (p >= m->data && p < m->data + MAX(m->size, 1)) {
+			m->refs--;
+			return 0;
+		}
+	}
+
+	/* An untracked mapping, which can only be freed if it was the last. */
 	mem_pool_free(&mdev->pool, mapping);
+	mdev->untracked_end = MIN(mdev->untracked_end, mdev->pool.free_offset);
 
 	return 0;
 }
@@ -257,3 +354,123 @@ const struct region_device_ops xlate_rdev_ops = {
 	.munmap = xlate_munmap,
 	.readat = xlate_readat,
 };
+
+#define CACHE_LINE_UNUSED	((size_t)~0)
+
+void cache_region_device_invalidate(struct cache_region_device *cdev)
+{
+	size_t i;
+
+	for (i = 0; i < cdev->num_lines; i++) {
+		cdev->lines[i].offset = CACHE_LINE_UNUSED;
+		cdev->lines[i].last_use = 0;
+	}
+	cdev->clock = 0;
+}
+
+int cache_region_device_init(struct cache_region_device *cdev,
+			const struct region_device *access_dev,
+			void *cache, size_t cache_size, size_t block_size,
+			void *mmap_cache, size_t mmap_cache_size)
+{
+	size_t num_lines;
+
+	if (block_size == 0)
+		return -1;
+
+	num_lines = cache_size / (sizeof(*cdev->lines) + block_size);
+	if (num_lines == 0)
+		return -1;
+
+	cdev->access_dev = access_dev;
+	cdev->lines = cache;
+	cdev->data = (uint8_t *)cache + num_lines * sizeof(*cdev->lines);
+	cdev->block_size = block_size;
+	cdev->num_lines = num_lines;
+	cdev->hits = 0;
+	cdev->misses = 0;
+	cache_region_device_invalidate(cdev);
+
+	cdev->mdev.rdev.root = NULL;
+	cdev->mdev.rdev.ops = &cache_rdev_ops;
+	cdev->mdev.rdev.region.offset = 0;
+	cdev->mdev.rdev.region.size = region_device_sz(access_dev);
+	mmap_helper_device_init(&cdev->mdev, mmap_cache, mmap_cache_size);
+
+	return 0;
+}
+
+/* Return the cache line holding the block at offset, filling it on a miss. */
+static struct cache_region_line *cache_get_line(
+			struct cache_region_device *cdev, size_t offset)
+{
+	struct cache_region_line *line, *victim = NULL;
+	ssize_t size;
+	size_t i;
+
+	for (i = 0; i < cdev->num_lines; i++) {
+		line = &cdev->lines[i];
+		if (line->offset == offset) {
+			line->last_use = ++cdev->clock;
+			cdev->hits++;
+			return line;
+		}
+		if (victim == NULL || line->last_use < victim->last_use)
+			victim = line;
+	}
+
+	cdev->misses++;
+
+	size = MIN(cdev->block_size,
+		   region_device_sz(cdev->access_dev) - offset);
+	i = victim - cdev->lines;
+	if (rdev_readat(cdev->access_dev, &cdev->data[i * cdev->block_size],
+			offset, size) != size) {
+		victim->offset = CACHE_LINE_UNUSED;
+		victim->last_use = 0;
+		return NULL;
+	}
+
+	victim->offset = offset;
+	victim->size = size;
+	victim->last_use = ++cdev->clock;
+
+	return victim;
+}
+
+static ssize_t cache_readat(const struct region_device *rd, void *b,
+				size_t offset, size_t size)
+{
+	struct cache_region_device *cdev;
+	struct cache_region_line *line;
+	size_t block, skip, chunk, done = 0;
+	uint8_t *dest = b;
+
+	cdev = container_of((void *)rd, __typeof__(*cdev), mdev.rdev);
+
+	/* Large reads are usually loaded once; keep them out of the cache. */
+	if (size >= cdev->block_size)
+		return rdev_readat(cdev->access_dev, b, offset, size);
+
+	while (done < size) {
+		skip = (offset + done) % cdev->block_size;
+		block = offset + done - skip;
+
+		line = cache_get_line(cdev, block);
+		if (line == NULL || line->size <= skip)
+			return -1;
+
+		chunk = MIN(size - done, line->size - skip);
+		memcpy(&dest[done], &cdev->data[(line - cdev->lines) *
+						cdev->block_size + skip], chunk);
+		done += chunk;
+	}
+
+	return size;
+}
+
+const struct region_device_ops cache_rdev_ops = {
+	.mmap = mmap_helper_rdev_mmap,
+	.munmap = mmap_helper_rdev_munmap,
+	.readat = cache_readat,
+};
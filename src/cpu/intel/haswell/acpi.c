@@ -20,6 +20,7 @@
 #include <arch/acpi.h>
 #include <arch/acpigen.h>
 #include <arch/cpu.h>
+#include <arch/table_cache.h>
 #include <cpu/x86/msr.h>
 #include <cpu/intel/speedstep.h>
 #include <cpu/intel/turbo.h>
@@ -303,6 +304,21 @@ static void generate_P_state_entries(int core, int cores_per_package)
 	acpigen_pop_len();
 }
 
+/* The MSRs generate_P_state_entries() reads, see table_cache.h. */
+const u32 *table_cache_cpu_msrs(size_t *count)
+{
+	static const u32 msrs[] = {
+		MSR_IA32_MISC_ENABLES, MSR_MISC_PWR_MGMT, MSR_PLATFORM_INFO,
+		MSR_PKG_POWER_SKU_UNIT, MSR_PKG_POWER_SKU,
+		MSR_TURBO_RATIO_LIMIT,
+		/* Only exists with configurable TDP, so it goes last. */
+		MSR_CONFIG_TDP_NOMINAL,
+	};
+
+	*count = ARRAY_SIZE(msrs) - !cpu_config_tdp_levels();
+	return msrs;
+}
+
 void generate_cpu_entries(device_t device)
 {
 	int coreID, cpuID, pcontrol_blk = get_pmbase(), plen = 6;
@@ -99,9 +99,9 @@ static void update_save_state(int cpu,
 	u32 iedbase;
 
 	/* The relocated handler runs with all CPUs concurrently. Therefore
-	 * stagger the entry points adjusting SMBASE downwards by save state
-	 * size * CPU num. */
-	smbase = relo_params->smram_base - cpu * runtime->save_state_size;
+	 * stagger the entry points as laid out by the SMM module
+	 * loader. */
+	smbase = smm_get_cpu_smbase(cpu);
 	iedbase = relo_params->ied_base;
 
 	printk(BIOS_DEBUG, "New SMBASE=0x%08x IEDBASE=0x%08x\n",
@@ -95,10 +95,9 @@ static void asmlinkage cpu_smm_do_relocation(void *arg)
                               runtime->save_state_size);
 
 	/* The relocated handler runs with all CPUs concurrently. Therefore
-	 * stagger the entry points adjusting SMBASE downwards by save state
-	 * size * CPU num. */
-	save_state->smbase = relo_params->smram_base -
-	                     cpu * runtime->save_state_size;
+	 * stagger the entry points as laid out by the SMM module
+	 * loader. */
+	save_state->smbase = smm_get_cpu_smbase(cpu);
 	save_state->iedbase = relo_params->ied_base;
 
 	printk(BIOS_DEBUG, "New SMBASE=0x%08x IEDBASE=0x%08x @ %p\n",
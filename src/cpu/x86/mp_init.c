@@ -14,8 +14,10 @@
  * GNU General Public License for more details.
  */
 
+#include <bootstate.h>
 #include <console/console.h>
 #include <stdint.h>
+#include <string.h>
 #include <rmodule.h>
 #include <arch/cpu.h>
 #include <cpu/cpu.h>
@@ -32,10 +34,12 @@
 #include <device/device.h>
 #include <device/path.h>
 #include <lib.h>
+#include <program_loading.h>
 #include <smp/atomic.h>
 #include <smp/spinlock.h>
 #include <symbols.h>
 #include <thread.h>
+#include <timestamp.h>
 
 #define MAX_APIC_IDS 256
 /* This needs to match the layout in the .module_parametrs section. */
@@ -86,6 +90,27 @@ struct cpu_map {
 /* Keep track of apic and device structure for each cpu. */
 static struct cpu_map cpus[CONFIG_MAX_CPUS];
 
+/* Work handed to APs waiting in ap_wait_for_instruction(). */
+struct mp_callback {
+	void (*func)(void *);
+	void *arg;
+};
+
+/*
+ * ap_work[] is only written while the matching ap_posted[] entry is 0. A
+ * posted entry holds the generation of the work, which never repeats, so an
+ * AP that claims it knows the copy it took of ap_work[] wasn't overwritten.
+ */
+static struct mp_callback ap_work[CONFIG_MAX_CPUS];
+static uint32_t ap_posted[CONFIG_MAX_CPUS];
+static uint32_t ap_generation;
+/* Number of APs that finished the flight plan and wait for work. */
+static int waiting_aps;
+/* Number of CPUs brought up by mp_init(), including the BSP. */
+static int mp_num_cpus;
+/* Set when the APs don't need the delays of the MP spec start sequence. */
+static int fast_startup;
+
 static inline void barrier_wait(atomic_t *b)
 {
 	while (atomic_read(b) == 0) {
@@ -100,12 +125,46 @@ static inline void release_barrier(atomic_t *b)
 	atomic_set(b, 1);
 }
 
+/*
+ * The delays of the INIT-SIPI-SIPI sequence in the MP spec are for the
+ * external and early integrated APICs. P6 and later Intel CPUs as well as
+ * K8 and later AMD CPUs start on the first SIPI right away, which is also
+ * what virtual CPUs do.
+ */
+static int mp_fast_startup_supported(void)
+{
+	unsigned int family;
+	unsigned int vendor;
+
+	if (!IS_ENABLED(CONFIG_MP_FAST_STARTUP))
+		return 0;
+
+	vendor = cpuid_ebx(0);
+	family = (cpuid_eax(1) >> 8) & 0xf;
+	if (family == 0xf)
+		family += (cpuid_eax(1) >> 20) & 0xff;
+
+	if (vendor == 0x756e6547)	/* GenuineIntel */
+		return family >= 6;
+	if (vendor == 0x68747541)	/* AuthenticAMD */
+		return family >= 0xf;
+	return 0;
+}
+
+/* With the fixed delays gone coarse polling steps would dominate. */
+static inline int poll_step(int delay_step)
+{
+	return fast_startup ? 1 : delay_step;
+}
+
 /* Returns 1 if timeout waiting for APs. 0 if target aps found. */
 static int wait_for_aps(atomic_t *val, int target, int total_delay,
                         int delay_step)
 {
 	int timeout = 0;
 	int delayed = 0;
+
+	delay_step = poll_step(delay_step);
 	while (atomic_read(val) != target) {
 		udelay(delay_step);
 		delayed += delay_step;
@@ -134,6 +193,62 @@ static void ap_do_flight_plan(void)
 	}
 }
 
+static uint32_t read_posted(uint32_t *slot)
+{
+	uint32_t gen = *(volatile uint32_t *)slot;
+
+	/* Don't let the compiler read ap_work[] ahead of the slot. */
+	asm volatile ("" : : : "memory");
+	return gen;
+}
+
+static void store_posted(uint32_t *slot, uint32_t gen)
+{
+	mfence();
+	*(volatile uint32_t *)slot = gen;
+}
+
+static uint32_t xchg_posted(uint32_t *slot, uint32_t gen)
+{
+	asm volatile ("xchg %0, %1" : "+r" (gen), "+m" (*slot) : : "memory");
+	return gen;
+}
+
+/* Returns 1 if *slot was old and has been replaced by new. */
+static int cmpxchg_posted(uint32_t *slot, uint32_t old, uint32_t new)
+{
+	uint32_t prev;
+
+	asm volatile ("lock cmpxchg %2, %1"
+		      : "=a" (prev), "+m" (*slot)
+		      : "r" (new), "0" (old)
+		      : "memory");
+	return prev == old;
+}
+
+static void ap_wait_for_instruction(void)
+{
+	struct mp_callback lcb;
+	const int index = cpu_info()->index;
+	uint32_t *slot = &ap_posted[index];
+
+	while (1) {
+		uint32_t gen = read_posted(slot);
+
+		if (gen == 0) {
+			asm ("pause");
+			continue;
+		}
+
+		/* Copy the work before claiming it. If the BSP withdrew it,
+		 * and possibly posted new work, the generation no longer
+		 * matches and the copy is dropped. */
+		lcb = ap_work[index];
+		if (cmpxchg_posted(slot, gen, 0))
+			lcb.func(lcb.arg);
+	}
+}
+
 /* By the time APs call ap_init() caching has been setup, and microcode has
  * been loaded. */
 static void asmlinkage ap_init(unsigned int cpu)
@@ -153,11 +268,16 @@ static void asmlinkage ap_init(unsigned int cpu)
 	info->cpu->path.apic.apic_id = apic_id;
 	cpus[cpu].apic_id = apic_id;
 
-	printk(BIOS_INFO, "AP: slot %d apic_id %x.\n", cpu, apic_id);
+	/* Many APs printing at once serialize on the console. */
+	printk(fast_startup ? BIOS_SPEW : BIOS_INFO,
+	       "AP: slot %d apic_id %x.\n", cpu, apic_id);
 
 	/* Walk the flight plan */
 	ap_do_flight_plan();
 
+	if (IS_ENABLED(CONFIG_PARALLEL_MP_AP_WORK))
+		ap_wait_for_instruction();
+
 	/* Park the AP. */
 	stop_this_cpu();
 }
@@ -294,9 +414,9 @@ static atomic_t *load_sipi_vector(struct mp_params *mp_params)
 	sp->microcode_ptr = (uint32_t)mp_params->microcode_pointer;
 	/* Pass on abiility to load microcode in parallel. */
 	if (mp_params->parallel_microcode_load) {
-		sp->microcode_lock = 0;
-	} else {
 		sp->microcode_lock = ~0;
+	} else {
+		sp->microcode_lock = 0;
 	}
 	sp->c_handler = (uint32_t)&ap_init;
 	ap_count = &sp->ap_count;
@@ -352,6 +472,7 @@ static int apic_wait_timeout(int total_delay, int delay_step)
 	int total = 0;
 	int timeout = 0;
 
+	delay_step = poll_step(delay_step);
 	while (lapic_read(LAPIC_ICR) & LAPIC_ICR_BUSY) {
 		udelay(delay_step);
 		total += delay_step;
@@ -397,8 +518,13 @@ static int start_aps(struct bus *cpu_bus, int ap_count, atomic_t *num_aps)
 	lapic_write_around(LAPIC_ICR2, SET_LAPIC_DEST_FIELD(0));
 	lapic_write_around(LAPIC_ICR, LAPIC_DEST_ALLBUT | LAPIC_INT_ASSERT |
 	                   LAPIC_DM_INIT);
-	printk(BIOS_DEBUG, "Waiting for 10ms after sending INIT.\n");
-	mdelay(10);
+	if (fast_startup) {
+		if (CONFIG_MP_FAST_INIT_DELAY_US)
+			udelay(CONFIG_MP_FAST_INIT_DELAY_US);
+	} else {
+		printk(BIOS_DEBUG, "Waiting for 10ms after sending INIT.\n");
+		mdelay(10);
+	}
 
 	/* Send 1st SIPI */
 	if ((lapic_read(LAPIC_ICR) & LAPIC_ICR_BUSY)) {
@@ -421,8 +547,16 @@ static int start_aps(struct bus *cpu_bus, int ap_count, atomic_t *num_aps)
 		printk(BIOS_DEBUG, "done.\n");
 	}
 
-	/* Wait for CPUs to check in up to 200 us. */
-	wait_for_aps(num_aps, ap_count, 200 /* us */, 15 /* us */);
+	if (fast_startup) {
+		/* The 2nd SIPI is only needed if an AP missed the 1st one. */
+		if (!wait_for_aps(num_aps, ap_count, 1000 /* 1 ms */, 1))
+			return 0;
+		printk(BIOS_DEBUG, "%d/%d APs checked in after 1st SIPI.\n",
+		       atomic_read(num_aps), ap_count);
+	} else {
+		/* Wait for CPUs to check in up to 200 us. */
+		wait_for_aps(num_aps, ap_count, 200 /* us */, 15 /* us */);
+	}
 
 	/* Send 2nd SIPI */
 	if ((lapic_read(LAPIC_ICR) & LAPIC_ICR_BUSY)) {
@@ -520,6 +654,8 @@ int mp_init(struct bus *cpu_bus, struct mp_params *p)
 	int num_aps;
 	atomic_t *ap_count;
 
+	timestamp_add_now(TS_START_MP_INIT);
+
 	init_bsp(cpu_bus);
 
 	if (p == NULL || p->flight_plan == NULL || p->num_records < 1) {
@@ -550,6 +686,9 @@ int mp_init(struct bus *cpu_bus, struct mp_params *p)
 	 * the startup code even if the caches are disabled.  */
 	wbinvd();
 
+	fast_startup = mp_fast_startup_supported();
+	mp_num_cpus = p->num_cpus;
+
 	/* Start the APs providing number of APs and the cpus_entered field. */
 	num_aps = p->num_cpus - 1;
 	if (start_aps(cpu_bus, num_aps, ap_count) < 0) {
@@ -559,10 +698,106 @@ int mp_init(struct bus *cpu_bus, struct mp_params *p)
 		return -1;
 	}
 
+	timestamp_add_now(TS_MP_APS_STARTED);
+	if (fast_startup)
+		printk(BIOS_INFO, "%d APs started.\n", num_aps);
+
 	/* Walk the flight plan for the BSP. */
-	return bsp_do_flight_plan(p);
+	if (bsp_do_flight_plan(p) < 0)
+		return -1;
+
+	if (IS_ENABLED(CONFIG_PARALLEL_MP_AP_WORK))
+		waiting_aps = num_aps;
+
+	timestamp_add_now(TS_END_MP_INIT);
+
+	return 0;
 }
 
+int mp_run_on_aps(void (*func)(void *), void *arg, long expire_us)
+{
+	const int step_us = 10;
+	long waited = 0;
+	uint32_t gen;
+	int i, taken;
+
+	if (!IS_ENABLED(CONFIG_PARALLEL_MP_AP_WORK) || waiting_aps == 0)
+		return -1;
+
+	/* 0 marks an empty slot. */
+	gen = ++ap_generation;
+	if (gen == 0)
+		gen = ++ap_generation;
+
+	/* cpu slot 0 is the BSP, the APs follow. */
+	for (i = 1; i <= waiting_aps; i++) {
+		ap_work[i].func = func;
+		ap_work[i].arg = arg;
+		store_posted(&ap_posted[i], gen);
+	}
+
+	while (waited < expire_us) {
+		taken = 0;
+		for (i = 1; i <= waiting_aps; i++)
+			if (read_posted(&ap_posted[i]) == 0)
+				taken++;
+		if (taken == waiting_aps)
+			break;
+		udelay(step_us);
+		waited += step_us;
+	}
+
+	/* The next call rewrites ap_work[], so every slot has to be empty
+	 * before returning. Whatever is still there was not taken, withdraw
+	 * it. */
+	taken = 0;
+	for (i = 1; i <= waiting_aps; i++)
+		if (xchg_posted(&ap_posted[i], 0) == 0)
+			taken++;
+
+	if (taken != waiting_aps)
+		printk(BIOS_ERR, "MP: only %d/%d APs took work\n", taken,
+		       waiting_aps);
+
+	return taken;
+}
+
+static void park_this_cpu(void *unused)
+{
+	stop_this_cpu();
+}
+
+int mp_park_aps(void)
+{
+	int ret;
+
+	ret = mp_run_on_aps(park_this_cpu, NULL, 10000 /* 10 ms */);
+	waiting_aps = 0;
+
+	return ret < 0 ? 0 : ret;
+}
+
+#if IS_ENABLED(CONFIG_PARALLEL_MP_AP_WORK)
+int arch_run_on_idle_cpus(void (*func)(void *), void *arg)
+{
+	int ret;
+
+	ret = mp_run_on_aps(func, arg, 1000 /* 1 ms */);
+
+	return ret < 0 ? 0 : ret;
+}
+
+/* Don't leave the APs spinning in coreboot memory once the payload or the
+ * resumed OS runs. */
+static void park_aps(void *unused)
+{
+	mp_park_aps();
+}
+
+BOOT_STATE_INIT_ENTRY(BS_OS_RESUME, BS_ON_ENTRY, park_aps, NULL);
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_BOOT, BS_ON_ENTRY, park_aps, NULL);
+#endif
+
 void mp_initialize_cpu(void *unused)
 {
 	/* Call back into driver infrastructure for the AP initialization.   */
@@ -578,6 +813,34 @@ int mp_get_apic_id(int cpu_slot)
 	return cpus[cpu_slot].apic_id;
 }
 
+/* CPUs that completed their relocation SMI, see smm_wait_for_relocation(). */
+static char smm_relocated[CONFIG_MAX_CPUS];
+static atomic_t smm_relocated_cpus;
+
+static void smm_relocation_done(void)
+{
+	int cpu = cpu_info()->index;
+
+	/* Each CPU only writes its own slot, the BSP may relocate twice. */
+	if (cpu < CONFIG_MAX_CPUS && !smm_relocated[cpu]) {
+		smm_relocated[cpu] = 1;
+		atomic_inc(&smm_relocated_cpus);
+	}
+}
+
+int smm_wait_for_relocation(int timeout_us)
+{
+	if (wait_for_aps(&smm_relocated_cpus, mp_num_cpus, timeout_us, 10)) {
+		printk(BIOS_ERR, "SMM relocation incomplete: %d/%d CPUs.\n",
+		       atomic_read(&smm_relocated_cpus), mp_num_cpus);
+		return -1;
+	}
+
+	printk(BIOS_DEBUG, "SMM relocation complete on %d CPUs.\n",
+	       mp_num_cpus);
+	return 0;
+}
+
 void smm_initiate_relocation_parallel(void)
 {
 	if ((lapic_read(LAPIC_ICR) & LAPIC_ICR_BUSY)) {
@@ -593,8 +856,11 @@ void smm_initiate_relocation_parallel(void)
 	lapic_write_around(LAPIC_ICR, LAPIC_INT_ASSERT | LAPIC_DM_SMI);
 	if (apic_wait_timeout(1000 /* 1 ms */, 100 /* us */)) {
 		printk(BIOS_DEBUG, "SMI Relocation timed out.\n");
-	} else
-		printk(BIOS_DEBUG, "Relocation complete.\n");
+	} else {
+		/* smm_wait_for_relocation() reports for all CPUs at once. */
+		printk(BIOS_SPEW, "Relocation complete.\n");
+		smm_relocation_done();
+	}
 
 }
 
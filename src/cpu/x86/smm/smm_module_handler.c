@@ -109,9 +109,9 @@ void *smm_get_save_state(int cpu)
 
 	/* This function assumes all save states start at top of default
 	 * SMRAM size space and are staggered down by save state size. */
-	base = (void *)smm_runtime->smbase;
+	base = (void *)smm_runtime_smbase(smm_runtime, cpu);
 	base += SMM_DEFAULT_SIZE;
-	base -= (cpu + 1) * smm_runtime->save_state_size;
+	base -= smm_runtime->save_state_size;
 
 	return base;
 }
@@ -13,6 +13,7 @@
  * GNU General Public License for more details.
  */
 
+#include <commonlib/helpers.h>
 #include <string.h>
 #include <rmodule.h>
 #include <cpu/x86/smm.h>
@@ -51,6 +52,9 @@ extern unsigned char _binary_smm_start[];
 /* Per cpu minimum stack size. */
 #define SMM_MINIMUM_STACK_SIZE 32
 
+/* Runtime of the module placed by smm_load_module(). */
+static const struct smm_runtime *smm_module_runtime;
+
 /*
  * The smm_entry_ins consists of 3 bytes. It is used when staggering SMRAM entry
  * addresses across CPUs.
@@ -125,23 +129,24 @@ static void *smm_stub_place_stacks(char *base, int size,
 	return stacks_top;
 }
 
-/* Place the staggered entry points for each CPU. The entry points are
- * staggered by the per cpu SMM save state size extending down from
- * SMM_ENTRY_OFFSET. */
+/* Place the staggered entry points for each CPU in a window. The entry
+ * points are staggered by the per cpu SMM save state size extending down
+ * from SMM_ENTRY_OFFSET. */
 static void smm_stub_place_staggered_entry_points(char *base,
-	const struct smm_loader_params *params, const struct rmodule *smm_stub)
+	const struct smm_loader_params *params, int num_cpus,
+	void *stub_entry)
 {
 	int stub_entry_offset;
 
-	stub_entry_offset = rmodule_entry_offset(smm_stub);
+	stub_entry_offset = (char *)stub_entry - &base[SMM_ENTRY_OFFSET];
 
 	/* If there are staggered entry points or the stub is not located
 	 * at the SMM entry point then jmp instructions need to be placed. */
-	if (params->num_concurrent_save_states > 1 || stub_entry_offset != 0) {
+	if (num_cpus > 1 || stub_entry_offset != 0) {
 		int num_entries;
 
 		base += SMM_ENTRY_OFFSET;
-		num_entries = params->num_concurrent_save_states;
+		num_entries = num_cpus;
 		/* Adjust beginning entry and number of entries down since
 		 * the initial entry point doesn't need a jump sequence. */
 		if (stub_entry_offset == 0) {
@@ -151,7 +156,72 @@ static void smm_stub_place_staggered_entry_points(char *base,
 		smm_place_jmp_instructions(base,
 		                           params->per_cpu_save_state_size,
 		                           num_entries,
-		                           rmodule_entry(smm_stub));
+		                           stub_entry);
+	}
+}
+
+/*
+ * Only as many save states as fit between the stub and the top of the
+ * default SMRAM size can be staggered below one SMBASE. Larger CPU counts
+ * are split into windows of SMM_DEFAULT_SIZE stacked above smbase, each
+ * with the same layout. Returns the number of CPUs per window, 0 if they
+ * all fit into the first one.
+ */
+static int smm_stub_cpus_per_window(const struct smm_loader_params *params,
+				    int smm_stub_size)
+{
+	int cpus;
+
+	cpus = (SMM_DEFAULT_SIZE - SMM_ENTRY_OFFSET - smm_stub_size) /
+	       params->per_cpu_save_state_size;
+
+	if (params->num_concurrent_save_states <= cpus)
+		return 0;
+
+	return cpus;
+}
+
+static int smm_stub_num_windows(const struct smm_loader_params *params,
+				int cpus_per_window)
+{
+	if (cpus_per_window == 0)
+		return 1;
+
+	return (params->num_concurrent_save_states + cpus_per_window - 1) /
+	       cpus_per_window;
+}
+
+/*
+ * The stub addresses its code and parameters absolutely once it has been
+ * loaded, so a copy of it at the entry point of another window continues
+ * in the loaded stub. All windows share the parameters and the stacks.
+ */
+static void smm_stub_place_windows(char *base,
+	const struct smm_loader_params *params, int cpus_per_window,
+	char *smm_stub_loc, const struct rmodule *smm_stub)
+{
+	void *stub_entry = rmodule_entry(smm_stub);
+	int smm_stub_size = rmodule_memory_size(smm_stub);
+	int num_windows;
+	int cpus;
+	int i;
+
+	num_windows = smm_stub_num_windows(params, cpus_per_window);
+	cpus = params->num_concurrent_save_states;
+
+	for (i = 0; i < num_windows; i++) {
+		char *window = &base[i * SMM_DEFAULT_SIZE];
+		int offset = i * SMM_DEFAULT_SIZE;
+
+		if (i > 0)
+			memcpy(smm_stub_loc + offset, smm_stub_loc,
+			       smm_stub_size);
+
+		smm_stub_place_staggered_entry_points(window, params,
+			cpus_per_window ? MIN(cpus, cpus_per_window) : cpus,
+			(char *)stub_entry + offset);
+
+		cpus -= cpus_per_window;
 	}
 }
 
@@ -177,6 +247,8 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 	int size;
 	char *base;
 	int i;
+	int cpus_per_window;
+	int window_save_states;
 	struct smm_stub_params *stub_params;
 	struct rmodule smm_stub;
 
@@ -191,15 +263,6 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 	if (rmodule_parse(&_binary_smmstub_start, &smm_stub))
 		return -1;
 
-	/* Adjust remaining size to account for save state. */
-	total_save_state_size = params->per_cpu_save_state_size *
-	                        params->num_concurrent_save_states;
-	size -= total_save_state_size;
-
-	/* The save state size encroached over the first SMM entry point. */
-	if (size <= SMM_ENTRY_OFFSET)
-		return -1;
-
 	/* Need a minimum stack size and alignment. */
 	if (params->per_cpu_stack_size <= SMM_MINIMUM_STACK_SIZE ||
 	    (params->per_cpu_stack_size & 3) != 0)
@@ -223,6 +286,20 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 		smm_stub_size += entry_sequence_size;
 	}
 
+	/* The save states of a window are staggered down from its top. */
+	cpus_per_window = smm_stub_cpus_per_window(params, smm_stub_size);
+	window_save_states = cpus_per_window ? cpus_per_window :
+	                     params->num_concurrent_save_states;
+
+	/* Adjust remaining size to account for save state. */
+	total_save_state_size = params->per_cpu_save_state_size *
+	                        window_save_states;
+	size -= total_save_state_size;
+
+	/* The save state size encroached over the first SMM entry point. */
+	if (size <= SMM_ENTRY_OFFSET)
+		return -1;
+
 	/* Stub is too big to fit. */
 	if (smm_stub_size > (size - SMM_ENTRY_OFFSET))
 		return -1;
@@ -234,7 +311,7 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 	 * entry points. The staggered entry points extend
 	 * below SMM_ENTRY_OFFSET by the number of concurrent
 	 * save states - 1 and save state size. */
-	if (params->num_concurrent_save_states > 1) {
+	if (window_save_states > 1) {
 		size -= total_save_state_size;
 		size += params->per_cpu_save_state_size;
 	}
@@ -248,8 +325,9 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 	if (rmodule_load(smm_stub_loc, &smm_stub))
 		return -1;
 
-	/* Place staggered entry points. */
-	smm_stub_place_staggered_entry_points(base, params, &smm_stub);
+	/* Place staggered entry points and the windows for further CPUs. */
+	smm_stub_place_windows(base, params, cpus_per_window, smm_stub_loc,
+			       &smm_stub);
 
 	/* Setup the parameters for the stub code. */
 	stub_params = rmodule_parameters(&smm_stub);
@@ -259,6 +337,7 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 	stub_params->c_handler_arg = (u32)params->handler_arg;
 	stub_params->runtime.smbase = (u32)smbase;
 	stub_params->runtime.save_state_size = params->per_cpu_save_state_size;
+	stub_params->runtime.cpus_per_window = cpus_per_window;
 
 	/* Initialize the APIC id to cpu number table to be 1:1 */
 	for (i = 0; i < params->num_concurrent_stacks; i++)
@@ -269,6 +348,9 @@ static int smm_module_setup_stub(void *smbase, struct smm_loader_params *params)
 
 	printk(BIOS_DEBUG, "SMM Module: stub loaded at %p. Will call %p(%p)\n",
 	       smm_stub_loc, params->handler, params->handler_arg);
+	if (cpus_per_window)
+		printk(BIOS_DEBUG, "SMM Module: %d CPUs per %d KiB window\n",
+		       cpus_per_window, SMM_DEFAULT_SIZE >> 10);
 
 	return 0;
 }
@@ -306,12 +388,15 @@ int smm_setup_relocation_handler(struct smm_loader_params *params)
  * |    stacks       |
  * +-----------------+ <- smram + size - total_stack_size
  * |      ...        |
- * +-----------------+ <- smram + handler_size + SMM_DEFAULT_SIZE
+ * +-----------------+ <- smram + handler_size + stub_size
  * |    handler      |
- * +-----------------+ <- smram + SMM_DEFAULT_SIZE
+ * +-----------------+ <- smram + stub_size
  * |    stub code    |
  * +-----------------+ <- smram
  *
+ * The stub_size is SMM_DEFAULT_SIZE for each window of CPUs whose save
+ * states can be staggered below one SMBASE, see smm_stub_cpus_per_window().
+ *
  * It should be noted that this algorithm will not work for
  * SMM_DEFAULT_SIZE SMRAM regions such as the A segment. This algorithm
  * expects a region large enough to encompass the handler and stacks
@@ -320,19 +405,30 @@ int smm_setup_relocation_handler(struct smm_loader_params *params)
 int smm_load_module(void *smram, int size, struct smm_loader_params *params)
 {
 	struct rmodule smm_mod;
+	struct rmodule smm_stub;
 	int total_stack_size;
 	int handler_size;
 	int module_alignment;
 	int alignment_size;
+	int stub_size;
 	char *base;
 
-	if (size <= SMM_DEFAULT_SIZE)
-		return -1;
-
 	/* Fail if can't parse the smm rmodule. */
 	if (rmodule_parse(&_binary_smm_start, &smm_mod))
 		return -1;
 
+	/* The windows are sized by the stub including its jmp sequence. */
+	if (rmodule_parse(&_binary_smmstub_start, &smm_stub))
+		return -1;
+	stub_size = rmodule_memory_size(&smm_stub);
+	if (rmodule_entry_offset(&smm_stub) != 0)
+		stub_size += ALIGN_UP(sizeof(struct smm_entry_ins), 16);
+	stub_size = smm_stub_num_windows(params,
+		smm_stub_cpus_per_window(params, stub_size)) * SMM_DEFAULT_SIZE;
+
+	if (size <= stub_size)
+		return -1;
+
 	total_stack_size = params->per_cpu_stack_size *
 	                   params->num_concurrent_stacks;
 
@@ -341,10 +437,10 @@ int smm_load_module(void *smram, int size, struct smm_loader_params *params)
 	base += size;
 	params->stack_top = base;
 
-	/* SMM module starts at offset SMM_DEFAULT_SIZE with the load alignment
+	/* SMM module starts above the stub windows with the load alignment
 	 * taken into account. */
 	base = smram;
-	base += SMM_DEFAULT_SIZE;
+	base += stub_size;
 	handler_size = rmodule_memory_size(&smm_mod);
 	module_alignment = rmodule_load_alignment(&smm_mod);
 	alignment_size = module_alignment - ((u32)base % module_alignment);
@@ -354,7 +450,7 @@ int smm_load_module(void *smram, int size, struct smm_loader_params *params)
 	}
 
 	/* Does the required amount of memory exceed the SMRAM region size? */
-	if ((total_stack_size + handler_size + SMM_DEFAULT_SIZE) > size)
+	if ((total_stack_size + handler_size + stub_size) > size)
 		return -1;
 
 	if (rmodule_load(base, &smm_mod))
@@ -363,5 +459,18 @@ int smm_load_module(void *smram, int size, struct smm_loader_params *params)
 	params->handler = rmodule_entry(&smm_mod);
 	params->handler_arg = rmodule_parameters(&smm_mod);
 
-	return smm_module_setup_stub(smram, params);
+	if (smm_module_setup_stub(smram, params))
+		return -1;
+
+	smm_module_runtime = params->runtime;
+
+	return 0;
+}
+
+u32 smm_get_cpu_smbase(int cpu)
+{
+	if (smm_module_runtime == NULL)
+		return 0;
+
+	return smm_runtime_smbase(smm_module_runtime, cpu);
 }
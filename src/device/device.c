@@ -41,6 +41,7 @@
 #include <string.h>
 #include <smp/spinlock.h>
 #if CONFIG_ARCH_X86
+#include <arch/acpi.h>
 #include <arch/ebda.h>
 #endif
 #include <timer.h>
@@ -1124,6 +1125,10 @@ static void init_dev(struct device *dev)
 		return;
 
 	if (!dev->initialized && dev->ops && dev->ops->init) {
+		if (IS_ENABLED(CONFIG_DEFER_DEVICE_INIT) && dev->defer_init) {
+			printk(BIOS_DEBUG, "%s init deferred\n", dev_path(dev));
+			return;
+		}
 #if CONFIG_HAVE_MONOTONIC_TIMER
 		struct stopwatch sw;
 		stopwatch_init(&sw);
@@ -1203,6 +1208,11 @@ static void final_dev(struct device *dev)
 	if (!dev->enabled)
 		return;
 
+	/* final() of a deferred device runs after its init(), if at all. */
+	if (IS_ENABLED(CONFIG_DEFER_DEVICE_INIT) && dev->defer_init &&
+	    !dev->initialized)
+		return;
+
 	if (dev->ops && dev->ops->final) {
 		printk(BIOS_DEBUG, "%s final\n", dev_path(dev));
 		dev->ops->final(dev);
@@ -1243,3 +1253,89 @@ void dev_finalize(void)
 
 	printk(BIOS_INFO, "Devices finalized\n");
 }
+
+/*
+ * Mainboards override this to skip the deferred devices at runtime, e.g. when
+ * a fast boot was requested.
+ */
+int __attribute__((weak)) dev_skip_deferred_init(void)
+{
+#if CONFIG_ARCH_X86
+	return IS_ENABLED(CONFIG_DEFERRED_DEVICE_INIT_SKIP_ON_RESUME) &&
+		acpi_is_wakeup_s3();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Initialize the devices marked defer_init in the devicetree.
+ *
+ * This runs after all other devices are initialized and before any of them
+ * is finalized, so a deferred device still sees the chipset unlocked, on S3
+ * resume as well. The init() methods are called in device list order, their
+ * final() methods follow with everybody else's. When dev_skip_deferred_init()
+ * returns 1 nothing is done and the devices are left for the OS to bring up.
+ */
+void dev_initialize_deferred(void)
+{
+	struct device *dev;
+	int count = 0;
+	int skip;
+#if CONFIG_HAVE_MONOTONIC_TIMER
+	struct stopwatch total;
+	long usecs;
+#endif
+
+	if (!IS_ENABLED(CONFIG_DEFER_DEVICE_INIT))
+		return;
+
+	skip = dev_skip_deferred_init();
+
+#if CONFIG_HAVE_MONOTONIC_TIMER
+	stopwatch_init(&total);
+#endif
+
+	for (dev = all_devices; dev; dev = dev->next) {
+		if (!dev->enabled || !dev->defer_init || dev->initialized)
+			continue;
+
+		if (skip) {
+			printk(BIOS_DEBUG, "%s init skipped\n", dev_path(dev));
+			count++;
+			continue;
+		}
+
+		/* Nothing to run, but its final() is still wanted. */
+		if (!dev->ops || !dev->ops->init) {
+			dev->initialized = 1;
+			continue;
+		}
+
+#if CONFIG_HAVE_MONOTONIC_TIMER
+		struct stopwatch sw;
+		stopwatch_init(&sw);
+#endif
+		printk(BIOS_DEBUG, "%s deferred init ...\n", dev_path(dev));
+		dev->initialized = 1;
+		dev->ops->init(dev);
+#if CONFIG_HAVE_MONOTONIC_TIMER
+		usecs = stopwatch_duration_usecs(&sw);
+		printk(BIOS_DEBUG, "%s deferred init finished in %ld usecs\n",
+		       dev_path(dev), usecs);
+#endif
+		count++;
+	}
+
+	if (skip) {
+		printk(BIOS_INFO, "%d deferred devices left to the OS\n", count);
+		return;
+	}
+
+#if CONFIG_HAVE_MONOTONIC_TIMER
+	printk(BIOS_INFO, "%d deferred devices initialized in %ld usecs\n",
+	       count, stopwatch_duration_usecs(&total));
+#else
+	printk(BIOS_INFO, "%d deferred devices initialized\n", count);
+#endif
+}
@@ -279,7 +279,11 @@ void vbe_set_graphics(void)
 	}
 	decdata = malloc(sizeof(*decdata));
 	int ret = 0;
-	ret = jpeg_decode(jpeg, framebuffer, 1024, 768, 16, decdata);
+	ret = jpeg_decode_fb(jpeg, framebuffer,
+			     le16_to_cpu(mode_info.vesa.x_resolution),
+			     le16_to_cpu(mode_info.vesa.y_resolution),
+			     le16_to_cpu(mode_info.vesa.bytes_per_scanline),
+			     16, decdata);
 #endif
 }
 
@@ -38,6 +38,7 @@
 #include <device/pci_ids.h>
 #include <device/pcix.h>
 #include <device/pciexp.h>
+#include <device/pci_scan_cache.h>
 #include <device/hypertransport.h>
 #include <pc80/i8259.h>
 #include <kconfig.h>
@@ -1074,6 +1075,105 @@ unsigned int pci_match_simple_dev(device_t dev, pci_devfn_t sdev)
 			dev->path.pci.devfn == PCI_DEV2DEVFN(sdev);
 }
 
+/* Returns 1 if the device tree has a device at devfn. */
+static int pci_scan_has_dev(struct device *list, unsigned int devfn)
+{
+	for (; list; list = list->sibling) {
+		if (list->path.type == DEVICE_PATH_PCI &&
+		    list->path.pci.devfn == devfn)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Probe a devfn. Devices that are not in the device tree are recorded for
+ * PCI_SCAN_CACHE, the others are probed on every boot anyway.
+ */
+static struct device *pci_scan_dev(struct device **old_devices,
+				   struct bus *bus, unsigned int devfn)
+{
+	struct device *dev;
+
+	/* First thing setup the device structure. */
+	dev = pci_scan_get_dev(old_devices, devfn);
+	if (dev)
+		return pci_probe_dev(dev, bus, devfn);
+
+	/* See if a device is present and setup the device structure. */
+	dev = pci_probe_dev(NULL, bus, devfn);
+	if (dev)
+		pci_scan_cache_record(bus->secondary, devfn,
+				      dev->vendor | dev->device << 16);
+	return dev;
+}
+
+/* PCIe port type of the bridge leading to the bus, -1 if there is none. */
+static int pci_bus_port_type(struct bus *bus, unsigned int *cap)
+{
+	struct device *bridge = bus->dev;
+
+	if (!bridge || bridge->path.type != DEVICE_PATH_PCI)
+		return -1;
+
+	*cap = pci_find_capability(bridge, PCI_CAP_ID_PCIE);
+	if (!*cap)
+		return -1;
+
+	return (pci_read_config16(bridge, *cap + PCI_EXP_FLAGS) &
+		PCI_EXP_FLAGS_TYPE) >> 4;
+}
+
+/*
+ * Look up the devices found on the bus on the previous boot. Returns their
+ * number, or -1 if the bus has to be probed as usual because it is not in
+ * the cache, one of the devices changed or cards may have been added. Only
+ * root buses and the internal buses of PCIe switches are taken from the
+ * cache, slots hang off the other ones.
+ */
+static int pci_scan_cached(struct bus *bus, int port_type,
+			   const struct pci_scan_cache_entry **entries)
+{
+	struct device dummy;
+	int i, n;
+
+	n = pci_scan_cache_lookup(bus->secondary, entries);
+	if (n < 0 || !bus->dev)
+		return -1;
+
+	if (bus->dev->path.type != DEVICE_PATH_DOMAIN &&
+	    port_type != PCI_EXP_TYPE_UPSTREAM)
+		return -1;
+
+	dummy.bus = bus;
+	dummy.path.type = DEVICE_PATH_PCI;
+	for (i = 0; i < n; i++) {
+		dummy.path.pci.devfn = (*entries)[i].devfn;
+		if (pci_read_config32(&dummy, PCI_VENDOR_ID) !=
+		    (*entries)[i].id) {
+			printk(BIOS_DEBUG, "PCI: bus %02x changed, probing "
+			       "all devices\n", bus->secondary);
+			return -1;
+		}
+	}
+
+	return n;
+}
+
+#if IS_ENABLED(CONFIG_PCIEXP_PLUGIN_SUPPORT) && IS_ENABLED(CONFIG_MMCONF_SUPPORT)
+/* The next function of an ARI device, 0 for the last one. */
+static unsigned int pci_ari_next_fn(struct device *dev)
+{
+	unsigned int cap;
+
+	cap = pciexp_find_extended_cap(dev, PCIE_EXT_CAP_ARI_ID);
+	if (!cap)
+		return 0;
+
+	return PCI_ARI_CAP_NFN(pci_mmio_read_config16(dev, cap + PCI_ARI_CAP));
+}
+#endif
+
 /**
  * Scan a PCI bus.
  *
@@ -1087,8 +1187,11 @@ unsigned int pci_match_simple_dev(device_t dev, pci_devfn_t sdev)
 void pci_scan_bus(struct bus *bus, unsigned min_devfn,
 			  unsigned max_devfn)
 {
-	unsigned int devfn;
+	unsigned int devfn, cap;
 	struct device *old_devices;
+	const struct pci_scan_cache_entry *cached = NULL;
+	int ncached = -1, next = 0, probed = 0;
+	int port_type, ari = 0;
 
 	printk(BIOS_DEBUG, "PCI: pci_scan_bus for bus %02x\n", bus->secondary);
 
@@ -1106,18 +1209,59 @@ void pci_scan_bus(struct bus *bus, unsigned min_devfn,
 
 	post_code(0x24);
 
+	if (IS_ENABLED(CONFIG_PCI_FAST_SCAN)) {
+		port_type = pci_bus_port_type(bus, &cap);
+
+		/*
+		 * Only device 0 can sit below a PCIe port, unless ARI
+		 * forwarding makes the device number part of the function.
+		 */
+		if (port_type == PCI_EXP_TYPE_ROOT_PORT ||
+		    port_type == PCI_EXP_TYPE_DOWNSTREAM) {
+			ari = pci_read_config16(bus->dev, cap + PCI_EXP_DEVCTL2)
+				& PCI_EXP_DEVCTL2_ARI;
+			if (!ari)
+				max_devfn = MIN(max_devfn, 0x07);
+		}
+
+		ncached = pci_scan_cached(bus, port_type, &cached);
+	}
+
 	/*
 	 * Probe all devices/functions on this bus with some optimization for
 	 * non-existence and single function devices.
 	 */
 	for (devfn = min_devfn; devfn <= max_devfn; devfn++) {
-		struct device *dev;
+		struct device *dev = NULL;
 
-		/* First thing setup the device structure. */
-		dev = pci_scan_get_dev(&old_devices, devfn);
+		/*
+		 * With a cache hit only what was found on the previous boot
+		 * and the devices in the device tree are probed.
+		 */
+		while (next < ncached && cached[next].devfn < devfn)
+			next++;
+		if (ncached < 0 || pci_scan_has_dev(old_devices, devfn) ||
+		    (next < ncached && cached[next].devfn == devfn)) {
+			dev = pci_scan_dev(&old_devices, bus, devfn);
+			probed++;
+		}
 
-		/* See if a device is present and setup the device structure. */
-		dev = pci_probe_dev(dev, bus, devfn);
+		/*
+		 * ARI devices chain their functions, follow the chain
+		 * instead of the device number.
+		 */
+		if (ari) {
+#if IS_ENABLED(CONFIG_PCIEXP_PLUGIN_SUPPORT) && IS_ENABLED(CONFIG_MMCONF_SUPPORT)
+			unsigned int next_fn = 0;
+
+			if (dev && dev->enabled)
+				next_fn = pci_ari_next_fn(dev);
+			if (next_fn <= devfn)
+				break;
+			devfn = next_fn - 1;
+#endif
+			continue;
+		}
 
 		/*
 		 * If this is not a multi function device, or the device is
@@ -1130,6 +1274,9 @@ void pci_scan_bus(struct bus *bus, unsigned min_devfn,
 		}
 	}
 
+	printk(BIOS_SPEW, "PCI: %d devfns probed on bus %02x%s\n", probed,
+	       bus->secondary, ncached >= 0 ? " (cached)" : "");
+
 	post_code(0x25);
 
 	/*
@@ -1152,6 +1299,9 @@ void pci_scan_bus(struct bus *bus, unsigned min_devfn,
 
 	scan_bridges(bus);
 
+	/* The links of the bridges just scanned retrain in parallel. */
+	pciexp_wait_links(bus);
+
 	/*
 	 * We've scanned the bus and so we know all about what's on the other
 	 * side of any bridges that may be on this bus plus any devices.
@@ -0,0 +1,266 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <boot_device.h>
+#include <bootstate.h>
+#include <commonlib/fnv.h>
+#include <commonlib/helpers.h>
+#include <console/console.h>
+#include <device/pci_scan_cache.h>
+#include <fmap.h>
+#include <pc80/mc146818rtc.h>
+#include <spi_flash.h>
+#include <string.h>
+#include <version.h>
+
+#if IS_ENABLED(CONFIG_USE_OPTION_TABLE)
+#include "option_table.h"
+#endif
+
+#define PCI_SCAN_CACHE_REGION		"RW_PCI_CACHE"
+#define PCI_SCAN_CACHE_SIGNATURE	(('P'<<0)|('C'<<8)|('I'<<16)|('C'<<24))
+#define PCI_SCAN_CACHE_VERSION		1
+#define PCI_SCAN_CACHE_ENTRIES		256
+
+/* The Intel flash descriptor with the PCH soft straps, at the flash start. */
+#define IFD_SIZE			4096
+#define IFD_SIGNATURE_OFFSET		0x10
+#define IFD_SIGNATURE			0x0ff0a55a
+
+struct pci_scan_cache_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t key;		/* hash of what decides the devices present */
+	uint32_t checksum;	/* of the bus map and the entries */
+	uint32_t count;		/* number of entries */
+	uint32_t reserved;
+	uint8_t buses[32];	/* bitmap of the buses that were scanned */
+} __attribute__((packed));
+
+enum pci_scan_cache_state {
+	PCI_SCAN_CACHE_UNKNOWN,	/* not looked up yet */
+	PCI_SCAN_CACHE_MISS,	/* all buses are probed */
+	PCI_SCAN_CACHE_HIT,	/* the old entries can be used */
+};
+
+static struct {
+	enum pci_scan_cache_state state;
+	uint32_t key;
+	/* What was found on the previous boot. */
+	struct pci_scan_cache_header old;
+	const struct pci_scan_cache_entry *old_entries;
+	/* What is found on this boot. */
+	struct pci_scan_cache_header hdr;
+	struct pci_scan_cache_entry entries[PCI_SCAN_CACHE_ENTRIES];
+	int overflow;
+} psc;
+
+static uint32_t pci_scan_cache_checksum(const struct pci_scan_cache_header *hdr,
+					const struct pci_scan_cache_entry *e)
+{
+	uint32_t h = FNV32_OFFSET;
+
+	h = fnv1a32(h, hdr->buses, sizeof(hdr->buses));
+	return fnv1a32(h, e, hdr->count * sizeof(*e));
+}
+
+static uint32_t pci_scan_cache_key_cmos(uint32_t h)
+{
+#if IS_ENABLED(CONFIG_USE_OPTION_TABLE)
+	int i;
+
+	for (i = LB_CKS_RANGE_START; i <= LB_CKS_RANGE_END; i++) {
+		uint8_t b = cmos_read(i);
+
+		h = fnv1a32(h, &b, sizeof(b));
+	}
+#endif
+
+	return h;
+}
+
+/*
+ * Besides the build, CMOS options and the soft straps in the flash descriptor
+ * can hide or unhide devices, e.g. PCH functions.
+ */
+static uint32_t pci_scan_cache_key(void)
+{
+	const struct region_device *boot_dev;
+	uint32_t h = FNV32_OFFSET;
+	uint32_t sig;
+	void *ifd;
+
+	h = fnv1a32(h, coreboot_version, strlen(coreboot_version));
+	h = fnv1a32(h, coreboot_build, strlen(coreboot_build));
+	h = pci_scan_cache_key_cmos(h);
+
+	boot_dev = boot_device_ro();
+	if (boot_dev == NULL ||
+	    rdev_readat(boot_dev, &sig, IFD_SIGNATURE_OFFSET, sizeof(sig)) !=
+			sizeof(sig) || sig != IFD_SIGNATURE)
+		return h;
+
+	ifd = rdev_mmap(boot_dev, 0, IFD_SIZE);
+	if (ifd == NULL)
+		return h;
+
+	h = fnv1a32(h, ifd, IFD_SIZE);
+	rdev_munmap(boot_dev, ifd);
+
+	return h;
+}
+
+static void pci_scan_cache_load(void)
+{
+	struct pci_scan_cache_header *old = &psc.old;
+	struct region_device rdev;
+	const struct pci_scan_cache_entry *e;
+	size_t size;
+
+	psc.state = PCI_SCAN_CACHE_MISS;
+	psc.key = pci_scan_cache_key();
+
+	if (fmap_locate_area_as_rdev(PCI_SCAN_CACHE_REGION, &rdev)) {
+		printk(BIOS_DEBUG, "PCI cache: no %s region\n",
+		       PCI_SCAN_CACHE_REGION);
+		return;
+	}
+
+	if (rdev_readat(&rdev, old, 0, sizeof(*old)) != sizeof(*old))
+		return;
+
+	if (old->signature != PCI_SCAN_CACHE_SIGNATURE ||
+	    old->version != PCI_SCAN_CACHE_VERSION ||
+	    old->count > PCI_SCAN_CACHE_ENTRIES) {
+		printk(BIOS_DEBUG, "PCI cache: empty\n");
+		return;
+	}
+
+	if (old->key != psc.key) {
+		printk(BIOS_DEBUG, "PCI cache: build or straps changed\n");
+		return;
+	}
+
+	size = old->count * sizeof(*e);
+	if (size > region_device_sz(&rdev) - sizeof(*old))
+		return;
+
+	e = rdev_mmap(&rdev, sizeof(*old), size);
+	if (e == NULL)
+		return;
+
+	if (pci_scan_cache_checksum(old, e) != old->checksum) {
+		printk(BIOS_ERR, "PCI cache: checksum mismatch\n");
+		rdev_munmap(&rdev, (void *)e);
+		return;
+	}
+
+	printk(BIOS_DEBUG, "PCI cache: %u devices on record\n", old->count);
+	psc.old_entries = e;
+	psc.state = PCI_SCAN_CACHE_HIT;
+}
+
+int pci_scan_cache_lookup(unsigned int bus,
+			  const struct pci_scan_cache_entry **entries)
+{
+	const struct pci_scan_cache_entry *e;
+	int i, n;
+
+	if (psc.state == PCI_SCAN_CACHE_UNKNOWN)
+		pci_scan_cache_load();
+
+	bus &= 0xff;
+	psc.hdr.buses[bus / 8] |= 1 << (bus % 8);
+
+	if (psc.state != PCI_SCAN_CACHE_HIT ||
+	    !(psc.old.buses[bus / 8] & (1 << (bus % 8))))
+		return -1;
+
+	/* A bus is scanned in one go, so its entries are next to each other. */
+	e = psc.old_entries;
+	for (i = 0; i < psc.old.count && e[i].bus != bus; i++)
+		;
+	for (n = 0; i + n < psc.old.count && e[i + n].bus == bus; n++)
+		;
+
+	*entries = &e[i];
+	return n;
+}
+
+void pci_scan_cache_record(unsigned int bus, unsigned int devfn, uint32_t id)
+{
+	struct pci_scan_cache_entry *e;
+
+	if (psc.hdr.count >= ARRAY_SIZE(psc.entries)) {
+		psc.overflow = 1;
+		return;
+	}
+
+	e = &psc.entries[psc.hdr.count++];
+	e->bus = bus;
+	e->devfn = devfn;
+	e->reserved = 0;
+	e->id = id;
+}
+
+static void pci_scan_cache_update(void *unused)
+{
+	struct pci_scan_cache_header *hdr = &psc.hdr;
+	struct spi_flash *flash;
+	struct region r;
+	size_t size;
+
+	/* Nothing was scanned, e.g. on a board without PCI devices. */
+	if (psc.state == PCI_SCAN_CACHE_UNKNOWN)
+		return;
+
+	if (psc.overflow) {
+		printk(BIOS_ERR, "PCI cache: more than %d devices\n",
+		       PCI_SCAN_CACHE_ENTRIES);
+		return;
+	}
+
+	hdr->signature = PCI_SCAN_CACHE_SIGNATURE;
+	hdr->version = PCI_SCAN_CACHE_VERSION;
+	hdr->key = psc.key;
+	hdr->checksum = pci_scan_cache_checksum(hdr, psc.entries);
+
+	if (psc.state == PCI_SCAN_CACHE_HIT && !memcmp(hdr, &psc.old,
+						       sizeof(*hdr)))
+		return;
+
+	size = sizeof(*hdr) + hdr->count * sizeof(psc.entries[0]);
+	if (fmap_locate_area(PCI_SCAN_CACHE_REGION, &r) ||
+	    size > region_sz(&r))
+		return;
+
+	flash = spi_flash_probe(CONFIG_BOOT_MEDIA_SPI_BUS, 0);
+	if (flash == NULL) {
+		printk(BIOS_ERR, "PCI cache: no SPI flash\n");
+		return;
+	}
+
+	printk(BIOS_DEBUG, "PCI cache: updating, %u devices\n", hdr->count);
+
+	/* The header goes last so that a partial update is never valid. */
+	if (flash->erase(flash, region_offset(&r),
+			 ALIGN_UP(size, flash->sector_size)) ||
+	    (hdr->count && flash->write(flash, region_offset(&r) + sizeof(*hdr),
+			size - sizeof(*hdr), psc.entries)) ||
+	    flash->write(flash, region_offset(&r), sizeof(*hdr), hdr))
+		printk(BIOS_ERR, "PCI cache: flash update failed\n");
+}
+
+BOOT_STATE_INIT_ENTRY(BS_WRITE_TABLES, BS_ON_EXIT, pci_scan_cache_update, NULL);
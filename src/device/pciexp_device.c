@@ -14,12 +14,15 @@
  * GNU General Public License for more details.
  */
 
+#include <bootstate.h>
+#include <commonlib/helpers.h>
 #include <console/console.h>
 #include <delay.h>
 #include <device/device.h>
 #include <device/pci.h>
 #include <device/pci_ids.h>
 #include <device/pciexp.h>
+#include <timer.h>
 
 #if IS_ENABLED(CONFIG_MMCONF_SUPPORT)
 unsigned int pciexp_find_extended_cap(device_t dev, unsigned int cap)
@@ -48,66 +51,196 @@ unsigned int pciexp_find_extended_cap(device_t dev, unsigned int cap)
 
 #if CONFIG_PCIEXP_COMMON_CLOCK
 /*
- * Re-train a PCIe link
+ * Links are retrained in the background. The retrain of every port on a bus
+ * is started while the bus is scanned and pciexp_wait_links() then waits for
+ * all of them together, instead of each port waiting for its own link. A port
+ * is queued once, the functions behind it are tuned when its link is done.
  */
 #define PCIE_TRAIN_RETRY 10000
-static int pciexp_retrain_link(device_t dev, unsigned cap)
+#define PCIE_TRAIN_MAX_LINKS 32
+
+static struct pciexp_link {
+	device_t root;
+	unsigned int root_cap;
+	struct stopwatch sw;
+} pciexp_links[PCIE_TRAIN_MAX_LINKS];
+static int pciexp_num_links;
+
+static void pciexp_tune_link(device_t root, unsigned int root_cap,
+			     device_t dev, unsigned int cap);
+
+/*
+ * Start link retraining
+ */
+static void pciexp_retrain_link(device_t dev, unsigned cap)
 {
-	unsigned try = PCIE_TRAIN_RETRY;
 	u16 lnk;
 
-	/* Start link retraining */
 	lnk = pci_read_config16(dev, cap + PCI_EXP_LNKCTL);
 	lnk |= PCI_EXP_LNKCTL_RL;
 	pci_write_config16(dev, cap + PCI_EXP_LNKCTL, lnk);
+}
+
+static int pciexp_slot_clock(device_t dev, unsigned int cap)
+{
+	u16 lnk;
+
+	lnk = pci_read_config16(dev, cap + PCI_EXP_LNKSTA);
+	return !!(lnk & PCI_EXP_LNKSTA_SLC);
+}
+
+static int pciexp_link_pending(device_t root)
+{
+	int i;
+
+	for (i = 0; i < pciexp_num_links; i++) {
+		if (pciexp_links[i].root == root)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Tune the functions that waited for the retrained link, i.e. those that
+ * share the slot clock with the port, see pciexp_enable_common_clock().
+ */
+static void pciexp_tune_retrained(device_t root, unsigned int root_cap)
+{
+	device_t dev;
+	unsigned int cap;
 
-	/* Wait for training to complete */
-	while (try--) {
-		lnk = pci_read_config16(dev, cap + PCI_EXP_LNKSTA);
-		if (!(lnk & PCI_EXP_LNKSTA_LT))
-			return 0;
-		udelay(100);
+	if (!root->link_list)
+		return;
+
+	for (dev = root->link_list->children; dev; dev = dev->sibling) {
+		cap = pci_find_capability(dev, PCI_CAP_ID_PCIE);
+		if (cap && pciexp_slot_clock(dev, cap))
+			pciexp_tune_link(root, root_cap, dev, cap);
 	}
+}
+
+static int pciexp_link_trained(struct pciexp_link *link)
+{
+	u16 lnk;
+
+	lnk = pci_read_config16(link->root, link->root_cap + PCI_EXP_LNKSTA);
+	return !(lnk & PCI_EXP_LNKSTA_LT);
+}
+
+/*
+ * Wait for the links of the ports on the given bus, or all of them if bus
+ * is NULL, to finish retraining and tune the devices behind them. There is
+ * a single deadline for all of them.
+ */
+void pciexp_wait_links(struct bus *bus)
+{
+	unsigned try = PCIE_TRAIN_RETRY;
+	struct pciexp_link done;
+	struct stopwatch sw;
+	int i, n, waiting;
+
+	stopwatch_init(&sw);
+	n = 0;
+
+	do {
+		waiting = 0;
+		for (i = 0; i < pciexp_num_links;) {
+			struct pciexp_link *link = &pciexp_links[i];
+
+			if (bus && link->root->bus != bus) {
+				i++;
+				continue;
+			}
+
+			if (!pciexp_link_trained(link)) {
+				if (try) {
+					waiting = 1;
+					i++;
+					continue;
+				}
+				printk(BIOS_ERR, "%s: Link Retrain timeout\n",
+				       dev_path(link->root));
+			} else {
+				printk(BIOS_DEBUG, "%s: Link retrained in %ld "
+				       "usecs\n", dev_path(link->root),
+				       stopwatch_duration_usecs(&link->sw));
+			}
+
+			/* The entry is gone before tuning may add new ones. */
+			done = *link;
+			pciexp_links[i] = pciexp_links[--pciexp_num_links];
+			pciexp_tune_retrained(done.root, done.root_cap);
+			n++;
+		}
+
+		if (waiting) {
+			udelay(100);
+			try--;
+		}
+	} while (waiting);
+
+	if (n)
+		printk(BIOS_DEBUG, "PCIe: %d links retrained in %ld usecs\n",
+		       n, stopwatch_duration_usecs(&sw));
+}
 
-	printk(BIOS_ERR, "%s: Link Retrain timeout\n", dev_path(dev));
-	return -1;
+static void pciexp_wait_all_links(void *unused)
+{
+	pciexp_wait_links(NULL);
 }
 
+/* Ports not on a bus scanned by pci_scan_bus() are caught here. */
+BOOT_STATE_INIT_ENTRY(BS_DEV_ENUMERATE, BS_ON_EXIT, pciexp_wait_all_links,
+		      NULL);
+
 /*
  * Check the Slot Clock Configuration for root port and endpoint
  * and enable Common Clock Configuration if possible.  If CCC is
- * enabled the link must be retrained.
+ * enabled the link must be retrained, which is started here once for all
+ * functions of the endpoint. Returns 1 if the rest of the tuning has to wait
+ * for the link.
  */
-static void pciexp_enable_common_clock(device_t root, unsigned root_cap,
-				       device_t endp, unsigned endp_cap)
+static int pciexp_enable_common_clock(device_t root, unsigned root_cap,
+				      device_t endp, unsigned endp_cap)
 {
-	u16 root_scc, endp_scc, lnkctl;
-
-	/* Get Slot Clock Configuration for root port */
-	root_scc = pci_read_config16(root, root_cap + PCI_EXP_LNKSTA);
-	root_scc &= PCI_EXP_LNKSTA_SLC;
+	struct pciexp_link *link;
+	u16 lnkctl;
 
-	/* Get Slot Clock Configuration for endpoint */
-	endp_scc = pci_read_config16(endp, endp_cap + PCI_EXP_LNKSTA);
-	endp_scc &= PCI_EXP_LNKSTA_SLC;
+	/* Check Slot Clock Configuration for root port and endpoint */
+	if (!pciexp_slot_clock(root, root_cap) ||
+	    !pciexp_slot_clock(endp, endp_cap))
+		return 0;
 
 	/* Enable Common Clock Configuration and retrain */
-	if (root_scc && endp_scc) {
-		printk(BIOS_INFO, "Enabling Common Clock Configuration\n");
+	printk(BIOS_INFO, "Enabling Common Clock Configuration\n");
 
-		/* Set in endpoint */
-		lnkctl = pci_read_config16(endp, endp_cap + PCI_EXP_LNKCTL);
-		lnkctl |= PCI_EXP_LNKCTL_CCC;
-		pci_write_config16(endp, endp_cap + PCI_EXP_LNKCTL, lnkctl);
+	/* Set in endpoint */
+	lnkctl = pci_read_config16(endp, endp_cap + PCI_EXP_LNKCTL);
+	lnkctl |= PCI_EXP_LNKCTL_CCC;
+	pci_write_config16(endp, endp_cap + PCI_EXP_LNKCTL, lnkctl);
 
-		/* Set in root port */
-		lnkctl = pci_read_config16(root, root_cap + PCI_EXP_LNKCTL);
-		lnkctl |= PCI_EXP_LNKCTL_CCC;
-		pci_write_config16(root, root_cap + PCI_EXP_LNKCTL, lnkctl);
+	/* Another function of the endpoint already started the retrain. */
+	if (pciexp_link_pending(root))
+		return 1;
 
-		/* Retrain link if CCC was enabled */
-		pciexp_retrain_link(root, root_cap);
-	}
+	/* Set in root port */
+	lnkctl = pci_read_config16(root, root_cap + PCI_EXP_LNKCTL);
+	lnkctl |= PCI_EXP_LNKCTL_CCC;
+	pci_write_config16(root, root_cap + PCI_EXP_LNKCTL, lnkctl);
+
+	/* Too many links in flight, wait for the older ones first. */
+	if (pciexp_num_links == ARRAY_SIZE(pciexp_links))
+		pciexp_wait_links(NULL);
+
+	/* Retrain link if CCC was enabled */
+	link = &pciexp_links[pciexp_num_links++];
+	link->root = root;
+	link->root_cap = root_cap;
+	stopwatch_init(&link->sw);
+	pciexp_retrain_link(root, root_cap);
+
+	return 1;
 }
 #endif /* CONFIG_PCIEXP_COMMON_CLOCK */
 
@@ -376,24 +509,10 @@ static enum aspm_type pciexp_enable_aspm(device_t root, unsigned root_cap,
 }
 #endif /* CONFIG_PCIEXP_ASPM */
 
-static void pciexp_tune_dev(device_t dev)
+/* Everything that has to be done once the link has its final clocking. */
+static void pciexp_tune_link(device_t root, unsigned int root_cap,
+			     device_t dev, unsigned int cap)
 {
-	device_t root = dev->bus->dev;
-	unsigned int root_cap, cap;
-
-	cap = pci_find_capability(dev, PCI_CAP_ID_PCIE);
-	if (!cap)
-		return;
-
-	root_cap = pci_find_capability(root, PCI_CAP_ID_PCIE);
-	if (!root_cap)
-		return;
-
-#if CONFIG_PCIEXP_COMMON_CLOCK
-	/* Check for and enable Common Clock */
-	pciexp_enable_common_clock(root, root_cap, dev, cap);
-#endif
-
 #if CONFIG_PCIEXP_CLK_PM
 	/* Check if per port CLK req is supported by endpoint*/
 	pciexp_enable_clock_power_pm(dev, cap);
@@ -417,6 +536,28 @@ static void pciexp_tune_dev(device_t dev)
 #endif
 }
 
+static void pciexp_tune_dev(device_t dev)
+{
+	device_t root = dev->bus->dev;
+	unsigned int root_cap, cap;
+
+	cap = pci_find_capability(dev, PCI_CAP_ID_PCIE);
+	if (!cap)
+		return;
+
+	root_cap = pci_find_capability(root, PCI_CAP_ID_PCIE);
+	if (!root_cap)
+		return;
+
+#if CONFIG_PCIEXP_COMMON_CLOCK
+	/* Check for and enable Common Clock, the rest follows retraining */
+	if (pciexp_enable_common_clock(root, root_cap, dev, cap))
+		return;
+#endif
+
+	pciexp_tune_link(root, root_cap, dev, cap);
+}
+
 void pciexp_scan_bus(struct bus *bus, unsigned int min_devfn,
 			     unsigned int max_devfn)
 {
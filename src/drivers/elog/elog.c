@@ -47,19 +47,28 @@
  * Static variables for ELOG state
  */
 static struct elog_area *elog_area;
-static u16 total_size;
-static u16 log_size; /* excluding header */
+static u32 total_size;
+static u32 log_size; /* excluding header */
 static u32 flash_base;
-static u16 full_threshold; /* from end of header */
-static u16 shrink_size; /* from end of header */
+static u32 full_threshold; /* from end of header */
+static u32 shrink_size; /* from end of header */
 
 static elog_area_state area_state;
 static elog_header_state header_state;
 static elog_event_buffer_state event_buffer_state;
 
-static u16 next_event_offset; /* from end of header */
+static u32 next_event_offset; /* from end of header, or of tail segment */
 static u16 event_count;
 
+/* State of a segmented log, see CONFIG_ELOG_SEGMENTED */
+static u32 segment_size;
+static u8 segment_count;
+static u32 segment_valid; /* bitmap of segments with a valid header */
+static u32 segment_loaded; /* bitmap of segments read into elog_area */
+static u32 segment_sequence[ELOG_MAX_SEGMENTS];
+static u8 tail_segment; /* segment with the highest sequence number */
+static u8 tail_open; /* events can be appended to the tail segment */
+
 static struct spi_flash *elog_spi;
 
 static enum {
@@ -237,6 +246,46 @@ static void elog_flash_write(void *address, u32 size)
 	elog_spi->write(elog_spi, offset, size, address);
 }
 
+/*
+ * Make the flash match 'size' bytes of the backing store at 'address'. Only
+ * the sectors that changed are erased, and only the changed bytes are
+ * programmed. The area has to cover whole flash sectors.
+ */
+static void elog_flash_update(void *address, u32 size)
+{
+	u32 offset;
+
+	if (!address || !size || !elog_spi)
+		return;
+
+	offset = flash_base;
+	offset += (u8 *)address - (u8 *)elog_area;
+
+	elog_debug("elog_flash_update(address=0x%p offset=0x%08x size=%u)\n",
+		   address, offset, size);
+
+	spi_flash_update(elog_spi, offset, size, address, NULL);
+}
+
+/*
+ * Read 'size' bytes from flash into the backing store at 'address'.
+ */
+static void elog_flash_read(void *address, u32 size)
+{
+	u32 offset;
+
+	if (!address || !size || !elog_spi)
+		return;
+
+	offset = flash_base;
+	offset += (u8 *)address - (u8 *)elog_area;
+
+	elog_debug("elog_flash_read(address=0x%p offset=0x%08x size=%u)\n",
+		   address, offset, size);
+
+	elog_spi->read(elog_spi, offset, size, address);
+}
+
 /*
  * Erase the first block specified in the address.
  * Only handles flash area within a single flash block.
@@ -362,8 +411,8 @@ static int elog_shrink(void)
 {
 	struct event_header *event;
 	u16 discard_count = 0;
-	u16 offset = 0;
-	u16 new_size = 0;
+	u32 offset = 0;
+	u32 new_size = 0;
 
 	elog_debug("elog_shrink()\n");
 
@@ -389,8 +438,7 @@ static int elog_shrink(void)
 	memmove(&elog_area->data[0], &elog_area->data[offset], new_size);
 	memset(&elog_area->data[new_size], ELOG_TYPE_EOL, log_size - new_size);
 
-	elog_flash_erase(elog_area, total_size);
-	elog_flash_write(elog_area, total_size);
+	elog_flash_update(elog_area, total_size);
 	elog_scan_flash();
 
 	/* Ensure the area was successfully erased */
@@ -405,9 +453,229 @@ static int elog_shrink(void)
 	return 0;
 }
 
+/*
+ * Pointer to the start of a segment of a segmented log
+ */
+static inline struct elog_segment_header *elog_segment(u8 index)
+{
+	return (struct elog_segment_header *)
+		((u8 *)elog_area + index * segment_size);
+}
+
+static int elog_is_segment_header_valid(struct elog_segment_header *seg)
+{
+	return seg->header.magic == ELOG_SIGNATURE &&
+		seg->header.version == ELOG_SEGMENT_VERSION &&
+		seg->header.header_size == sizeof(*seg) &&
+		seg->sequence == (u32)~seg->sequence_inv;
+}
+
+/*
+ * Read the events of a segment into the backing store if needed, and walk
+ * them. Returns the offset following the last valid event. If the rest of
+ * the segment isn't erased, a write was interrupted and nothing more can be
+ * appended to it, which is reported through 'clean'.
+ */
+static u32 elog_segment_load(u8 index, int *clean, u16 *count)
+{
+	u8 *base = (u8 *)elog_segment(index);
+	u32 offset = sizeof(struct elog_segment_header);
+	struct event_header *event;
+
+	if (!(segment_loaded & (1u << index))) {
+		elog_flash_read(base + offset, segment_size - offset);
+		segment_loaded |= 1u << index;
+	}
+
+	*count = 0;
+	while (offset + sizeof(*event) < segment_size) {
+		event = (struct event_header *)&base[offset];
+
+		if (event->type == ELOG_TYPE_EOL)
+			break;
+		if (event->length < sizeof(*event) + 1 ||
+		    event->length > segment_size - offset ||
+		    elog_checksum_event(event) != 0)
+			break;
+
+		offset += event->length;
+		(*count)++;
+	}
+
+	*clean = elog_is_buffer_clear(&base[offset], segment_size - offset);
+
+	return offset;
+}
+
+/*
+ * Read the segment headers and the events in the newest segment.
+ */
+static int elog_segment_scan(void)
+{
+	struct elog_segment_header *seg;
+	int clean;
+	u8 i;
+
+	elog_debug("elog_segment_scan()\n");
+
+	segment_size = elog_spi->sector_size;
+	segment_count = MIN(total_size / elog_spi->sector_size,
+			    ELOG_MAX_SEGMENTS);
+	if (segment_count < 2) {
+		printk(BIOS_ERR, "ELOG: Area must hold at least two %u byte "
+		       "segments\n", elog_spi->sector_size);
+		return -1;
+	}
+
+	memset(elog_area, ELOG_TYPE_EOL, total_size);
+	segment_valid = 0;
+	segment_loaded = 0;
+	tail_segment = segment_count - 1;
+	tail_open = 0;
+	next_event_offset = 0;
+	event_count = 0;
+
+	for (i = 0; i < segment_count; i++) {
+		seg = elog_segment(i);
+		elog_flash_read(seg, sizeof(*seg));
+		if (!elog_is_segment_header_valid(seg))
+			continue;
+
+		segment_sequence[i] = seg->sequence;
+		if (!(segment_valid & (1u << tail_segment)) ||
+		    seg->sequence > segment_sequence[tail_segment])
+			tail_segment = i;
+		segment_valid |= 1u << i;
+	}
+
+	if (!segment_valid)
+		return 0;
+
+	next_event_offset = elog_segment_load(tail_segment, &clean,
+					      &event_count);
+	tail_open = clean;
+	if (!clean)
+		printk(BIOS_WARNING, "ELOG: Segment %u is damaged, starting "
+		       "a new one\n", tail_segment);
+
+	return 0;
+}
+
+/*
+ * Erase the segment after the tail, which holds the oldest events, and make
+ * it the new tail. Returns the number of bytes dropped from the log, or -1
+ * on failure.
+ */
+static int elog_segment_open_next(void)
+{
+	u8 next = (tail_segment + 1) % segment_count;
+	struct elog_segment_header *seg = elog_segment(next);
+	u32 sequence = 0;
+	int dropped = 0;
+	int clean;
+	u16 count;
+
+	elog_debug("elog_segment_open_next(%u)\n", next);
+
+	if (segment_valid & (1u << tail_segment))
+		sequence = segment_sequence[tail_segment] + 1;
+	if (segment_valid & (1u << next))
+		dropped = segment_size;
+
+	segment_valid &= ~(1u << next);
+	elog_flash_erase(seg, segment_size);
+
+	memset(seg, ELOG_TYPE_EOL, segment_size);
+	seg->header.magic = ELOG_SIGNATURE;
+	seg->header.version = ELOG_SEGMENT_VERSION;
+	seg->header.header_size = sizeof(*seg);
+	seg->sequence = sequence;
+	seg->sequence_inv = ~sequence;
+	elog_flash_write(seg, sizeof(*seg));
+
+	/* Ensure the segment was successfully erased and written */
+	segment_loaded &= ~(1u << next);
+	elog_flash_read(seg, sizeof(*seg));
+	if (!elog_is_segment_header_valid(seg) ||
+	    elog_segment_load(next, &clean, &count) != sizeof(*seg) ||
+	    !clean) {
+		printk(BIOS_ERR, "ELOG: Flash segment %u was not erased!\n",
+		       next);
+		tail_open = 0;
+		return -1;
+	}
+
+	segment_valid |= 1u << next;
+	segment_sequence[next] = sequence;
+	tail_segment = next;
+	tail_open = 1;
+	next_event_offset = sizeof(*seg);
+	event_count = 0;
+
+	return dropped;
+}
+
 #ifndef __SMM__
 #if IS_ENABLED(CONFIG_ARCH_X86)
 
+#if CONFIG_ELOG_CBMEM
+/*
+ * Assemble the events of the newest segments, oldest first, into a regular
+ * event log at 'dest' of 'dest_size' bytes. Older segments that don't fit
+ * are left out.
+ */
+static void elog_segment_export(void *dest, u32 dest_size)
+{
+	struct elog_area *area = dest;
+	u32 events[ELOG_MAX_SEGMENTS];
+	u32 space = dest_size - sizeof(struct elog_header);
+	u8 *seg;
+	u32 size = 0;
+	u16 count;
+	int clean;
+	u8 i, index, newest;
+
+	area->header.magic = ELOG_SIGNATURE;
+	area->header.version = ELOG_VERSION;
+	area->header.header_size = sizeof(struct elog_header);
+	area->header.reserved[0] = ELOG_TYPE_EOL;
+	area->header.reserved[1] = ELOG_TYPE_EOL;
+
+	/* Segments preceding the tail are older, in round-robin order. Keep
+	 * at least one byte for the end of log marker. */
+	for (newest = 0; newest < segment_count; newest++) {
+		index = (tail_segment + segment_count - newest) %
+			segment_count;
+		events[index] = 0;
+		if (!(segment_valid & (1u << index)))
+			continue;
+
+		if (index == tail_segment)
+			events[index] = next_event_offset;
+		else
+			events[index] = elog_segment_load(index, &clean,
+							  &count);
+		events[index] -= sizeof(struct elog_segment_header);
+
+		if (size + events[index] >= space)
+			break;
+		size += events[index];
+	}
+
+	size = 0;
+	for (i = newest; i > 0; i--) {
+		index = (tail_segment + segment_count - (i - 1)) %
+			segment_count;
+		seg = (u8 *)elog_segment(index);
+		memcpy(&area->data[size],
+		       &seg[sizeof(struct elog_segment_header)], events[index]);
+		size += events[index];
+	}
+
+	memset(&area->data[size], ELOG_TYPE_EOL, space - size);
+}
+#endif
+
 /*
  * Convert a flash offset into a memory mapped flash address
  */
@@ -431,20 +699,25 @@ int elog_smbios_write_type15(unsigned long *current, int handle)
 {
 	struct smbios_type15 *t = (struct smbios_type15 *)*current;
 	int len = sizeof(struct smbios_type15);
+	/* The segmented log is only exported as far as SMBIOS can describe */
+	u32 area_size = MIN(total_size, ELOG_MAX_AREA_SIZE);
 
 #if CONFIG_ELOG_CBMEM
 	/* Save event log buffer into CBMEM for the OS to read */
-	void *cbmem = cbmem_add(CBMEM_ID_ELOG, total_size);
+	void *cbmem = cbmem_add(CBMEM_ID_ELOG, area_size);
 	if (!cbmem)
 		return 0;
-	memcpy(cbmem, elog_area, total_size);
+	if (IS_ENABLED(CONFIG_ELOG_SEGMENTED))
+		elog_segment_export(cbmem, area_size);
+	else
+		memcpy(cbmem, elog_area, area_size);
 #endif
 
 	memset(t, 0, len);
 	t->type = SMBIOS_EVENT_LOG;
 	t->length = len - 2;
 	t->handle = handle;
-	t->area_length = total_size - 1;
+	t->area_length = area_size - 1;
 	t->header_offset = 0;
 	t->data_offset = sizeof(struct elog_header);
 	t->access_method = SMBIOS_EVENTLOG_ACCESS_METHOD_MMIO32;
@@ -465,6 +738,15 @@ int elog_smbios_write_type15(unsigned long *current, int handle)
 #endif
 #endif
 
+/*
+ * Log how many bytes were dropped. The event holds a 16-bit count, which a
+ * segmented log can exceed.
+ */
+static void elog_add_log_clear(u32 size)
+{
+	elog_add_event_word(ELOG_TYPE_LOG_CLEAR, MIN(size, 0xffff));
+}
+
 /*
  * Clear the entire event log
  */
@@ -476,15 +758,22 @@ int elog_clear(void)
 	if (elog_init() < 0)
 		return -1;
 
-	/* Erase flash area */
-	elog_flash_erase(elog_area, total_size);
-	elog_prepare_empty();
+	if (IS_ENABLED(CONFIG_ELOG_SEGMENTED)) {
+		/* Erase all segments, the next event opens the first one */
+		elog_flash_erase(elog_area, segment_count * segment_size);
+		if (elog_segment_scan() < 0 || segment_valid)
+			return -1;
+	} else {
+		/* Erase flash area */
+		elog_flash_erase(elog_area, total_size);
+		elog_prepare_empty();
 
-	if (!elog_is_area_valid())
-		return -1;
+		if (!elog_is_area_valid())
+			return -1;
+	}
 
 	/* Log the clear event */
-	elog_add_event_word(ELOG_TYPE_LOG_CLEAR, total_size);
+	elog_add_log_clear(total_size);
 
 	return 0;
 }
@@ -509,6 +798,9 @@ static void elog_find_flash(void)
 		flash_base = CONFIG_ELOG_FLASH_BASE;
 		total_size = CONFIG_ELOG_AREA_SIZE;
 	}
+	/* Only the segmented format is read piecewise and exported in part */
+	if (!IS_ENABLED(CONFIG_ELOG_SEGMENTED))
+		total_size = MIN(total_size, ELOG_MAX_AREA_SIZE);
 	log_size = total_size - sizeof(struct elog_header);
 	full_threshold = log_size - ELOG_MIN_AVAILABLE_ENTRIES * MAX_EVENT_SIZE;
 	shrink_size = MIN(total_size * ELOG_SHRINK_PERCENTAGE / 100,
@@ -559,43 +851,64 @@ int elog_init(void)
 		return -1;
 	}
 
-	/* Load the log from flash */
-	elog_scan_flash();
-
-	/* Prepare the flash if necessary */
-	if (header_state == ELOG_HEADER_INVALID ||
-		event_buffer_state == ELOG_EVENT_BUFFER_CORRUPTED) {
-		/* If the header is invalid or the events are corrupted,
-		 * no events can be salvaged so erase the entire area. */
-		printk(BIOS_ERR, "ELOG: flash area invalid\n");
-		elog_flash_erase(elog_area, total_size);
-		elog_prepare_empty();
-	}
+	if (IS_ENABLED(CONFIG_ELOG_SEGMENTED)) {
+		/* Only the segment headers and the newest segment are read */
+		if (elog_segment_scan() < 0)
+			return -1;
 
-	if (area_state == ELOG_AREA_EMPTY)
-		elog_prepare_empty();
+		printk(BIOS_INFO, "ELOG: FLASH @0x%p [SPI 0x%08x]\n",
+		       elog_area, flash_base);
 
-	if (!elog_is_area_valid()) {
-		printk(BIOS_ERR, "ELOG: Unable to prepare flash\n");
-		return -1;
-	}
+		printk(BIOS_INFO, "ELOG: area is %d segments of %u bytes,"
+		       " newest is %d\n", segment_count, segment_size,
+		       tail_segment);
 
-	printk(BIOS_INFO, "ELOG: FLASH @0x%p [SPI 0x%08x]\n",
-	       elog_area, flash_base);
+		elog_initialized = ELOG_INITIALIZED;
 
-	printk(BIOS_INFO, "ELOG: area is %d bytes, full threshold %d,"
-	       " shrink size %d\n", total_size, full_threshold, shrink_size);
+		/* Log a clear event if necessary */
+		if (!segment_valid)
+			elog_add_log_clear(total_size);
+	} else {
+		/* Load the log from flash */
+		elog_scan_flash();
+
+		/* Prepare the flash if necessary */
+		if (header_state == ELOG_HEADER_INVALID ||
+			event_buffer_state == ELOG_EVENT_BUFFER_CORRUPTED) {
+			/* If the header is invalid or the events are
+			 * corrupted, no events can be salvaged so erase
+			 * the entire area. */
+			printk(BIOS_ERR, "ELOG: flash area invalid\n");
+			elog_flash_erase(elog_area, total_size);
+			elog_prepare_empty();
+		}
 
-	elog_initialized = ELOG_INITIALIZED;
+		if (area_state == ELOG_AREA_EMPTY)
+			elog_prepare_empty();
 
-	/* Shrink the log if we are getting too full */
-	if (next_event_offset >= full_threshold)
-		if (elog_shrink() < 0)
+		if (!elog_is_area_valid()) {
+			printk(BIOS_ERR, "ELOG: Unable to prepare flash\n");
 			return -1;
+		}
 
-	/* Log a clear event if necessary */
-	if (event_count == 0)
-		elog_add_event_word(ELOG_TYPE_LOG_CLEAR, total_size);
+		printk(BIOS_INFO, "ELOG: FLASH @0x%p [SPI 0x%08x]\n",
+		       elog_area, flash_base);
+
+		printk(BIOS_INFO, "ELOG: area is %u bytes, full threshold %u,"
+		       " shrink size %u\n", total_size, full_threshold,
+		       shrink_size);
+
+		elog_initialized = ELOG_INITIALIZED;
+
+		/* Shrink the log if we are getting too full */
+		if (next_event_offset >= full_threshold)
+			if (elog_shrink() < 0)
+				return -1;
+
+		/* Log a clear event if necessary */
+		if (event_count == 0)
+			elog_add_log_clear(total_size);
+	}
 
 #if !defined(__SMM__)
 	/* Log boot count event except in S3 resume */
@@ -658,6 +971,7 @@ void elog_add_event_raw(u8 event_type, void *data, u8 data_size)
 {
 	struct event_header *event;
 	u8 event_size;
+	int dropped = 0;
 
 	elog_debug("elog_add_event_raw(type=%X)\n", event_type);
 
@@ -673,15 +987,27 @@ void elog_add_event_raw(u8 event_type, void *data, u8 data_size)
 		return;
 	}
 
-	/* Make sure event data can fit */
-	if ((next_event_offset + event_size) >= log_size) {
-		printk(BIOS_ERR, "ELOG: Event(%X) does not fit\n",
-		       event_type);
-		return;
+	if (IS_ENABLED(CONFIG_ELOG_SEGMENTED)) {
+		/* Move on to the next segment if the tail is full */
+		if (!tail_open ||
+		    next_event_offset + event_size > segment_size) {
+			dropped = elog_segment_open_next();
+			if (dropped < 0)
+				return;
+		}
+		event = (struct event_header *)
+			((u8 *)elog_segment(tail_segment) + next_event_offset);
+	} else {
+		/* Make sure event data can fit */
+		if ((next_event_offset + event_size) >= log_size) {
+			printk(BIOS_ERR, "ELOG: Event(%X) does not fit\n",
+			       event_type);
+			return;
+		}
+		event = elog_get_event_base(next_event_offset);
 	}
 
 	/* Fill out event data */
-	event = elog_get_event_base(next_event_offset);
 	event->type = event_type;
 	event->length = event_size;
 	elog_fill_timestamp(event);
@@ -703,6 +1029,13 @@ void elog_add_event_raw(u8 event_type, void *data, u8 data_size)
 	printk(BIOS_INFO, "ELOG: Event(%X) added with size %d\n",
 	       event_type, event_size);
 
+	if (IS_ENABLED(CONFIG_ELOG_SEGMENTED)) {
+		/* Record the events dropped with the oldest segment */
+		if (dropped)
+			elog_add_log_clear(dropped);
+		return;
+	}
+
 	/* Shrink the log if we are getting too full */
 	if (next_event_offset >= full_threshold)
 		elog_shrink();
@@ -24,9 +24,23 @@ struct elog_header {
 	u8 reserved[2];
 } __attribute__ ((packed));
 
+/*
+ * Header at the start of each segment of a segmented ELOG. The sequence
+ * number is stored twice, the second time inverted, so that a header torn by
+ * an interrupted erase or write never looks valid.
+ */
+struct elog_segment_header {
+	struct elog_header header;
+	u32 sequence;
+	u32 sequence_inv;
+} __attribute__ ((packed));
+
 /* ELOG related constants */
 #define ELOG_SIGNATURE			0x474f4c45  /* 'ELOG' */
 #define ELOG_VERSION			1
+#define ELOG_SEGMENT_VERSION		2
+#define ELOG_MAX_SEGMENTS		32
+#define ELOG_MAX_AREA_SIZE		0x10000 /* SMBIOS area_length is 16 bits */
 #define ELOG_MIN_AVAILABLE_ENTRIES	2  /* Shrink when this many can't fit */
 #define ELOG_SHRINK_PERCENTAGE		25 /* Percent of total area to remove */
 
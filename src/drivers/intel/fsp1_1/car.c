@@ -14,6 +14,7 @@
  */
 
 #include <arch/early_variables.h>
+#include <cbfs.h>
 #include <console/console.h>
 #include <ec/google/chromeec/ec.h>
 #include <fsp/car.h>
@@ -83,7 +84,7 @@ asmlinkage void *romstage_after_verstage(void)
 
 	console_init();
 
-	if (prog_locate(&fsp)) {
+	if (prog_locate(&fsp) || cbfs_prog_map_verified(&fsp)) {
 		fih = NULL;
 		printk(BIOS_ERR, "Unable to locate %s\n", prog_name(&fsp));
 	} else
@@ -167,7 +167,7 @@ static void fsp_cache_save(struct prog *fsp)
 
 static int fsp_find_and_relocate(struct prog *fsp)
 {
-	if (prog_locate(fsp)) {
+	if (prog_locate(fsp) || cbfs_prog_map_verified(fsp)) {
 		printk(BIOS_ERR, "ERROR: Couldn't find %s\n", prog_name(fsp));
 		return -1;
 	}
@@ -11,6 +11,7 @@
 #include <cbfs.h>
 #include <cpu/x86/smm.h>
 #include <delay.h>
+#include <endian.h>
 #include <stdlib.h>
 #include <string.h>
 #include <spi-generic.h>
@@ -141,11 +142,61 @@ static int spi_flash_cmd_read_array(struct spi_slave *spi, u8 *cmd,
 	return len != 0;
 }
 
+/*
+ * Read using the multi-I/O mode negotiated in spi_flash_probe(). The opcode
+ * goes out on one line, address and dummy bytes on mode->addr_lines lines and
+ * data comes back on mode->data_lines lines.
+ */
+static int spi_flash_cmd_read_multi_io(struct spi_flash *flash, u32 offset,
+				       size_t len, void *data)
+{
+	const struct spi_flash_read_mode *mode = &flash->read_mode;
+	struct spi_slave *spi = flash->spi;
+	u8 cmd[4 + SPI_FLASH_MAX_DUMMY_BYTES];
+	const size_t cmd_len = 4 + mode->dummy_bytes;
+	size_t transfer_size;
+	int ret;
+
+	memset(cmd, 0, sizeof(cmd));
+	cmd[0] = mode->opcode;
+
+	while (len) {
+		if (spi->max_transfer_size)
+			transfer_size = min(len, spi->max_transfer_size);
+		else
+			transfer_size = len;
+
+		spi_flash_addr(offset, cmd);
+
+		if (spi_claim_bus(spi))
+			return -1;
+		ret = spi->xfer_multi_io(spi, cmd, cmd_len, mode->addr_lines,
+					 data, transfer_size,
+					 mode->data_lines);
+		spi_release_bus(spi);
+		if (ret < 0) {
+			printk(BIOS_WARNING, "SF: Failed to read %zu bytes in "
+			       "%d-%d-%d mode\n", transfer_size,
+			       1, mode->addr_lines, mode->data_lines);
+			return -1;
+		}
+
+		offset += transfer_size;
+		data = (void *)((uintptr_t)data + transfer_size);
+		len -= transfer_size;
+	}
+
+	return 0;
+}
+
 int spi_flash_cmd_read_fast(struct spi_flash *flash, u32 offset,
 		size_t len, void *data)
 {
 	u8 cmd[5];
 
+	if (flash->read_mode.data_lines > 1)
+		return spi_flash_cmd_read_multi_io(flash, offset, len, data);
+
 	cmd[0] = CMD_READ_ARRAY_FAST;
 	cmd[4] = 0x00;
 
@@ -194,27 +245,48 @@ int spi_flash_cmd_wait_ready(struct spi_flash *flash, unsigned long timeout)
 		CMD_READ_STATUS, STATUS_WIP);
 }
 
+/*
+ * Pick the largest erase operation that starts at offset and doesn't go past
+ * end. Since erase sizes are powers of two, doing this repeatedly covers a
+ * range with the fewest operations.
+ */
+static const struct spi_flash_erase_type *
+spi_flash_erase_type_for(const struct spi_flash *flash, u32 offset, u32 end)
+{
+	int i;
+
+	for (i = flash->num_erase_types - 1; i >= 0; i--) {
+		const struct spi_flash_erase_type *type = &flash->erase_types[i];
+		if (offset % type->size == 0 && end - offset >= type->size)
+			return type;
+	}
+
+	return NULL;
+}
+
 int spi_flash_cmd_erase(struct spi_flash *flash, u32 offset, size_t len)
 {
-	u32 start, end, erase_size;
+	const struct spi_flash_erase_type *type;
+	u32 start, end;
 	int ret;
 	u8 cmd[4];
 
-	erase_size = flash->sector_size;
-	if (offset % erase_size || len % erase_size) {
+	if (!flash->num_erase_types || offset % flash->erase_types[0].size ||
+	    len % flash->erase_types[0].size) {
 		printk(BIOS_WARNING, "SF: Erase offset/length not multiple of erase size\n");
 		return -1;
 	}
 
 	flash->spi->rw = SPI_WRITE_FLAG;
 
-	cmd[0] = flash->erase_cmd;
 	start = offset;
 	end = start + len;
 
 	while (offset < end) {
+		type = spi_flash_erase_type_for(flash, offset, end);
+		cmd[0] = type->opcode;
 		spi_flash_addr(offset, cmd);
-		offset += erase_size;
+		offset += type->size;
 
 #if CONFIG_DEBUG_SPI_FLASH
 		printk(BIOS_SPEW, "SF: erase %2x %2x %2x %2x (%x)\n", cmd[0], cmd[1],
@@ -228,7 +300,7 @@ int spi_flash_cmd_erase(struct spi_flash *flash, u32 offset, size_t len)
 		if (ret)
 			goto out;
 
-		ret = spi_flash_cmd_wait_ready(flash, SPI_FLASH_PAGE_ERASE_TIMEOUT);
+		ret = spi_flash_cmd_wait_ready(flash, type->timeout);
 		if (ret)
 			goto out;
 	}
@@ -244,6 +316,272 @@ int spi_flash_cmd_status(struct spi_flash *flash, u8 *reg)
 	return spi_flash_cmd(flash->spi, flash->status_cmd, reg, sizeof(*reg));
 }
 
+#if IS_ENABLED(CONFIG_SPI_FLASH_SFDP)
+#define SFDP_SIGNATURE		0x50444653	/* "SFDP" */
+#define SFDP_BFPT_ID		0xff00		/* JEDEC Basic Flash Parameters */
+/* DWORDs 1 to 16 of the BFPT, as defined by JESD216A/B */
+#define SFDP_BFPT_DWORDS	16
+
+struct sfdp_header {
+	u32 signature;
+	u8 minor;
+	u8 major;
+	u8 nph;		/* number of parameter headers - 1 */
+	u8 unused;
+} __attribute__((packed));
+
+struct sfdp_param_header {
+	u8 id_lsb;
+	u8 minor;
+	u8 major;
+	u8 length;	/* in DWORDs */
+	u8 pointer[3];
+	u8 id_msb;
+} __attribute__((packed));
+
+/* The Basic Flash Parameter Table, indexed by DWORD number - 1 */
+struct sfdp_bfpt {
+	u32 dw[SFDP_BFPT_DWORDS];
+	int length;
+};
+
+static int spi_flash_read_sfdp(struct spi_flash *flash, u32 offset,
+			       void *buf, size_t len)
+{
+	u8 cmd[5];
+
+	cmd[0] = CMD_READ_SFDP;
+	spi_flash_addr(offset, cmd);
+	cmd[4] = 0x00;	/* dummy */
+
+	return spi_flash_cmd_read(flash->spi, cmd, sizeof(cmd), buf, len);
+}
+
+/* Returns 0 if the flash has a valid BFPT, which is then read into bfpt. */
+static int spi_flash_read_bfpt(struct spi_flash *flash, struct sfdp_bfpt *bfpt)
+{
+	struct sfdp_header header;
+	struct sfdp_param_header param;
+	u32 ptp;
+	int i;
+
+	if (spi_flash_read_sfdp(flash, 0, &header, sizeof(header)) ||
+	    le32_to_cpu(header.signature) != SFDP_SIGNATURE)
+		return -1;
+
+	/* The first parameter header always describes the BFPT. */
+	if (spi_flash_read_sfdp(flash, sizeof(header), &param, sizeof(param)))
+		return -1;
+	if ((param.id_msb << 8 | param.id_lsb) != SFDP_BFPT_ID ||
+	    param.length < 9)
+		return -1;
+
+	memset(bfpt, 0, sizeof(*bfpt));
+	bfpt->length = min(param.length, SFDP_BFPT_DWORDS);
+	ptp = param.pointer[0] | param.pointer[1] << 8 | param.pointer[2] << 16;
+	if (spi_flash_read_sfdp(flash, ptp, bfpt->dw,
+				bfpt->length * sizeof(u32)))
+		return -1;
+
+	for (i = 0; i < bfpt->length; i++)
+		bfpt->dw[i] = le32_to_cpu(bfpt->dw[i]);
+
+	return 0;
+}
+
+/* Typical erase time from BFPT DWORD 10 in ms, given count and units */
+static u32 sfdp_erase_time(u32 count, u32 units)
+{
+	static const u32 unit_ms[] = { 1, 16, 128, 1000 };
+
+	return (count + 1) * unit_ms[units];
+}
+
+/* Read the erase types from the BFPT. Returns the number found. */
+static int sfdp_erase_types(const struct sfdp_bfpt *bfpt,
+			    struct spi_flash_erase_type *types)
+{
+	u32 mult, count, units, timeout;
+	int i, n = 0;
+
+	/* Erase times were added in JESD216A, fall back to generic ones. */
+	mult = bfpt->dw[9] & 0xf;
+
+	for (i = 0; i < 4; i++) {
+		u32 dw = bfpt->dw[7 + i / 2] >> (16 * (i % 2));
+		u8 size_shift = dw & 0xff;
+		u8 opcode = (dw >> 8) & 0xff;
+
+		if (!size_shift || size_shift >= 32)
+			continue;
+
+		if (bfpt->length >= 10) {
+			count = (bfpt->dw[9] >> (4 + 7 * i)) & 0x1f;
+			units = (bfpt->dw[9] >> (9 + 7 * i)) & 0x3;
+			timeout = 2 * (mult + 1) * sfdp_erase_time(count, units);
+		} else if ((1 << size_shift) <= 4 * KiB) {
+			timeout = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+		} else {
+			timeout = SPI_FLASH_SECTOR_ERASE_TIMEOUT;
+		}
+
+		types[n].size = 1 << size_shift;
+		types[n].opcode = opcode;
+		types[n].timeout = timeout;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * Quad modes only work once the Quad Enable bit is set. Setting it means
+ * rewriting the status registers which is too risky to do here, so only
+ * check whether it's set already, as BFPT DWORD 15 describes.
+ */
+static int sfdp_quad_enabled(struct spi_flash *flash,
+			     const struct sfdp_bfpt *bfpt)
+{
+	u8 status;
+
+	if (bfpt->length < 15)
+		return 0;
+
+	switch ((bfpt->dw[14] >> 20) & 0x7) {
+	case 0:		/* no QE bit, quad modes always work */
+		return 1;
+	case 1:
+	case 4:		/* bit 1 of status register 2, which can't be read */
+		return 0;
+	case 5:		/* bit 1 of status register 2 */
+		if (spi_flash_cmd(flash->spi, CMD_READ_STATUS2, &status, 1))
+			return 0;
+		return !!(status & (1 << 1));
+	case 2:		/* bit 6 of status register 1 */
+		if (spi_flash_cmd(flash->spi, CMD_READ_STATUS, &status, 1))
+			return 0;
+		return !!(status & (1 << 6));
+	case 3:		/* bit 7 of status register 2, read with 0x3f */
+		if (spi_flash_cmd(flash->spi, CMD_READ_STATUS2_ALT, &status, 1))
+			return 0;
+		return !!(status & (1 << 7));
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Fill in a read mode from a BFPT fast read descriptor: wait states in bits
+ * 4:0, mode clocks in bits 7:5 and the opcode in bits 15:8. Returns 0 if the
+ * mode and dummy clocks fill whole bytes, as sent on the address lines.
+ */
+static int sfdp_read_mode(struct spi_flash_read_mode *mode, u16 desc,
+			  u8 addr_lines, u8 data_lines)
+{
+	const u8 clocks = (desc & 0x1f) + ((desc >> 5) & 0x7);
+
+	if ((clocks * addr_lines) % 8)
+		return -1;
+
+	mode->opcode = desc >> 8;
+	mode->addr_lines = addr_lines;
+	mode->data_lines = data_lines;
+	mode->dummy_bytes = clocks * addr_lines / 8;
+	return 0;
+}
+
+/*
+ * Pick the fastest read mode both the flash and the controller support.
+ * Returns 0 if one was found.
+ */
+static int sfdp_pick_read_mode(struct spi_flash *flash,
+			       const struct sfdp_bfpt *bfpt,
+			       struct spi_flash_read_mode *mode)
+{
+	const unsigned int modes = flash->spi->read_modes;
+	int quad;
+
+	if (!modes || !flash->spi->xfer_multi_io)
+		return -1;
+
+	quad = (modes & (SPI_READ_MODE_1_4_4 | SPI_READ_MODE_1_1_4)) &&
+		(bfpt->dw[0] & (SFDP_READ_1_4_4 | SFDP_READ_1_1_4)) &&
+		sfdp_quad_enabled(flash, bfpt);
+
+	if (quad && (modes & SPI_READ_MODE_1_4_4) &&
+	    (bfpt->dw[0] & SFDP_READ_1_4_4) &&
+	    !sfdp_read_mode(mode, bfpt->dw[2], 4, 4))
+		return 0;
+	if (quad && (modes & SPI_READ_MODE_1_1_4) &&
+	    (bfpt->dw[0] & SFDP_READ_1_1_4) &&
+	    !sfdp_read_mode(mode, bfpt->dw[2] >> 16, 1, 4))
+		return 0;
+	if ((modes & SPI_READ_MODE_1_1_2) && (bfpt->dw[0] & SFDP_READ_1_1_2) &&
+	    !sfdp_read_mode(mode, bfpt->dw[3], 1, 2))
+		return 0;
+
+	return -1;
+}
+#endif
+
+/*
+ * Set up the erase operations and the read mode of a detected flash part,
+ * from SFDP if possible.
+ */
+static void spi_flash_init_params(struct spi_flash *flash)
+{
+	struct spi_flash_erase_type *types = flash->erase_types;
+	struct spi_flash_erase_type tmp;
+	int i, j, n = 0;
+
+	memset(&flash->read_mode, 0, sizeof(flash->read_mode));
+
+#if IS_ENABLED(CONFIG_SPI_FLASH_SFDP)
+	struct sfdp_bfpt bfpt;
+
+	if (flash->erase == spi_flash_cmd_erase &&
+	    !spi_flash_read_bfpt(flash, &bfpt)) {
+		n = sfdp_erase_types(&bfpt, types);
+		if (flash->read == spi_flash_cmd_read_fast &&
+		    !sfdp_pick_read_mode(flash, &bfpt, &flash->read_mode))
+			printk(BIOS_INFO, "SF: Using %d-%d-%d read, opcode "
+			       "%02x\n", 1, flash->read_mode.addr_lines,
+			       flash->read_mode.data_lines,
+			       flash->read_mode.opcode);
+	}
+#endif
+
+	/* Sort by size, smallest first. */
+	for (i = 1; i < n; i++)
+		for (j = i; j > 0 && types[j].size < types[j - 1].size; j--) {
+			tmp = types[j];
+			types[j] = types[j - 1];
+			types[j - 1] = tmp;
+		}
+
+	/*
+	 * The sector size is what callers align their erases to, so only
+	 * trust SFDP if its smallest erase size fits into a sector.
+	 */
+	if (n && (types[0].size > flash->sector_size ||
+		  flash->sector_size % types[0].size))
+		n = 0;
+
+	if (!n) {
+		types[0].size = flash->sector_size;
+		types[0].opcode = flash->erase_cmd;
+		types[0].timeout = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+		n = 1;
+	}
+
+	flash->num_erase_types = n;
+
+	for (i = 0; i < n; i++)
+		printk(BIOS_DEBUG, "SF: Erase type %d: %u KiB, opcode %02x, "
+		       "timeout %u ms\n", i, types[i].size / KiB,
+		       types[i].opcode, types[i].timeout);
+}
+
 /*
  * The following table holds all device probe functions
  *
@@ -372,6 +710,8 @@ flash_detected:
 	printk(BIOS_INFO, "SF: Detected %s with sector size 0x%x, total 0x%x\n",
 			flash->name, flash->sector_size, flash->size);
 
+	spi_flash_init_params(flash);
+
 	spi_flash_dev = flash;
 
 	return flash;
@@ -381,6 +721,169 @@ err_read_id:
 	return NULL;
 }
 
+/*
+ * Granularity at which spi_flash_update() compares and programs data. Chunks
+ * are aligned to it, so they never cross a (256 byte or larger) page.
+ */
+#define SPI_FLASH_UPDATE_CHUNK	256
+
+enum {
+	UPDATE_SKIP,		/* contents already match */
+	UPDATE_PROGRAM,		/* only bits need clearing */
+	UPDATE_ERASE,		/* some bits need setting */
+};
+
+/*
+ * Compare the flash contents of [offset, offset + len) with buf. Returns the
+ * UPDATE_* action they need, or -1 if reading fails.
+ */
+static int spi_flash_update_action(struct spi_flash *flash, u32 offset,
+				   size_t len, const u8 *buf)
+{
+	u8 cur[SPI_FLASH_UPDATE_CHUNK];
+	int action = UPDATE_SKIP;
+	size_t chunk, i;
+
+	while (len) {
+		chunk = min(len, sizeof(cur) - offset % sizeof(cur));
+		if (flash->read(flash, offset, chunk, cur))
+			return -1;
+
+		for (i = 0; i < chunk; i++) {
+			if (cur[i] == buf[i])
+				continue;
+			if ((cur[i] & buf[i]) != buf[i])
+				return UPDATE_ERASE;
+			action = UPDATE_PROGRAM;
+		}
+
+		offset += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return action;
+}
+
+/*
+ * Program the chunks of [offset, offset + len) that differ from buf. If the
+ * range was just erased, it is known to read as 0xff and isn't read back.
+ */
+static int spi_flash_update_program(struct spi_flash *flash, u32 offset,
+				    size_t len, const u8 *buf, int erased,
+				    struct spi_flash_update_stats *stats)
+{
+	u8 cur[SPI_FLASH_UPDATE_CHUNK];
+	size_t chunk, first, last;
+
+	while (len) {
+		chunk = min(len, sizeof(cur) - offset % sizeof(cur));
+		if (erased)
+			memset(cur, 0xff, chunk);
+		else if (flash->read(flash, offset, chunk, cur))
+			return -1;
+
+		/* Only program the bytes from the first to the last change. */
+		for (first = 0; first < chunk && cur[first] == buf[first];
+		     first++)
+			;
+		if (first < chunk) {
+			for (last = chunk; cur[last - 1] == buf[last - 1];
+			     last--)
+				;
+			if (flash->write(flash, offset + first, last - first,
+					 buf + first))
+				return -1;
+			stats->programmed += last - first;
+		}
+
+		offset += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+/* Erase whole sectors in [offset, offset + len) and program them with buf. */
+static int spi_flash_update_erase(struct spi_flash *flash, u32 offset,
+				  size_t len, const u8 *buf,
+				  struct spi_flash_update_stats *stats)
+{
+	if (!len)
+		return 0;
+
+	if (flash->erase(flash, offset, len))
+		return -1;
+	stats->erased += len;
+
+	return spi_flash_update_program(flash, offset, len, buf, 1, stats);
+}
+
+int spi_flash_update(struct spi_flash *flash, u32 offset, size_t len,
+		     const void *buf, struct spi_flash_update_stats *stats)
+{
+	struct spi_flash_update_stats local_stats;
+	const u8 *data = buf;
+	const u32 start = offset, end = offset + len;
+	u32 next, erase_start = offset, erase_end = offset;
+	int action;
+
+	if (!stats)
+		stats = &local_stats;
+	memset(stats, 0, sizeof(*stats));
+
+	/*
+	 * Classify one sector at a time, but erase runs of adjacent sectors
+	 * with a single call so that larger erase types can be used.
+	 */
+	while (offset < end) {
+		next = min(offset - offset % flash->sector_size +
+			   flash->sector_size, end);
+
+		action = spi_flash_update_action(flash, offset, next - offset,
+						 data + (offset - start));
+		if (action < 0)
+			return -1;
+
+		if (action == UPDATE_ERASE) {
+			if (offset % flash->sector_size ||
+			    next % flash->sector_size) {
+				printk(BIOS_WARNING, "SF: Update of partial "
+				       "sector @ %#x needs an erase\n", offset);
+				return -1;
+			}
+			if (erase_end != offset) {
+				if (spi_flash_update_erase(flash, erase_start,
+					erase_end - erase_start,
+					data + (erase_start - start), stats))
+					return -1;
+				erase_start = offset;
+			}
+			erase_end = next;
+		} else if (action == UPDATE_PROGRAM) {
+			if (spi_flash_update_program(flash, offset,
+					next - offset, data + (offset - start),
+					0, stats))
+				return -1;
+		} else {
+			stats->skipped += next - offset;
+		}
+
+		offset = next;
+	}
+
+	if (spi_flash_update_erase(flash, erase_start, erase_end - erase_start,
+				   data + (erase_start - start), stats))
+		return -1;
+
+	printk(BIOS_DEBUG, "SF: Updated %zu bytes @ %#x: %zu erased, "
+	       "%zu programmed, %zu unchanged\n", len, start, stats->erased,
+	       stats->programmed, stats->skipped);
+
+	return 0;
+}
+
 /* Only the RAM stage will build in the lb_new_record symbol
  * so only define this function if we are after that stage */
 #ifdef __RAMSTAGE__
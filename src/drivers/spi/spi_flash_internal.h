@@ -24,10 +24,19 @@
 #define CMD_READ_ARRAY_LEGACY		0xe8
 
 #define CMD_READ_STATUS			0x05
+#define CMD_READ_STATUS2		0x35
+#define CMD_READ_STATUS2_ALT		0x3f
 #define CMD_WRITE_ENABLE		0x06
 
 #define CMD_BLOCK_ERASE			0xD8
 
+#define CMD_READ_SFDP			0x5a
+
+/* Fast read modes in BFPT DWORD 1 */
+#define SFDP_READ_1_1_2			(1 << 16)
+#define SFDP_READ_1_4_4			(1 << 21)
+#define SFDP_READ_1_1_4			(1 << 22)
+
 /* Common status */
 #define STATUS_WIP			0x01
 
@@ -57,7 +66,10 @@ int spi_flash_cmd_poll_bit(struct spi_flash *flash, unsigned long timeout,
  */
 int spi_flash_cmd_wait_ready(struct spi_flash *flash, unsigned long timeout);
 
-/* Erase sectors. */
+/*
+ * Erase a range using the fewest operations from flash->erase_types. offset
+ * and len must be aligned to the smallest erase size.
+ */
 int spi_flash_cmd_erase(struct spi_flash *flash, u32 offset, size_t len);
 
 /* Read status register. */
@@ -28,12 +28,36 @@ void *cbfs_boot_map_optionrom(uint16_t vendor, uint16_t device);
 /* Load stage by name into memory. Returns entry address on success. NULL on
  * failure. */
 void *cbfs_boot_load_stage_by_name(const char *name);
-/* Locate file by name and optional type. Return 0 on success. < 0 on error. */
+/* Locate file by name and optional type. Return 0 on success. < 0 on error.
+ * The caller would access the file without any check, so a file that needs
+ * verification is refused. Use the loaders below to read its contents. */
 int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type);
+/* Locate the file named after prog with optional type and chain its data into
+ * prog. A file that needs verification is not hashed here: the loaders check
+ * the bytes they actually use, see cbfs_prog_stage_load(), cbfs_stage_load(),
+ * selfload() and cbfs_prog_map_verified(). Return 0 on success. < 0 on
+ * error. */
+int cbfs_boot_locate_prog(struct prog *prog, uint32_t *type);
 /* Map file into memory leaking the mapping. Only should be used when
  * leaking mappings are a no-op. Returns NULL on error, else returns
- * the mapping and sets the size of the file. */
+ * the mapping and sets the size of the file. A file that needs
+ * verification is checked through the returned mapping. */
 void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size);
+/* Locate file by name and optional type and map all of it. rdev is set to the
+ * file's data for rdev_munmap(). A file that needs verification is checked
+ * through the returned mapping. Returns NULL on error. */
+void *cbfs_boot_map(struct region_device *rdev, const char *name,
+			uint32_t *type);
+/* Locate file by name and optional type and read all of it to the
+ * |buf_size| bytes large |buf|. A file that needs verification is checked
+ * in buf. Returns the file size, or 0 on error. */
+size_t cbfs_boot_load_file(const char *name, void *buf, size_t buf_size,
+				uint32_t *type);
+/* Make a program located by cbfs_boot_locate_prog() safe to read directly:
+ * when its contents need verification, map all of them, check the mapping
+ * and point prog at it. The mapping is leaked. Return 0 on success. < 0 on
+ * error. */
+int cbfs_prog_map_verified(struct prog *prog);
 
 /* Load |in_size| bytes from |rdev| at |offset| to the |buffer_size| bytes
  * large |buffer|, decompressing it according to |compression| in the process.
@@ -43,9 +67,39 @@ void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size);
 size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression);
 
+/* Load the data following the already read |stage| header of the stage file
+ * in prog to |buffer|, which is stage->memlen bytes large, checking the
+ * header and the data as read when the file needs verification. Returns the
+ * decompressed size, or 0 on error. */
+size_t cbfs_stage_load(const struct prog *prog, const struct cbfs_stage *stage,
+			void *buffer);
+
 /* Load stage into memory filling in prog. Return 0 on success. < 0 on error. */
 int cbfs_prog_stage_load(struct prog *prog);
 
+/* Hash of a file's contents, built up while they are read. */
+struct cbfs_verify {
+	struct vb2_digest_context ctx;
+	uint8_t expected[VB2_SHA512_DIGEST_SIZE];
+	int digest_sz;
+};
+
+/* Return 1 if the contents of the program located by cbfs_boot_locate_prog()
+ * need to match the hash in its metadata before they are used. */
+int cbfs_prog_needs_verify(const struct prog *prog);
+
+/* For loaders that read a file in pieces: start with the hash attribute found
+ * in the file's |metadata|, extend with the file's bytes in order and finish
+ * with the last ones, which fails if the hash doesn't match. The bytes that
+ * are used have to be hashed where they are used, cbfs_verify_rdev() reads
+ * the ones in between from |rdev|. All return 0 on success. < 0 on error. */
+int cbfs_verify_start(struct cbfs_verify *v,
+			const struct region_device *metadata);
+int cbfs_verify_extend(struct cbfs_verify *v, const void *buf, size_t size);
+int cbfs_verify_rdev(struct cbfs_verify *v, const struct region_device *rdev,
+			size_t offset, size_t size);
+int cbfs_verify_finish(struct cbfs_verify *v, const void *buf, size_t size);
+
 /*****************************************************************
  * Support structures and functions. Direct field access should  *
  * only be done by implementers of cbfs regions -- Not the above *
@@ -58,6 +112,8 @@ struct cbfs_props {
 	size_t offset;
 	/* CBFS size. */
 	size_t size;
+	/* Files need to match their hash attribute before being used. */
+	int verify_files;
 };
 
 /* Return < 0 on error otherwise props are filled out accordingly. */
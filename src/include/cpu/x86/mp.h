@@ -113,6 +113,18 @@ void mp_initialize_cpu(void *unused);
 /* Returns apic id for coreboot cpu number or < 0 on failure. */
 int mp_get_apic_id(int cpu_slot);
 
+/*
+ * With PARALLEL_MP_AP_WORK the APs wait for work after mp_init() instead of
+ * halting. mp_run_on_aps() hands func(arg) to every waiting AP and returns
+ * the number of APs that picked it up within expire_us microseconds, or < 0
+ * if there are no APs waiting. It does not wait for func() to finish, the
+ * caller has to provide its own completion tracking.
+ */
+int mp_run_on_aps(void (*func)(void *), void *arg, long expire_us);
+
+/* Halt all waiting APs. No further work can be handed to them. */
+int mp_park_aps(void);
+
 /*
  * SMM helpers to use with initializing CPUs.
  */
@@ -121,5 +133,10 @@ int mp_get_apic_id(int cpu_slot);
 void smm_initiate_relocation_parallel(void);
 /* Send SMI to self with single execution. */
 void smm_initiate_relocation(void);
+/*
+ * Wait up to timeout_us for every CPU started by mp_init() to complete its
+ * relocation SMI. Returns 0 when they all did, < 0 otherwise.
+ */
+int smm_wait_for_relocation(int timeout_us);
 
 #endif /* _X86_MP_H_ */
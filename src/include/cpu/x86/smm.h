@@ -493,6 +493,10 @@ u16 smm_get_pmbase(void);
 struct smm_runtime {
 	u32 smbase;
 	u32 save_state_size;
+	/* The save states of this many CPUs are staggered down from the top
+	 * of a SMM_DEFAULT_SIZE window above smbase, the next CPUs use the
+	 * next window up. 0 means all CPUs share the first window. */
+	u32 cpus_per_window;
 	/* The apic_id_to_cpu provides a mapping from APIC id to cpu number.
 	 * The cpu number is indicated by the index into the array by matching
 	 * the default APIC id and value at the index. The stub loader
@@ -502,6 +506,20 @@ struct smm_runtime {
 	u8 apic_id_to_cpu[CONFIG_MAX_CPUS];
 } __attribute__ ((packed));
 
+/* SMBASE of a CPU in the layout described by the runtime. */
+static inline u32 smm_runtime_smbase(const struct smm_runtime *runtime,
+				     int cpu)
+{
+	u32 smbase = runtime->smbase;
+
+	if (runtime->cpus_per_window) {
+		smbase += (cpu / runtime->cpus_per_window) * SMM_DEFAULT_SIZE;
+		cpu %= runtime->cpus_per_window;
+	}
+
+	return smbase - cpu * runtime->save_state_size;
+}
+
 struct smm_module_params {
 	void *arg;
 	int cpu;
@@ -559,6 +577,10 @@ struct smm_loader_params {
 /* Both of these return 0 on success, < 0 on failure. */
 int smm_setup_relocation_handler(struct smm_loader_params *params);
 int smm_load_module(void *smram, int size, struct smm_loader_params *params);
+
+/* SMBASE the relocation handler has to program for cpu to enter the module
+ * loaded by smm_load_module(). */
+u32 smm_get_cpu_smbase(int cpu);
 #endif /* __SMM__ */
 #endif /* CONFIG_SMM_TSEG */
 
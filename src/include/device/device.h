@@ -123,6 +123,7 @@ struct device {
 	unsigned int    enabled : 1;	/* set if we should enable the device */
 	unsigned int    initialized : 1; /* set if we have initialized the device */
 	unsigned int    on_mainboard : 1;
+	unsigned int    defer_init : 1; /* init() runs after all others */
 	struct pci_irq_info pci_irq_info[4];
 	u8 command;
 
@@ -169,6 +170,9 @@ void dev_enumerate(void);
 void dev_configure(void);
 void dev_enable(void);
 void dev_initialize(void);
+void dev_initialize_deferred(void);
+/* Returns 1 if the deferred devices are left to the OS on this boot. */
+int dev_skip_deferred_init(void);
 void dev_optimize(void);
 void dev_finalize(void);
 void dev_finalize_chips(void);
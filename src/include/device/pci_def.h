@@ -402,6 +402,8 @@ static inline int pci_base_address_is_memory_space(unsigned int attr)
 #define  PCI_EXP_RTCTL_CRSSVE	0x10	/* CRS Software Visibility Enable */
 #define PCI_EXP_RTCAP		30	/* Root Capabilities */
 #define PCI_EXP_RTSTA		32	/* Root Status */
+#define PCI_EXP_DEVCTL2		40	/* Device Control 2 */
+#define  PCI_EXP_DEVCTL2_ARI	0x20	/* Alternative Routing-ID Forwarding */
 
 /* Extended Capabilities (PCI-X 2.0 and Express) */
 #define PCI_EXT_CAP_ID(header)		(header & 0x0000ffff)
@@ -418,6 +420,11 @@ static inline int pci_base_address_is_memory_space(unsigned int attr)
 #define  PCIE_EXT_CAP_AER_ID	0x0001
 #define  PCIE_EXT_CAP_L1SS_ID	0x001E
 #define  PCIE_EXT_CAP_LTR_ID	0x0018
+#define  PCIE_EXT_CAP_ARI_ID	0x000E
+
+/* Alternative Routing-ID Interpretation */
+#define PCI_ARI_CAP		4	/* ARI Capability */
+#define  PCI_ARI_CAP_NFN(x)	(((x) >> 8) & 0xff) /* Next Function Number */
 
 /* Advanced Error Reporting */
 #define PCI_ERR_UNCOR_STATUS	4	/* Uncorrectable Error Status */
@@ -0,0 +1,52 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef DEVICE_PCI_SCAN_CACHE_H
+#define DEVICE_PCI_SCAN_CACHE_H
+
+#include <stdint.h>
+
+/*
+ * The devices found by probing, i.e. those without an entry in the device
+ * tree, are kept in the RW_PCI_CACHE FMAP region. On the next boot only
+ * these are probed on a bus the cache covers, after their IDs have been
+ * checked against the hardware.
+ */
+struct pci_scan_cache_entry {
+	uint8_t bus;
+	uint8_t devfn;
+	uint16_t reserved;
+	uint32_t id;		/* vendor and device ID */
+} __attribute__((packed));
+
+#if IS_ENABLED(CONFIG_PCI_SCAN_CACHE)
+/*
+ * Returns the number of devices found on the bus on the previous boot,
+ * in devfn order, or -1 if the bus is not known.
+ */
+int pci_scan_cache_lookup(unsigned int bus,
+			  const struct pci_scan_cache_entry **entries);
+void pci_scan_cache_record(unsigned int bus, unsigned int devfn, uint32_t id);
+#else
+static inline int pci_scan_cache_lookup(unsigned int bus,
+			const struct pci_scan_cache_entry **entries)
+{
+	return -1;
+}
+static inline void pci_scan_cache_record(unsigned int bus,
+					 unsigned int devfn, uint32_t id) {}
+#endif
+
+#endif /* DEVICE_PCI_SCAN_CACHE_H */
@@ -17,4 +17,11 @@ void pciexp_scan_bridge(device_t dev);
 extern struct device_operations default_pciexp_ops_bus;
 
 unsigned int pciexp_find_extended_cap(device_t dev, unsigned int cap);
+
+#if IS_ENABLED(CONFIG_PCIEXP_COMMON_CLOCK)
+/* Wait for the retraining links of the ports on bus, NULL for all. */
+void pciexp_wait_links(struct bus *bus);
+#else
+static inline void pciexp_wait_links(struct bus *bus) {}
+#endif
 #endif /* DEVICE_PCIEXP_H */
@@ -47,6 +47,23 @@ struct edid_mode {
 	unsigned int y_mm;
 };
 
+/* Compact mode table entry. decode_edid() collects every timing it finds
+ * (detailed, established, standard and CEA short video descriptors) in a
+ * single pass and sorts the table so that the preferred timing comes first,
+ * then native timings, then everything else from largest to smallest.
+ */
+#define EDID_TIMING_PREFERRED	(1 << 0)
+#define EDID_TIMING_NATIVE	(1 << 1)
+#define EDID_TIMING_DETAILED	(1 << 2)
+#define EDID_MAX_TIMINGS	32
+
+struct edid_timing {
+	u16 ha;
+	u16 va;
+	u8 refresh;
+	u8 flags;
+};
+
 /* structure for communicating EDID information from a raw EDID block to
  * higher level functions.
  * The size of the data types is not critical, so we leave them as
@@ -89,6 +106,10 @@ struct edid {
 	u32 bytes_per_line;
 
 	int hdmi_monitor_detected;
+
+	/* Sorted table of supported timings, see struct edid_timing. */
+	struct edid_timing modes[EDID_MAX_TIMINGS];
+	unsigned int num_modes;
 };
 
 /* Defined in src/lib/edid.c */
@@ -23,6 +23,10 @@
 /* Defined in src/lib/lzma.c. Returns decompressed size or 0 on error. */
 size_t ulzma(const void *src, void *dst);
 size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn);
+/* Like ulzman(), but reentrant: the caller provides the decoder state. */
+#define ULZMA_SCRATCH_SIZE 15980
+size_t ulzman_scratch(const void *src, size_t srcn, void *dst, size_t dstn,
+		      void *scratch);
 
 /* Defined in src/lib/ramtest.c */
 void ram_check(unsigned long start, unsigned long stop);
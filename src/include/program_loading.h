@@ -41,6 +41,11 @@ enum prog_type {
  * set on the last segment loaded. */
 void arch_segment_loaded(uintptr_t start, size_t size, int flags);
 
+/* Start func(arg) on CPUs that are idle while the program is being loaded.
+ * Returns the number of CPUs that picked up the call, 0 if there are none.
+ * The caller has to track their completion itself. */
+int arch_run_on_idle_cpus(void (*func)(void *), void *arg);
+
 /* Representation of a program. */
 struct prog {
 	/* The region_device is the source of program content to load. After
@@ -50,6 +55,10 @@ struct prog {
 	enum prog_type type;
 	const char *name;
 	struct region_device rdev;
+	/* Metadata of the CBFS file rdev points into while its contents still
+	 * have to be checked against the file's hash attribute. The loaders
+	 * check what they read, see cbfs_boot_locate_prog(). Empty otherwise. */
+	struct region_device metadata;
 	/* Entry to program with optional argument. It's up to the architecture
 	 * to decide if argument is passed. */
 	void (*entry)(void *);
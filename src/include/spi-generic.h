@@ -27,6 +27,11 @@
 #define SPI_READ_FLAG	0x01
 #define SPI_WRITE_FLAG	0x02
 
+/* Multi-I/O read modes, as command-address-data line counts */
+#define SPI_READ_MODE_1_1_2	(1 << 0)
+#define SPI_READ_MODE_1_1_4	(1 << 1)
+#define SPI_READ_MODE_1_4_4	(1 << 2)
+
 /*-----------------------------------------------------------------------
  * Representation of a SPI slave, i.e. what we're communicating with.
  *
@@ -39,6 +44,11 @@
  *              read or write transaction, usually this is a controller
  *              property, kept in the slave structure for convenience. Zero in
  *              this field means 'unlimited'.
+ *   read_modes: SPI_READ_MODE_* flags for the multi-I/O read modes the
+ *              controller supports through xfer_multi_io.
+ *   xfer_multi_io: Like spi_xfer(), but sends the first byte of dout on one
+ *              line, the rest of dout on addr_lines lines and receives din on
+ *              data_lines lines. Only needs to be set with read_modes.
  */
 struct spi_slave {
 	unsigned int	bus;
@@ -47,6 +57,11 @@ struct spi_slave {
 	unsigned int	max_transfer_size;
 	int force_programmer_specific;
 	struct spi_flash * (*programmer_specific_probe) (struct spi_slave *spi);
+	unsigned int	read_modes;
+	int (*xfer_multi_io)(struct spi_slave *slave, const void *dout,
+			     unsigned int bytesout, unsigned int addr_lines,
+			     void *din, unsigned int bytesin,
+			     unsigned int data_lines);
 };
 
 /*-----------------------------------------------------------------------
@@ -21,6 +21,28 @@
 #include <spi-generic.h>
 #include <boot/coreboot_tables.h>
 
+/* An erase operation supported by a flash part */
+struct spi_flash_erase_type {
+	u32		size;
+	u8		opcode;
+	/* Maximum time the operation may take, in milliseconds */
+	u32		timeout;
+};
+
+#define SPI_FLASH_MAX_ERASE_TYPES	4
+
+/* Up to 7 mode and 31 wait clocks on 4 lines per BFPT read descriptor */
+#define SPI_FLASH_MAX_DUMMY_BYTES	19
+
+/* A multi-I/O fast read mode, zeroed when using the 1-1-1 fast read */
+struct spi_flash_read_mode {
+	u8		opcode;
+	u8		addr_lines;
+	u8		data_lines;
+	/* Mode and dummy bytes following the address */
+	u8		dummy_bytes;
+};
+
 struct spi_flash {
 	struct spi_slave *spi;
 
@@ -34,6 +56,20 @@ struct spi_flash {
 
 	u8		status_cmd;
 
+	/*
+	 * Erase operations available to spi_flash_cmd_erase(), sorted by
+	 * increasing size. Filled in by spi_flash_probe() from SFDP if
+	 * enabled and available, otherwise from erase_cmd and sector_size.
+	 */
+	struct spi_flash_erase_type erase_types[SPI_FLASH_MAX_ERASE_TYPES];
+	u8		num_erase_types;
+
+	/*
+	 * Read mode used by spi_flash_cmd_read_fast(), negotiated between the
+	 * flash (through SFDP) and the controller by spi_flash_probe().
+	 */
+	struct spi_flash_read_mode read_mode;
+
 	/* All callbacks return 0 on success and != 0 on error. */
 	int		(*read)(struct spi_flash *flash, u32 offset,
 				size_t len, void *buf);
@@ -46,6 +82,23 @@ struct spi_flash {
 
 struct spi_flash *spi_flash_probe(unsigned int bus, unsigned int cs);
 
+/* What a spi_flash_update() call had to do, in bytes */
+struct spi_flash_update_stats {
+	size_t		erased;
+	size_t		programmed;
+	size_t		skipped;	/* already up to date */
+};
+
+/*
+ * Make [offset, offset + len) of the flash contain buf, touching as little of
+ * it as possible: sectors that already match are skipped, sectors where bits
+ * only need clearing are programmed without an erase, and only the changed
+ * parts of each page are programmed. Sectors that need an erase must be fully
+ * covered by the range. stats may be NULL. Returns 0 on success.
+ */
+int spi_flash_update(struct spi_flash *flash, u32 offset, size_t len,
+		     const void *buf, struct spi_flash_update_stats *stats);
+
 void lb_spi_flash(struct lb_header *header);
 
 #endif /* _SPI_FLASH_H_ */
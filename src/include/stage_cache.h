@@ -36,6 +36,22 @@ void stage_cache_external_region(void **base, size_t *size);
 struct stage_cache {
 	uint64_t load_addr;
 	uint64_t entry_addr;
+	uint32_t size;		/* Size of the stage itself. */
+	uint32_t compression;	/* CBFS_COMPRESS_NONE or CBFS_COMPRESS_LZ4 */
+	uint32_t checksum;	/* Of the cached data as stored. */
+	uint32_t reserved;
 };
 
+/*
+ * Helpers shared by the stage cache implementations. stage_cache_prepare()
+ * fills in meta and returns the number of bytes stage_cache_store() needs
+ * to cache the stage. stage_cache_restore() checks the cached data and
+ * places the stage back at its load address. It returns 0 on success.
+ */
+size_t stage_cache_prepare(struct stage_cache *meta, const struct prog *stage);
+void stage_cache_store(struct stage_cache *meta, const struct prog *stage,
+			void *c, size_t size);
+int stage_cache_restore(const struct stage_cache *meta, const void *c,
+			size_t size);
+
 #endif /* _STAGE_CACHE_H_ */
@@ -33,7 +33,82 @@
 #define DEBUG(x...)
 #endif
 
-int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
+int cbfs_verify_start(struct cbfs_verify *v,
+			const struct region_device *metadata)
+{
+	/* The hash attribute is looked up in the metadata only. */
+	const struct cbfsf fh = { .metadata = *metadata };
+	enum vb2_hash_algorithm hash_alg;
+
+	v->digest_sz = cbfsf_file_hash(&fh, &hash_alg, v->expected,
+					sizeof(v->expected));
+	if (v->digest_sz < 0) {
+		ERROR("No hash attribute.\n");
+		return -1;
+	}
+
+	if (vb2_digest_init(&v->ctx, hash_alg))
+		return -1;
+
+	return 0;
+}
+
+int cbfs_verify_extend(struct cbfs_verify *v, const void *buf, size_t size)
+{
+	if (vb2_digest_extend(&v->ctx, buf, size))
+		return -1;
+
+	return 0;
+}
+
+int cbfs_verify_rdev(struct cbfs_verify *v, const struct region_device *rdev,
+			size_t offset, size_t size)
+{
+	uint8_t buf[256];
+	size_t chunk;
+
+	while (size) {
+		chunk = MIN(size, sizeof(buf));
+		if (rdev_readat(rdev, buf, offset, chunk) != chunk ||
+		    cbfs_verify_extend(v, buf, chunk))
+			return -1;
+		offset += chunk;
+		size -= chunk;
+	}
+
+	return 0;
+}
+
+int cbfs_verify_finish(struct cbfs_verify *v, const void *buf, size_t size)
+{
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+
+	if ((size && cbfs_verify_extend(v, buf, size)) ||
+	    vb2_digest_finalize(&v->ctx, digest, v->digest_sz))
+		return -1;
+
+	if (memcmp(digest, v->expected, v->digest_sz)) {
+		ERROR("Hash mismatch.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Check a file's contents held in memory against its hash attribute. */
+static int cbfs_verify_buffer(const struct region_device *metadata,
+				const void *buf, size_t size)
+{
+	struct cbfs_verify v;
+
+	if (cbfs_verify_start(&v, metadata))
+		return -1;
+
+	return cbfs_verify_finish(&v, buf, size);
+}
+
+static int cbfs_boot_locate_file(struct cbfsf *fh, const char *name,
+				uint32_t *type, int *verify)
 {
 	struct region_device rdev;
 	const struct region_device *boot_dev;
@@ -51,27 +126,130 @@ int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
 	if (rdev_chain(&rdev, boot_dev, props.offset, props.size))
 		return -1;
 
-	return cbfs_locate(fh, &rdev, name, type);
+	if (cbfs_locate(fh, &rdev, name, type))
+		return -1;
+
+	*verify = IS_ENABLED(CONFIG_VBOOT_CBFS_FILE_HASHES) &&
+		props.verify_files;
+
+	return 0;
 }
 
-void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size)
+int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
+{
+	int verify;
+
+	if (cbfs_boot_locate_file(fh, name, type, &verify))
+		return -1;
+
+	/* Whatever the caller reads from fh later would go unchecked. */
+	if (verify) {
+		ERROR("'%s' needs verification, use a verifying loader.\n",
+			name);
+		return -1;
+	}
+
+	return 0;
+}
+
+int cbfs_boot_locate_prog(struct prog *prog, uint32_t *type)
+{
+	struct cbfsf fh;
+	int verify;
+
+	if (cbfs_boot_locate_file(&fh, prog_name(prog), type, &verify))
+		return -1;
+
+	cbfs_file_data(prog_rdev(prog), &fh);
+
+	if (verify)
+		cbfs_file_metadata(&prog->metadata, &fh);
+	else
+		memset(&prog->metadata, 0, sizeof(prog->metadata));
+
+	return 0;
+}
+
+int cbfs_prog_needs_verify(const struct prog *prog)
+{
+	return IS_ENABLED(CONFIG_VBOOT_CBFS_FILE_HASHES) &&
+		region_device_sz(&prog->metadata) != 0;
+}
+
+void *cbfs_boot_map(struct region_device *rdev, const char *name,
+			uint32_t *type)
 {
 	struct cbfsf fh;
 	size_t fsize;
+	void *map;
+	int verify;
 
-	if (cbfs_boot_locate(&fh, name, &type))
+	if (cbfs_boot_locate_file(&fh, name, type, &verify))
 		return NULL;
 
-	fsize = region_device_sz(&fh.data);
+	cbfs_file_data(rdev, &fh);
+	fsize = region_device_sz(rdev);
+
+	map = rdev_mmap(rdev, 0, fsize);
 
-	if (size != NULL)
-		*size = fsize;
+	/* The mapping is what the caller uses, so that is what gets hashed. */
+	if (map != NULL && verify &&
+	    cbfs_verify_buffer(&fh.metadata, map, fsize)) {
+		ERROR("'%s' failed verification.\n", name);
+		rdev_munmap(rdev, map);
+		return NULL;
+	}
 
-	return rdev_mmap(&fh.data, 0, fsize);
+	return map;
 }
 
-size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
-	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression)
+void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size)
+{
+	struct region_device rdev;
+	void *map;
+
+	map = cbfs_boot_map(&rdev, name, &type);
+
+	if (map != NULL && size != NULL)
+		*size = region_device_sz(&rdev);
+
+	return map;
+}
+
+int cbfs_prog_map_verified(struct prog *prog)
+{
+	struct region_device *rdev = prog_rdev(prog);
+	size_t size = region_device_sz(rdev);
+	void *map;
+
+	if (!cbfs_prog_needs_verify(prog))
+		return 0;
+
+	map = rdev_mmap(rdev, 0, size);
+	if (map == NULL) {
+		ERROR("'%s' can't be mapped for verification.\n",
+			prog_name(prog));
+		return -1;
+	}
+
+	if (cbfs_verify_buffer(&prog->metadata, map, size)) {
+		ERROR("'%s' failed verification.\n", prog_name(prog));
+		rdev_munmap(rdev, map);
+		return -1;
+	}
+
+	/* Everything is read from the checked mapping from now on. */
+	prog_set_area(prog, map, size);
+	memset(&prog->metadata, 0, sizeof(prog->metadata));
+
+	return 0;
+}
+
+/* Like cbfs_load_and_decompress(), but when |verify| is given the input bytes
+ * finish its hash and have to match before they are decompressed. */
+static size_t cbfs_load(const struct region_device *rdev, size_t offset,
+	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression,
+	struct cbfs_verify *verify)
 {
 	size_t out_size;
 
@@ -79,6 +257,9 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 	case CBFS_COMPRESS_NONE:
 		if (rdev_readat(rdev, buffer, offset, in_size) != in_size)
 			return 0;
+		if (verify != NULL && cbfs_verify_finish(verify, buffer,
+							 in_size))
+			return 0;
 		return in_size;
 
 	case CBFS_COMPRESS_LZ4:
@@ -93,6 +274,9 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 		void *compr_start = buffer + buffer_size - in_size;
 		if (rdev_readat(rdev, compr_start, offset, in_size) != in_size)
 			return 0;
+		if (verify != NULL && cbfs_verify_finish(verify, compr_start,
+							 in_size))
+			return 0;
 
 		timestamp_add_now(TS_START_ULZ4F);
 		out_size = ulz4fn(compr_start, in_size, buffer, buffer_size);
@@ -109,6 +293,12 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 		if (map == NULL)
 			return 0;
 
+		if (verify != NULL && cbfs_verify_finish(verify, map,
+							 in_size)) {
+			rdev_munmap(rdev, map);
+			return 0;
+		}
+
 		/* Note: timestamp not useful for memory-mapped media (x86) */
 		timestamp_add_now(TS_START_ULZMA);
 		out_size = ulzman(map, in_size, buffer, buffer_size);
@@ -123,6 +313,65 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 	}
 }
 
+size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
+	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression)
+{
+	return cbfs_load(rdev, offset, in_size, buffer, buffer_size,
+			 compression, NULL);
+}
+
+size_t cbfs_boot_load_file(const char *name, void *buf, size_t buf_size,
+				uint32_t *type)
+{
+	struct cbfsf fh;
+	struct cbfs_verify v;
+	struct cbfs_verify *verify = NULL;
+	size_t fsize;
+	int needs_verify;
+
+	if (cbfs_boot_locate_file(&fh, name, type, &needs_verify))
+		return 0;
+
+	fsize = region_device_sz(&fh.data);
+	if (fsize > buf_size) {
+		ERROR("'%s' doesn't fit into %zu bytes.\n", name, buf_size);
+		return 0;
+	}
+
+	if (needs_verify) {
+		verify = &v;
+		if (cbfs_verify_start(verify, &fh.metadata))
+			return 0;
+	}
+
+	/* The bytes are checked in buf, where the caller uses them. */
+	if (cbfs_load(&fh.data, 0, fsize, buf, buf_size, CBFS_COMPRESS_NONE,
+		      verify) != fsize) {
+		ERROR("'%s' couldn't be loaded.\n", name);
+		return 0;
+	}
+
+	return fsize;
+}
+
+size_t cbfs_stage_load(const struct prog *prog, const struct cbfs_stage *stage,
+			void *buffer)
+{
+	struct cbfs_verify v;
+	struct cbfs_verify *verify = NULL;
+
+	if (cbfs_prog_needs_verify(prog)) {
+		verify = &v;
+		/* The hash covers the header the caller already read. */
+		if (cbfs_verify_start(verify, &prog->metadata) ||
+		    cbfs_verify_extend(verify, stage, sizeof(*stage)))
+			return 0;
+	}
+
+	return cbfs_load(&prog->rdev, sizeof(*stage), stage->len, buffer,
+			 stage->memlen, stage->compression, verify);
+}
+
 static inline int tohex4(unsigned int c)
 {
 	return (c <= 9) ? (c + '0') : (c - 10 + 'a');
@@ -148,16 +397,12 @@ void *cbfs_boot_map_optionrom(uint16_t vendor, uint16_t device)
 
 void *cbfs_boot_load_stage_by_name(const char *name)
 {
-	struct cbfsf fh;
 	struct prog stage = PROG_INIT(PROG_UNKNOWN, name);
 	uint32_t type = CBFS_TYPE_STAGE;
 
-	if (cbfs_boot_locate(&fh, name, &type))
+	if (cbfs_boot_locate_prog(&stage, &type))
 		return NULL;
 
-	/* Chain data portion in the prog. */
-	cbfs_file_data(prog_rdev(&stage), &fh);
-
 	if (cbfs_prog_stage_load(&stage))
 		return NULL;
 
@@ -191,15 +436,15 @@ int cbfs_prog_stage_load(struct prog *pstage)
 	/* Hacky way to not load programs over read only media. The stages
 	 * that would hit this path initialize themselves. */
 	if (ENV_VERSTAGE && IS_ENABLED(CONFIG_ARCH_X86) &&
-	    IS_ENABLED(CONFIG_SPI_FLASH_MEMORY_MAPPED)) {
+	    IS_ENABLED(CONFIG_SPI_FLASH_MEMORY_MAPPED) &&
+	    !cbfs_prog_needs_verify(pstage)) {
 		void *mapping = rdev_mmap(fh, foffset, fsize);
 		rdev_munmap(fh, mapping);
 		if (mapping == load)
 			goto out;
 	}
 
-	fsize = cbfs_load_and_decompress(fh, foffset, fsize, load,
-					 stage.memlen, stage.compression);
+	fsize = cbfs_stage_load(pstage, &stage, load);
 	if (!fsize)
 		return -1;
 
@@ -284,6 +529,8 @@ int cbfs_boot_region_properties(struct cbfs_props *props)
 		if (ops->locate == NULL)
 			continue;
 
+		props->verify_files = 0;
+
 		if (ops->locate(props))
 			continue;
 
@@ -20,6 +20,8 @@
  */
 
 #include <boot_device.h>
+#include <bootstate.h>
+#include <console/console.h>
 #include <spi_flash.h>
 #include <symbols.h>
 #include <cbmem.h>
@@ -43,6 +45,69 @@ static const struct region_device_ops spi_ops = {
 static struct mmap_helper_region_device mdev =
 	MMAP_HELPER_REGION_INIT(&spi_ops, 0, CONFIG_ROM_SIZE);
 
+#if IS_ENABLED(CONFIG_CBFS_SPI_READ_CACHE)
+/*
+ * The read cache is layered on top of mdev and takes the start of the CBFS
+ * cache region, leaving the rest for mmap() buffers.
+ */
+#define READ_CACHE_SIZE	(CONFIG_CBFS_SPI_READ_CACHE_LINES * \
+		(CONFIG_CBFS_SPI_READ_CACHE_BLOCK_SIZE + \
+		 sizeof(struct cache_region_line)))
+
+static struct cache_region_device cdev;
+static int cdev_ready;
+
+static void read_cache_init(u8 *cache, size_t cache_size)
+{
+	cdev_ready = 0;
+
+	if (cache_size <= READ_CACHE_SIZE ||
+	    cache_region_device_init(&cdev, &mdev.rdev, cache, READ_CACHE_SIZE,
+			CONFIG_CBFS_SPI_READ_CACHE_BLOCK_SIZE,
+			cache + READ_CACHE_SIZE, cache_size - READ_CACHE_SIZE)) {
+		printk(BIOS_WARNING, "SPI read cache doesn't fit in %zu bytes\n",
+		       cache_size);
+		mmap_helper_device_init(&mdev, cache, cache_size);
+		return;
+	}
+
+	cdev_ready = 1;
+}
+
+static struct mmap_helper_region_device *mmap_dev(void)
+{
+	return cdev_ready ? &cdev.mdev : &mdev;
+}
+
+static void read_cache_report(void)
+{
+	if (cdev_ready)
+		printk(BIOS_DEBUG, "SPI read cache: %zu hits, %zu misses\n",
+		       cdev.hits, cdev.misses);
+}
+#else
+static void read_cache_init(u8 *cache, size_t cache_size)
+{
+	mmap_helper_device_init(&mdev, cache, cache_size);
+}
+
+static struct mmap_helper_region_device *mmap_dev(void)
+{
+	return &mdev;
+}
+
+static void read_cache_report(void) {}
+#endif
+
+static void boot_device_report(void)
+{
+	struct mmap_helper_region_device *dev = mmap_dev();
+
+	printk(BIOS_DEBUG, "SPI mmap pool: peak usage %zu of %zu bytes\n",
+	       dev->peak_usage, dev->pool.size);
+	read_cache_report();
+}
+
 static void switch_to_postram_cache(int unused)
 {
 	/*
@@ -51,9 +116,9 @@ static void switch_to_postram_cache(int unused)
 	 * being overwritten if spi_flash was not accessed before dram was up.
 	 */
 	boot_device_init();
+	boot_device_report();
 	if (_preram_cbfs_cache != _postram_cbfs_cache)
-		mmap_helper_device_init(&mdev, _postram_cbfs_cache,
-					_postram_cbfs_cache_size);
+		read_cache_init(_postram_cbfs_cache, _postram_cbfs_cache_size);
 }
 ROMSTAGE_CBMEM_INIT_HOOK(switch_to_postram_cache);
 
@@ -67,7 +132,7 @@ void boot_device_init(void)
 
 	spi_flash_info = spi_flash_probe(bus, cs);
 
-	mmap_helper_device_init(&mdev, _cbfs_cache, _cbfs_cache_size);
+	read_cache_init(_cbfs_cache, _cbfs_cache_size);
 }
 
 /* Return the CBFS boot device. */
@@ -76,5 +141,18 @@ const struct region_device *boot_device_ro(void)
 	if (spi_flash_info == NULL)
 		return NULL;
 
+#if IS_ENABLED(CONFIG_CBFS_SPI_READ_CACHE)
+	if (cdev_ready)
+		return cache_region_device_rdev(&cdev);
+#endif
 	return &mdev.rdev;
 }
+
+#if ENV_RAMSTAGE
+static void boot_device_report_ramstage(void *unused)
+{
+	boot_device_report();
+}
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_LOAD, BS_ON_EXIT, boot_device_report_ramstage,
+		      NULL);
+#endif
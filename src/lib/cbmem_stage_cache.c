@@ -22,19 +22,22 @@
 void stage_cache_add(int stage_id, const struct prog *stage)
 {
 	struct stage_cache *meta;
+	struct stage_cache m;
+	size_t size;
 	void *c;
 
+	size = stage_cache_prepare(&m, stage);
+
 	meta = cbmem_add(CBMEM_ID_STAGEx_META + stage_id, sizeof(*meta));
 	if (meta == NULL)
 		return;
-	meta->load_addr = (uintptr_t)prog_start(stage);
-	meta->entry_addr = (uintptr_t)prog_entry(stage);
 
-	c = cbmem_add(CBMEM_ID_STAGEx_CACHE + stage_id, prog_size(stage));
+	c = cbmem_add(CBMEM_ID_STAGEx_CACHE + stage_id, size);
 	if (c == NULL)
 		return;
 
-	memcpy(c, prog_start(stage), prog_size(stage));
+	stage_cache_store(&m, stage, c, size);
+	*meta = m;
 }
 
 void stage_cache_load_stage(int stage_id, struct prog *stage)
@@ -60,8 +63,9 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	size = cbmem_entry_size(e);
 	load_addr = (void *)(uintptr_t)meta->load_addr;
 
-	memcpy(load_addr, c, size);
+	if (stage_cache_restore(meta, c, size))
+		return;
 
-	prog_set_area(stage, load_addr, size);
+	prog_set_area(stage, load_addr, meta->size);
 	prog_set_entry(stage, (void *)(uintptr_t)meta->entry_addr, NULL);
 }
@@ -35,6 +35,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <edid.h>
+#include <cbmem.h>
 #include <boot/coreboot_tables.h>
 #include <vbe.h>
 
@@ -96,6 +97,28 @@ static struct edid tmp_edid;
 static int vbe_valid;
 static struct lb_framebuffer edid_fb;
 
+/*
+ * Decoded EDID blocks are kept in CBMEM so that a second decode of the same
+ * block (another pipe driving the same panel, the resume path, ...) is a
+ * memcmp() instead of a full parse. The checksum byte is used as a cheap key,
+ * the raw block is compared before an entry is trusted.
+ */
+#define EDID_CACHE_ENTRIES	4
+#define EDID_CACHE_MAX_SIZE	256
+
+struct edid_cache_entry {
+	int size;	/* 0 means the entry is unused */
+	u8 checksum;
+	int result;
+	unsigned char raw[EDID_CACHE_MAX_SIZE];
+	struct edid out;
+};
+
+struct edid_cache {
+	unsigned int next;
+	struct edid_cache_entry entry[EDID_CACHE_ENTRIES];
+};
+
 static char *manufacturer_name(unsigned char *x)
 {
 	extra_info.manuf_name[0] = ((x[0] & 0x7C) >> 2) + '@';
@@ -197,19 +220,84 @@ extract_string(unsigned char *x, int *valid_termination, int len)
 	return ret;
 }
 
+/* Add a timing to the compact mode table, merging flags of duplicates. */
+static void
+add_timing(struct edid *out, unsigned int ha, unsigned int va,
+	   unsigned int refresh, u8 flags)
+{
+	struct edid_timing *t;
+	unsigned int i;
+
+	if (!ha || !va || !refresh || refresh > 0xff)
+		return;
+
+	for (i = 0; i < out->num_modes; i++) {
+		t = &out->modes[i];
+		if (t->ha == ha && t->va == va && t->refresh == refresh) {
+			t->flags |= flags;
+			return;
+		}
+	}
+
+	if (out->num_modes >= EDID_MAX_TIMINGS)
+		return;
+
+	t = &out->modes[out->num_modes++];
+	t->ha = ha;
+	t->va = va;
+	t->refresh = refresh;
+	t->flags = flags;
+}
+
+static int
+timing_rank(const struct edid_timing *t)
+{
+	return (t->flags & EDID_TIMING_PREFERRED ? 2 : 0) +
+	       (t->flags & EDID_TIMING_NATIVE ? 1 : 0);
+}
+
+/* Preferred first, then native, then by decreasing size and refresh. */
+static int
+timing_before(const struct edid_timing *a, const struct edid_timing *b)
+{
+	if (timing_rank(a) != timing_rank(b))
+		return timing_rank(a) > timing_rank(b);
+	if (a->ha * a->va != b->ha * b->va)
+		return a->ha * a->va > b->ha * b->va;
+	return a->refresh > b->refresh;
+}
+
+static void
+sort_timings(struct edid *out)
+{
+	unsigned int i, j;
+
+	/* At most EDID_MAX_TIMINGS entries, insertion sort is plenty. */
+	for (i = 1; i < out->num_modes; i++) {
+		struct edid_timing t = out->modes[i];
+
+		for (j = i; j > 0 && timing_before(&t, &out->modes[j - 1]); j--)
+			out->modes[j] = out->modes[j - 1];
+		out->modes[j] = t;
+	}
+}
+
 /* 1 means valid data */
 static int
 detailed_block(struct edid *result_edid, unsigned char *x, int in_extension,
 	       struct edid_context *c)
 {
 	struct edid *out = &tmp_edid;
+	unsigned int htotal, vtotal, refresh = 0;
+	u8 flags = EDID_TIMING_DETAILED;
 	int i;
-#if 1
-	printk(BIOS_SPEW, "Hex of detail: ");
-	for (i = 0; i < 18; i++)
-		printk(BIOS_SPEW, "%02x", x[i]);
-	printk(BIOS_SPEW, "\n");
-#endif
+
+	if (console_log_level(BIOS_SPEW)) {
+		printk(BIOS_SPEW, "Hex of detail: ");
+		for (i = 0; i < 18; i++)
+			printk(BIOS_SPEW, "%02x", x[i]);
+		printk(BIOS_SPEW, "\n");
+	}
 
 	/* Result might already have some valid fields like mode_is_supported */
 	*out = *result_edid;
@@ -478,6 +566,7 @@ detailed_block(struct edid *result_edid, unsigned char *x, int in_extension,
 	out->mode.vso = ((x[10] >> 4) + ((x[11] & 0x0C) << 2));
 	out->mode.vspw = ((x[10] & 0x0F) + ((x[11] & 0x03) << 4));
 	out->mode.vborder = x[16];
+
 	/* set up some reasonable defaults for payloads.
 	 * We observe that most modern chipsets we work with
 	 * tend to support rgb888 without regard to the
@@ -559,11 +648,21 @@ detailed_block(struct edid *result_edid, unsigned char *x, int in_extension,
 	       extra_info.syncmethod, x[17] & 0x80 ?" interlaced" : "",
 	       extra_info.stereo);
 
+	htotal = out->mode.ha + out->mode.hbl;
+	vtotal = out->mode.va + out->mode.vbl;
+	if (htotal && vtotal)
+		refresh = (out->mode.pixel_clock * 1000 + htotal * vtotal / 2) /
+			  (htotal * vtotal);
+	/* The preferred timing is also the panel's native format (1.4 3.10.2) */
+	if (!in_extension && !c->did_detailed_timing && c->has_preferred_timing)
+		flags |= EDID_TIMING_PREFERRED | EDID_TIMING_NATIVE;
+
 	if (! c->did_detailed_timing) {
 		printk(BIOS_SPEW, "Did detailed timing\n");
 		c->did_detailed_timing = 1;
 		*result_edid = *out;
 	}
+	add_timing(result_edid, out->mode.ha, out->mode.va, refresh, flags);
 
 	return 1;
 }
@@ -650,15 +749,41 @@ cea_audio_block(unsigned char *x)
 	}
 }
 
+/* Progressive CEA-861 VICs we may want to drive, indexed by VIC. */
+static const struct {
+	u16 x, y;
+	u8 refresh;
+} cea_vics[] = {
+	[1] = {640, 480, 60},
+	[2] = {720, 480, 60},
+	[3] = {720, 480, 60},
+	[4] = {1280, 720, 60},
+	[16] = {1920, 1080, 60},
+	[17] = {720, 576, 50},
+	[18] = {720, 576, 50},
+	[19] = {1280, 720, 50},
+	[31] = {1920, 1080, 50},
+	[32] = {1920, 1080, 24},
+	[33] = {1920, 1080, 25},
+	[34] = {1920, 1080, 30},
+};
+
 static void
-cea_video_block(unsigned char *x)
+cea_video_block(struct edid *out, unsigned char *x)
 {
 	int i;
 	int length = x[0] & 0x1f;
 
-	for (i = 1; i < length; i++)
-		printk(BIOS_SPEW,"    VIC %02d %s\n", x[i] & 0x7f,
+	for (i = 1; i <= length; i++) {
+		int vic = x[i] & 0x7f;
+
+		printk(BIOS_SPEW,"    VIC %02d %s\n", vic,
 		       x[i] & 0x80 ? "(native)" : "");
+		if (vic < ARRAY_SIZE(cea_vics))
+			add_timing(out, cea_vics[vic].x, cea_vics[vic].y,
+				   cea_vics[vic].refresh,
+				   x[i] & 0x80 ? EDID_TIMING_NATIVE : 0);
+	}
 }
 
 static void
@@ -793,13 +918,17 @@ cea_block(struct edid *out, unsigned char *x)
 		break;
 	case 0x02:
 		printk(BIOS_SPEW, "  Video data block\n");
-		cea_video_block(x);
+		cea_video_block(out, x);
 		break;
 	case 0x03:
+		if ((x[0] & 0x1f) < 3) {
+			printk(BIOS_SPEW, "  Vendor-specific data block without OUI\n");
+			break;
+		}
 		/* yes really, endianness lols */
 		oui = (x[3] << 16) + (x[2] << 8) + x[1];
 		printk(BIOS_SPEW, "  Vendor-specific data block, OUI %06x", oui);
-		if (oui == 0x000c03)
+		if (oui == 0x000c03 && (x[0] & 0x1f) >= 5)
 			cea_hdmi_block(out, x);
 		else
 			printk(BIOS_SPEW, "\n");
@@ -876,6 +1005,12 @@ parse_cea(struct edid *out, unsigned char *x, struct edid_context *c)
 			if (offset < 4)
 				break;
 
+			/* Data blocks and DTDs have to fit before the checksum */
+			if (offset > 127) {
+				ret = 1;
+				break;
+			}
+
 			if (version < 3) {
 				printk(BIOS_SPEW, "%d 8-byte timing descriptors\n", (offset - 4) / 8);
 				if (offset - 4 > 0)
@@ -884,6 +1019,10 @@ parse_cea(struct edid *out, unsigned char *x, struct edid_context *c)
 				int i;
 				printk(BIOS_SPEW, "%d bytes of CEA data\n", offset - 4);
 				for (i = 4; i < offset; i += (x[i] & 0x1f) + 1) {
+					if (i + (x[i] & 0x1f) >= offset) {
+						ret = 1;
+						break;
+					}
 					cea_block(out, x + i);
 				}
 			}
@@ -1048,6 +1187,42 @@ int set_display_mode(struct edid *edid, enum edid_modes mode)
 	return -1;
 }
 
+static struct edid_cache *get_edid_cache(void)
+{
+	struct edid_cache *cache;
+
+	if (!IS_ENABLED(CONFIG_EDID_CACHE))
+		return NULL;
+
+	cache = cbmem_find(CBMEM_ID_EDID);
+	if (cache)
+		return cache;
+
+	cache = cbmem_add(CBMEM_ID_EDID, sizeof(*cache));
+	if (cache)
+		memset(cache, 0, sizeof(*cache));
+	return cache;
+}
+
+static struct edid_cache_entry *
+find_cached_edid(struct edid_cache *cache, unsigned char *edid, int size)
+{
+	int i;
+
+	for (i = 0; i < EDID_CACHE_ENTRIES; i++) {
+		struct edid_cache_entry *e = &cache->entry[i];
+
+		if (e->size == size && e->checksum == edid[0x7f] &&
+		    !memcmp(e->raw, edid, size))
+			return e;
+	}
+
+	return NULL;
+}
+
+static int decode_edid_uncached(unsigned char *edid, int size,
+				struct edid *out);
+
 /*
  * Given a raw edid bloc, decode it into a form
  * that other parts of coreboot can use -- mainly
@@ -1057,6 +1232,43 @@ int set_display_mode(struct edid *edid, enum edid_modes mode)
  * We accept what we are given.
  */
 int decode_edid(unsigned char *edid, int size, struct edid *out)
+{
+	struct edid_cache *cache = NULL;
+	struct edid_cache_entry *e;
+	int ret;
+
+	if (edid && size >= 128 && size <= EDID_CACHE_MAX_SIZE &&
+	    !memcmp(edid, "\x00\xFF\xFF\xFF\xFF\xFF\xFF\x00", 8))
+		cache = get_edid_cache();
+
+	if (!cache)
+		return decode_edid_uncached(edid, size, out);
+
+	e = find_cached_edid(cache, edid, size);
+	if (e) {
+		printk(BIOS_SPEW, "EDID: using cached decode (checksum 0x%02x)\n",
+		       e->checksum);
+		*out = e->out;
+		return e->result;
+	}
+
+	/* The decoder may fix up the block in place, key on the original. */
+	e = &cache->entry[cache->next];
+	e->size = 0;
+	e->checksum = edid[0x7f];
+	memcpy(e->raw, edid, size);
+
+	ret = decode_edid_uncached(edid, size, out);
+	e->result = ret;
+	e->out = *out;
+	e->size = size;
+	cache->next = (cache->next + 1) % EDID_CACHE_ENTRIES;
+
+	return ret;
+}
+
+static int decode_edid_uncached(unsigned char *edid, int size,
+				struct edid *out)
 {
 	int analog, i, j;
 	struct edid_context c = {
@@ -1071,7 +1283,8 @@ int decode_edid(unsigned char *edid, int size, struct edid *out)
 	    .conformant = 1,
 	};
 
-	dump_breakdown(edid);
+	if (console_log_level(BIOS_SPEW))
+		dump_breakdown(edid);
 
 	memset(out, 0, sizeof(*out));
 
@@ -1281,6 +1494,9 @@ int decode_edid(unsigned char *edid, int size, struct edid *out)
 		if (edid[0x23 + i / 8] & (1 << (7 - i % 8))) {
 			printk(BIOS_SPEW, "  %dx%d@%dHz\n", established_timings[i].x,
 			       established_timings[i].y, established_timings[i].refresh);
+			add_timing(out, established_timings[i].x,
+				   established_timings[i].y,
+				   established_timings[i].refresh, 0);
 
 			for (j = 0; j < NUM_KNOWN_MODES; j++) {
 				if (known_modes[j].ha == established_timings[i].x &&
@@ -1325,6 +1541,7 @@ int decode_edid(unsigned char *edid, int size, struct edid *out)
 		refresh = 60 + (b2 & 0x3f);
 
 		printk(BIOS_SPEW, "  %dx%d@%dHz\n", x, y, refresh);
+		add_timing(out, x, y, refresh, 0);
 		for (j = 0; j < NUM_KNOWN_MODES; j++) {
 			if (known_modes[j].ha == x && known_modes[j].va == y &&
 					known_modes[j].refresh == refresh)
@@ -1366,6 +1583,8 @@ int decode_edid(unsigned char *edid, int size, struct edid *out)
 		c.nonconformant_extension +=
 				parse_extension(out, &edid[i], &c);
 
+	sort_timings(out);
+
 	if (c.claims_one_point_four) {
 		if (c.nonconformant_digital_display ||
 		    !c.has_valid_string_termination ||
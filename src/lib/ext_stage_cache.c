@@ -63,9 +63,13 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	struct imd *imd;
 	const struct imd_entry *e;
 	struct stage_cache *meta;
+	struct stage_cache m;
+	size_t size;
 	void *c;
 
 	imd = imd_get();
+	size = stage_cache_prepare(&m, stage);
+
 	e = imd_entry_add(imd, CBMEM_ID_STAGEx_META + stage_id, sizeof(*meta));
 
 	if (e == NULL)
@@ -73,18 +77,15 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 
 	meta = imd_entry_at(imd, e);
 
-	meta->load_addr = (uintptr_t)prog_start(stage);
-	meta->entry_addr = (uintptr_t)prog_entry(stage);
-
-	e = imd_entry_add(imd, CBMEM_ID_STAGEx_CACHE + stage_id,
-				prog_size(stage));
+	e = imd_entry_add(imd, CBMEM_ID_STAGEx_CACHE + stage_id, size);
 
 	if (e == NULL)
 		return;
 
 	c = imd_entry_at(imd, e);
 
-	memcpy(c, prog_start(stage), prog_size(stage));
+	stage_cache_store(&m, stage, c, size);
+	*meta = m;
 }
 
 void stage_cache_load_stage(int stage_id, struct prog *stage)
@@ -95,6 +96,8 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	void *c;
 	size_t size;
 
+	prog_set_entry(stage, NULL, NULL);
+
 	imd = imd_get();
 	e = imd_entry_find(imd, CBMEM_ID_STAGEx_META + stage_id);
 	if (e == NULL)
@@ -110,9 +113,10 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	c = imd_entry_at(imd, e);
 	size = imd_entry_size(imd, e);
 
-	memcpy((void *)(uintptr_t)meta->load_addr, c, size);
+	if (stage_cache_restore(meta, c, size))
+		return;
 
-	prog_set_area(stage, (void *)(uintptr_t)meta->load_addr, size);
+	prog_set_area(stage, (void *)(uintptr_t)meta->load_addr, meta->size);
 	prog_set_entry(stage, (void *)(uintptr_t)meta->entry_addr, NULL);
 }
 
@@ -175,6 +175,7 @@ static boot_state_t bs_dev_init(void *arg)
 
 static boot_state_t bs_post_device(void *arg)
 {
+	dev_initialize_deferred();
 	dev_finalize();
 	timestamp_add_now(TS_DEVICE_DONE);
 
@@ -100,6 +100,8 @@ static void initcol __P((PREC[][64]));
 static void col221111 __P((int *, unsigned char *, int));
 static void col221111_16 __P((int *, unsigned char *, int));
 static void col221111_32 __P((int *, unsigned char *, int));
+static void colgeneric __P((int *, int, int, unsigned char *, int, int, int,
+			   int));
 
 /*********************************/
 
@@ -206,6 +208,8 @@ static int readtables(int till)
 				l -= 1 + 16;
 				k = 0;
 				for (i = 0; i < 16; i++) {
+					if (k + hufflen[i] > 256)
+						return -1;
 					for (j = 0; j < hufflen[i]; j++)
 						huffvals[k++] = getbyte();
 					l -= hufflen[i];
@@ -278,15 +282,15 @@ int jpeg_check_size(unsigned char *buf, int width, int height)
         return 1;
 }
 
-int jpeg_decode(unsigned char *buf, unsigned char *pic,
-		int width, int height, int depth, struct jpeg_decdata *decdata)
+/*
+ * Parse the headers up to the start of scan and set up decoding. Returns the
+ * picture size in *width and *height.
+ */
+static int jpeg_parse(unsigned char *buf, int *width, int *height,
+		      struct jpeg_decdata *decdata)
 {
-	int i, j, m, tac, tdc;
-	int mcusx, mcusy, mx, my;
-	int max[6];
+	int i, j, m, tac, tdc, h, v;
 
-	if (!decdata || !buf || !pic)
-		return -1;
 	datap = buf;
 	if (getbyte() != 0xff)
 		return ERR_NO_SOI;
@@ -298,17 +302,14 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 	i = getbyte();
 	if (i != 8)
 		return ERR_NOT_8BIT;
-	if (((getword() + 15) & ~15) != height)
-		return ERR_HEIGHT_MISMATCH;
-	if (((getword() + 15) & ~15) != width)
-		return ERR_WIDTH_MISMATCH;
-	if ((height & 15) || (width & 15))
+	*height = getword();
+	*width = getword();
+	if (*height <= 0 || *width <= 0)
 		return ERR_BAD_WIDTH_OR_HEIGHT;
 	info.nc = getbyte();
 	if (info.nc > MAXCOMP)
 		return ERR_TOO_MANY_COMPPS;
 	for (i = 0; i < info.nc; i++) {
-		int h, v;
 		comps[i].cid = getbyte();
 		comps[i].hv = getbyte();
 		v = comps[i].hv & 15;
@@ -353,19 +354,44 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 	if (dscans[0].cid != 1 || dscans[1].cid != 2 || dscans[2].cid != 3)
 		return ERR_NOT_YCBCR_221111;
 
-	if (dscans[0].hv != 0x22 || dscans[1].hv != 0x11 || dscans[2].hv != 0x11)
+	/* Luma may be subsampled by up to 2 in each direction, chroma not. */
+	h = dscans[0].hv >> 4;
+	v = dscans[0].hv & 15;
+	if (h < 1 || h > 2 || v < 1 || v > 2 ||
+	    dscans[1].hv != 0x11 || dscans[2].hv != 0x11)
 		return ERR_NOT_YCBCR_221111;
 
-	mcusx = width >> 4;
-	mcusy = height >> 4;
-
-
 	idctqtab(quant[dscans[0].tq], decdata->dquant[0]);
 	idctqtab(quant[dscans[1].tq], decdata->dquant[1]);
 	idctqtab(quant[dscans[2].tq], decdata->dquant[2]);
 	initcol(decdata->dquant);
 	setinput(&glob_in, datap);
 
+	return 0;
+}
+
+/*
+ * Decode the scan into pic, which has 'pitch' bytes per line. Only the
+ * first 'width' columns and 'height' lines are written; MCUs are decoded
+ * one at a time and converted straight into place.
+ */
+static int jpeg_decode_scan(unsigned char *pic, int pitch, int width,
+			    int height, int depth, int picw, int pich,
+			    struct jpeg_decdata *decdata)
+{
+	const int h = dscans[0].hv >> 4, v = dscans[0].hv & 15;
+	const int nblocks = h * v + 2;
+	const int bpp = depth / 8;
+	int mcusx, mcusy, mx, my, i, m;
+	int max[6];
+	unsigned char *p;
+
+	if (depth != 16 && depth != 24 && depth != 32)
+		return ERR_DEPTH_MISMATCH;
+
+	mcusx = (picw + 8 * h - 1) / (8 * h);
+	mcusy = (pich + 8 * v - 1) / (8 * v);
+
 #if 0
 	/* landing zone */
 	img[len] = 0;
@@ -375,36 +401,45 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 
 	dec_initscans();
 
-	dscans[0].next = 6 - 4;
-	dscans[1].next = 6 - 4 - 1;
-	dscans[2].next = 6 - 4 - 1 - 1;	/* 411 encoding */
+	dscans[0].next = 2;
+	dscans[1].next = 1;
+	dscans[2].next = 0;	/* luma blocks, then one each of Cb, Cr */
 	for (my = 0; my < mcusy; my++) {
+		/* Nothing below the clipping rectangle needs decoding. */
+		if (my * 8 * v >= height)
+			return 0;
 		for (mx = 0; mx < mcusx; mx++) {
 			if (info.dri && !--info.nm)
 				if (dec_checkmarker())
 					return ERR_WRONG_MARKER;
 
-			decode_mcus(&glob_in, decdata->dcts, 6, dscans, max);
-			idct(decdata->dcts, decdata->out, decdata->dquant[0], IFIX(128.5), max[0]);
-			idct(decdata->dcts + 64, decdata->out + 64, decdata->dquant[0], IFIX(128.5), max[1]);
-			idct(decdata->dcts + 128, decdata->out + 128, decdata->dquant[0], IFIX(128.5), max[2]);
-			idct(decdata->dcts + 192, decdata->out + 192, decdata->dquant[0], IFIX(128.5), max[3]);
-			idct(decdata->dcts + 256, decdata->out + 256, decdata->dquant[1], IFIX(0.5), max[4]);
-			idct(decdata->dcts + 320, decdata->out + 320, decdata->dquant[2], IFIX(0.5), max[5]);
-
-			switch (depth) {
-			case 32:
-				col221111_32(decdata->out, pic + (my * 16 * mcusx + mx) * 16 * 4, mcusx * 16 * 4);
-				break;
-			case 24:
-				col221111(decdata->out, pic + (my * 16 * mcusx + mx) * 16 * 3, mcusx * 16 * 3);
-				break;
-			case 16:
-				col221111_16(decdata->out, pic + (my * 16 * mcusx + mx) * (16 * 2), mcusx * (16 * 2));
-				break;
-			default:
-				return ERR_DEPTH_MISMATCH;
-				break;
+			decode_mcus(&glob_in, decdata->dcts, nblocks, dscans,
+				    max);
+			for (i = 0; i < nblocks - 2; i++)
+				idct(decdata->dcts + i * 64,
+				     decdata->out + i * 64, decdata->dquant[0],
+				     IFIX(128.5), max[i]);
+			idct(decdata->dcts + i * 64, decdata->out + i * 64,
+			     decdata->dquant[1], IFIX(0.5), max[i]);
+			i++;
+			idct(decdata->dcts + i * 64, decdata->out + i * 64,
+			     decdata->dquant[2], IFIX(0.5), max[i]);
+
+			p = pic + my * 8 * v * pitch + mx * 8 * h * bpp;
+
+			/* The unrolled converters handle whole 2x2 MCUs. */
+			if (h == 2 && v == 2 && (mx + 1) * 16 <= width &&
+			    (my + 1) * 16 <= height) {
+				if (depth == 32)
+					col221111_32(decdata->out, p, pitch);
+				else if (depth == 24)
+					col221111(decdata->out, p, pitch);
+				else
+					col221111_16(decdata->out, p, pitch);
+			} else {
+				colgeneric(decdata->out, h, v, p, pitch, depth,
+					   width - mx * 8 * h,
+					   height - my * 8 * v);
 			}
 		}
 	}
@@ -416,6 +451,48 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 	return 0;
 }
 
+int jpeg_decode(unsigned char *buf, unsigned char *pic,
+		int width, int height, int depth, struct jpeg_decdata *decdata)
+{
+	int ret, picw, pich;
+
+	if (!decdata || !buf || !pic)
+		return -1;
+	ret = jpeg_parse(buf, &picw, &pich, decdata);
+	if (ret)
+		return ret;
+	if (((pich + 15) & ~15) != height)
+		return ERR_HEIGHT_MISMATCH;
+	if (((picw + 15) & ~15) != width)
+		return ERR_WIDTH_MISMATCH;
+	if ((height & 15) || (width & 15))
+		return ERR_BAD_WIDTH_OR_HEIGHT;
+
+	return jpeg_decode_scan(pic, width * depth / 8, width, height, depth,
+				width, height, decdata);
+}
+
+int jpeg_decode_fb(unsigned char *buf, unsigned char *fb, int fb_width,
+		   int fb_height, int pitch, int depth,
+		   struct jpeg_decdata *decdata)
+{
+	int ret, picw, pich;
+
+	if (!decdata || !buf || !fb)
+		return -1;
+	ret = jpeg_parse(buf, &picw, &pich, decdata);
+	if (ret)
+		return ret;
+
+	if (fb_width > picw)
+		fb_width = picw;
+	if (fb_height > pich)
+		fb_height = pich;
+
+	return jpeg_decode_scan(fb, pitch, fb_width, fb_height, depth,
+				picw, pich, decdata);
+}
+
 /****************************************************************/
 /**************       huffman decoder             ***************/
 /****************************************************************/
@@ -705,6 +782,14 @@ void idct(int *in, int *out, PREC *lquant, PREC off, int max)
 		t3 = in[j] * lquant[j];
 		j = *zig2p++;
 		t6 = in[j] * lquant[j];
+		/* Columns without AC coefficients are common, and flat. */
+		if ((t1 | t2 | t3 | t4 | t5 | t6 | t7) == 0) {
+			for (j = 0; j < 8; j++)
+				tmpp[j * 8] = t0;
+			tmpp++;
+			t0 = 0;
+			continue;
+		}
 		IDCT;
 		tmpp[0 * 8] = t0;
 		tmpp[1 * 8] = t1;
@@ -992,3 +1077,41 @@ static void col221111_32(int *out, unsigned char *pic, int width)
 		outy += 64 * 2 - 16 * 4;
 	}
 }
+
+/*
+ * Convert an MCU of h x v luma blocks and one block each of Cb and Cr, writing
+ * only the first 'width' columns and 'height' lines. Used for other sampling
+ * factors and for MCUs cut off at the edges of the picture.
+ */
+static void colgeneric(int *out, int h, int v, unsigned char *pic, int pitch,
+		       int depth, int width, int height)
+{
+	static const int dither[4] = { 3, 0, 1, 2 };
+	int i, j, xin, yin;
+	unsigned char *p;
+	int *outy, *outc;
+	int cr, cg, cb, y;
+
+	if (width > 8 * h)
+		width = 8 * h;
+	if (height > 8 * v)
+		height = 8 * v;
+
+	for (i = 0; i < height; i++) {
+		p = pic + i * pitch;
+		yin = i & 7;
+		for (j = 0; j < width; j++) {
+			xin = j & 7;
+			outy = out + ((i >> 3) * h + (j >> 3)) * 64;
+			outc = out + 64 * h * v;
+			CBCRCG(i / v, j / h);
+			if (depth == 32)
+				PIC_32(yin, xin, p, j);
+			else if (depth == 24)
+				PIC(yin, xin, p, j);
+			else
+				PIC_16(yin, xin, p, j,
+				       dither[(i & 1) * 2 + (j & 1)]);
+		}
+	}
+}
@@ -45,6 +45,14 @@ struct jpeg_decdata {
 };
 
 int jpeg_decode(unsigned char *, unsigned char *, int, int, int, struct jpeg_decdata *);
+/*
+ * Decode into a framebuffer of fb_width x fb_height pixels with 'pitch'
+ * bytes per line, clipping the picture to it. Unlike jpeg_decode(), the
+ * picture size needn't be a multiple of 16.
+ */
+int jpeg_decode_fb(unsigned char *buf, unsigned char *fb, int fb_width,
+		   int fb_height, int pitch, int depth,
+		   struct jpeg_decdata *decdata);
 void jpeg_fetch_size(unsigned char *buf, int *width, int *height);
 int jpeg_check_size(unsigned char *, int, int);
 
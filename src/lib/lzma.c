@@ -16,7 +16,8 @@
 
 #include "lzmadecode.h"
 
-size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
+size_t ulzman_scratch(const void *src, size_t srcn, void *dst, size_t dstn,
+		     void *scratchpad)
 {
 	unsigned char properties[LZMA_PROPERTIES_SIZE];
 	const int data_offset = LZMA_PROPERTIES_SIZE + 8;
@@ -26,7 +27,6 @@ size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
 	int res;
 	CLzmaDecoderState state;
 	SizeT mallocneeds;
-	MAYBE_STATIC unsigned char scratchpad[15980];
 	const unsigned char *cp;
 
 	memcpy(properties, src, LZMA_PROPERTIES_SIZE);
@@ -42,7 +42,7 @@ size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
 		return 0;
 	}
 	mallocneeds = (LzmaGetNumProbs(&state.Properties) * sizeof(CProb));
-	if (mallocneeds > 15980) {
+	if (mallocneeds > ULZMA_SCRATCH_SIZE) {
 		printk(BIOS_WARNING, "lzma: Decoder scratchpad too small!\n");
 		return 0;
 	}
@@ -56,6 +56,13 @@ size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
 	return outProcessed;
 }
 
+size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	MAYBE_STATIC unsigned char scratchpad[ULZMA_SCRATCH_SIZE];
+
+	return ulzman_scratch(src, srcn, dst, dstn, scratchpad);
+}
+
 size_t ulzma(const void *src, void *dst)
 {
 	return ulzman(src, ~(size_t)0, dst, ~(size_t)0);
@@ -160,7 +160,6 @@ int nhlt_endpoint_add_formats(struct nhlt_endpoint *endp,
 
 	for (i = 0; i < num_formats; i++) {
 		struct nhlt_format *fmt;
-		struct cbfsf file;
 		struct region_device settings;
 		void *settings_data;
 		const struct nhlt_format_config *cfg = &formats[i];
@@ -178,12 +177,8 @@ int nhlt_endpoint_add_formats(struct nhlt_endpoint *endp,
 			continue;
 
 		/* Find the settings file in CBFS and place it in format. */
-		if (cbfs_boot_locate(&file, cfg->settings_file, NULL))
-			return -1;
-
-		cbfs_file_data(&settings, &file);
-
-		settings_data = rdev_mmap_full(&settings);
+		settings_data = cbfs_boot_map(&settings, cfg->settings_file,
+						NULL);
 
 		if (settings_data == NULL)
 			return -1;
@@ -35,16 +35,9 @@ const struct mem_region_device addrspace_32bit = MEM_REGION_DEV_INIT(0, ~0UL);
 
 int prog_locate(struct prog *prog)
 {
-	struct cbfsf file;
-
 	cbfs_prepare_program_locate();
 
-	if (cbfs_boot_locate(&file, prog_name(prog), NULL))
-		return -1;
-
-	cbfs_file_data(prog_rdev(prog), &file);
-
-	return 0;
+	return cbfs_boot_locate_prog(prog, NULL);
 }
 
 void run_romstage(void)
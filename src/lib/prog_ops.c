@@ -33,3 +33,10 @@ void __attribute__ ((weak)) platform_prog_run(struct prog *prog)
 {
 	/* do nothing */
 }
+
+/* Without secondary CPUs to hand work to, everything runs on the caller. */
+int __attribute__ ((weak)) arch_run_on_idle_cpus(void (*func)(void *),
+						 void *arg)
+{
+	return 0;
+}
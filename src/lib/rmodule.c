@@ -282,8 +282,7 @@ int rmodule_stage_load(struct rmod_stage_load *rsl)
 	printk(BIOS_INFO, "Decompressing stage %s @ 0x%p (%d bytes)\n",
 	       prog_name(rsl->prog), rmod_loc, stage.memlen);
 
-	if (!cbfs_load_and_decompress(fh, sizeof(stage), stage.len, rmod_loc,
-				      stage.memlen, stage.compression))
+	if (!cbfs_stage_load(rsl->prog, &stage, rmod_loc))
 		return -1;
 
 	if (rmodule_parse(rmod_loc, &rmod_stage))
@@ -26,19 +26,34 @@
 #include <lib.h>
 #include <bootmem.h>
 #include <program_loading.h>
+#include <smp/spinlock.h>
 #include <timestamp.h>
 
 static const unsigned long lb_start = (unsigned long)&_program;
 static const unsigned long lb_end = (unsigned long)&_eprogram;
 
+/* Serializes payload segment decompression on several CPUs. */
+DECLARE_SPIN_LOCK(segment_lock)
+
+/*
+ * A payload that needs verification is hashed while it is loaded, in file
+ * order: the segment table as it is parsed, the segment data where it is
+ * used and the unused bytes in between straight from the boot media.
+ */
+struct payload_verify {
+	struct cbfs_verify hash;
+	size_t offset;			/* payload bytes hashed so far */
+};
+
 struct segment {
 	struct segment *next;
 	struct segment *prev;
 	unsigned long s_dstaddr;
-	unsigned long s_srcaddr;
+	unsigned long s_srcaddr;	/* offset into the payload region_device */
 	unsigned long s_memsz;
 	unsigned long s_filesz;
 	int compression;
+	int loaded;			/* already decompressed by a worker */
 };
 
 /* The problem:
@@ -207,39 +222,86 @@ static int relocate_segment(unsigned long buffer, struct segment *seg)
 }
 
 
+/* Hash the unused payload bytes up to offset. Returns 0 on success. */
+static int verify_skip_to(struct payload_verify *pv,
+			  const struct region_device *rdev, size_t offset)
+{
+	if (offset < pv->offset) {
+		printk(BIOS_ERR, "Payload segments out of order\n");
+		return -1;
+	}
+
+	if (cbfs_verify_rdev(&pv->hash, rdev, pv->offset, offset - pv->offset))
+		return -1;
+
+	pv->offset = offset;
+	return 0;
+}
+
+/* Hash size payload bytes at offset that have been read to buf. */
+static int verify_used(struct payload_verify *pv,
+		       const struct region_device *rdev, size_t offset,
+		       const void *buf, size_t size)
+{
+	if (pv == NULL)
+		return 0;
+
+	if (verify_skip_to(pv, rdev, offset) ||
+	    cbfs_verify_extend(&pv->hash, buf, size)) {
+		printk(BIOS_ERR, "Could not hash payload at 0x%zx\n", offset);
+		return -1;
+	}
+
+	pv->offset = offset + size;
+	return 0;
+}
+
 static int build_self_segment_list(
 	struct segment *head,
-	struct cbfs_payload *cbfs_payload, uintptr_t *entry)
+	const struct region_device *rdev, uintptr_t *entry,
+	struct payload_verify *pv)
 {
 	struct segment *new;
-	struct segment *ptr;
-	struct cbfs_payload_segment *segment, *first_segment;
+	struct cbfs_payload_segment segment;
+	size_t offset = 0;
 	memset(head, 0, sizeof(*head));
 	head->next = head->prev = head;
-	first_segment = segment = &cbfs_payload->segments;
 
+	/*
+	 * Only the segment table is read here. The segment contents are
+	 * streamed from the region_device in load_self_segments(), so the
+	 * payload never has to be mapped as a whole.
+	 */
 	while(1) {
-		printk(BIOS_DEBUG, "Loading segment from rom address 0x%p\n", segment);
-		switch(segment->type) {
+		if (rdev_readat(rdev, &segment, offset, sizeof(segment)) !=
+		    sizeof(segment)) {
+			printk(BIOS_ERR, "Could not read segment at 0x%zx\n",
+			       offset);
+			return 0;
+		}
+		if (verify_used(pv, rdev, offset, &segment, sizeof(segment)))
+			return 0;
+		printk(BIOS_DEBUG, "Loading segment from payload offset 0x%zx\n",
+		       offset);
+		offset += sizeof(segment);
+
+		switch(segment.type) {
 		case PAYLOAD_SEGMENT_PARAMS:
 			printk(BIOS_DEBUG, "  parameter section (skipped)\n");
-			segment++;
 			continue;
 
 		case PAYLOAD_SEGMENT_CODE:
 		case PAYLOAD_SEGMENT_DATA:
 			printk(BIOS_DEBUG, "  %s (compression=%x)\n",
-					segment->type == PAYLOAD_SEGMENT_CODE ?  "code" : "data",
-					ntohl(segment->compression));
+					segment.type == PAYLOAD_SEGMENT_CODE ?  "code" : "data",
+					ntohl(segment.compression));
 			new = malloc(sizeof(*new));
-			new->s_dstaddr = ntohll(segment->load_addr);
-			new->s_memsz = ntohl(segment->mem_len);
-			new->compression = ntohl(segment->compression);
-
-			new->s_srcaddr = (uintptr_t)
-				((unsigned char *)first_segment)
-				+ ntohl(segment->offset);
-			new->s_filesz = ntohl(segment->len);
+			new->s_dstaddr = ntohll(segment.load_addr);
+			new->s_memsz = ntohl(segment.mem_len);
+			new->compression = ntohl(segment.compression);
+			new->s_srcaddr = ntohl(segment.offset);
+			new->s_filesz = ntohl(segment.len);
+			new->loaded = 0;
 			printk(BIOS_DEBUG, "  New segment dstaddr 0x%lx memsize 0x%lx srcaddr 0x%lx filesize 0x%lx\n",
 				new->s_dstaddr, new->s_memsz, new->s_srcaddr, new->s_filesz);
 			/* Clean up the values */
@@ -253,21 +315,21 @@ static int build_self_segment_list(
 
 		case PAYLOAD_SEGMENT_BSS:
 			printk(BIOS_DEBUG, "  BSS 0x%p (%d byte)\n", (void *)
-					(intptr_t)ntohll(segment->load_addr),
-				 	ntohl(segment->mem_len));
+					(intptr_t)ntohll(segment.load_addr),
+				 	ntohl(segment.mem_len));
 			new = malloc(sizeof(*new));
 			new->s_filesz = 0;
-			new->s_srcaddr = (uintptr_t)
-				((unsigned char *)first_segment)
-				+ ntohl(segment->offset);
-			new->s_dstaddr = ntohll(segment->load_addr);
-			new->s_memsz = ntohl(segment->mem_len);
+			new->s_srcaddr = ntohl(segment.offset);
+			new->s_dstaddr = ntohll(segment.load_addr);
+			new->s_memsz = ntohl(segment.mem_len);
+			new->compression = CBFS_COMPRESS_NONE;
+			new->loaded = 0;
 			break;
 
 		case PAYLOAD_SEGMENT_ENTRY:
 			printk(BIOS_DEBUG, "  Entry Point 0x%p\n",
-			       (void *)(intptr_t)ntohll(segment->load_addr));
-			*entry =  ntohll(segment->load_addr);
+			       (void *)(intptr_t)ntohll(segment.load_addr));
+			*entry =  ntohll(segment.load_addr);
 			/* Per definition, a payload always has the entry point
 			 * as last segment. Thus, we use the occurrence of the
 			 * entry point as break condition for the loop.
@@ -279,24 +341,233 @@ static int build_self_segment_list(
 			/* We found something that we don't know about. Throw
 			 * hands into the sky and run away!
 			 */
-			printk(BIOS_EMERG, "Bad segment type %x\n", segment->type);
-			return -1;
+			printk(BIOS_EMERG, "Bad segment type %x\n", segment.type);
+			return 0;
 		}
 
-		/* We have found another CODE, DATA or BSS segment */
-		segment++;
+		/* We have found another CODE, DATA or BSS segment. Keep them
+		 * in stream order. */
+		new->next = head;
+		new->prev = head->prev;
+		head->prev->next = new;
+		head->prev = new;
+	}
+
+	return 1;
+}
+
+/*
+ * Fill the first s_filesz bytes at dest from the payload. Uncompressed data
+ * is read straight into place; compressed data only needs this one segment
+ * mapped, not the whole payload. Returns the number of bytes produced, 0 on
+ * error. A non-NULL scratch means the caller is a secondary CPU: LZMA then
+ * uses that decoder state instead of ulzman()'s shared one, and no
+ * timestamps are taken because the timestamp table is not locked. With pv
+ * the input is hashed right before it is used.
+ */
+static size_t load_segment_data(const struct region_device *rdev,
+				struct segment *seg, unsigned char *dest,
+				void *scratch, struct payload_verify *pv)
+{
+	size_t len = 0;
+	void *src;
+
+	if (seg->compression == CBFS_COMPRESS_NONE) {
+		printk(BIOS_DEBUG, "it's not compressed!\n");
+		if (rdev_readat(rdev, dest, seg->s_srcaddr, seg->s_filesz) !=
+		    seg->s_filesz)
+			return 0;
+		if (verify_used(pv, rdev, seg->s_srcaddr, dest, seg->s_filesz))
+			return 0;
+		return seg->s_filesz;
+	}
+
+	/* Mapping may update region_device state, keep it on one CPU. */
+	spin_lock(&segment_lock);
+	src = rdev_mmap(rdev, seg->s_srcaddr, seg->s_filesz);
+	spin_unlock(&segment_lock);
+	if (src == NULL)
+		return 0;
+
+	if (verify_used(pv, rdev, seg->s_srcaddr, src, seg->s_filesz)) {
+		rdev_munmap(rdev, src);
+		return 0;
+	}
 
-		/* Find place where to insert our segment */
-		for(ptr = head->next; ptr != head; ptr = ptr->next) {
-			if (new->s_srcaddr < ntohll(segment->load_addr))
+	switch(seg->compression) {
+		case CBFS_COMPRESS_LZMA: {
+			printk(BIOS_DEBUG, "using LZMA\n");
+			if (scratch) {
+				len = ulzman_scratch(src, seg->s_filesz, dest,
+						     seg->s_memsz, scratch);
 				break;
+			}
+			timestamp_add_now(TS_START_ULZMA);
+			len = ulzman(src, seg->s_filesz, dest, seg->s_memsz);
+			timestamp_add_now(TS_END_ULZMA);
+			break;
 		}
+		case CBFS_COMPRESS_LZ4: {
+			printk(BIOS_DEBUG, "using LZ4\n");
+			if (scratch) {
+				len = ulz4fn(src, seg->s_filesz, dest,
+					     seg->s_memsz);
+				break;
+			}
+			timestamp_add_now(TS_START_ULZ4F);
+			len = ulz4fn(src, seg->s_filesz, dest, seg->s_memsz);
+			timestamp_add_now(TS_END_ULZ4F);
+			break;
+		}
+		default:
+			printk(BIOS_INFO,  "CBFS:  Unknown compression type %d\n", seg->compression);
+			break;
+	}
+
+	spin_lock(&segment_lock);
+	rdev_munmap(rdev, src);
+	spin_unlock(&segment_lock);
+	return len;
+}
+
+/*
+ * Compressed segments that overlap neither coreboot nor any other segment
+ * can be decompressed in any order. When there are idle CPUs they take
+ * such segments off a shared list while the BSP does the same. ulzman()
+ * keeps its decoder state in a static buffer, so every worker gets its
+ * own. Only a few workers are useful since they all read the same boot
+ * media.
+ */
+#if CONFIG_MAX_CPUS > 4
+#define SEGMENT_WORKERS		3
+#else
+#define SEGMENT_WORKERS		(CONFIG_MAX_CPUS - 1)
+#endif
+
+static u8 segment_scratch[SEGMENT_WORKERS][ULZMA_SCRATCH_SIZE]
+	__attribute__((aligned(8)));
+
+struct segment_jobs {
+	const struct region_device *rdev;
+	struct segment *head;
+	struct segment *next;	/* where to look for the next job */
+	int workers;		/* scratch buffers handed out */
+	int finished;		/* CPUs done with this structure */
+	int failed;
+};
 
-		/* Order by stream offset */
-		new->next = ptr;
-		new->prev = ptr->prev;
-		ptr->prev->next = new;
-		ptr->prev = new;
+static struct segment *claim_segment(struct segment_jobs *jobs)
+{
+	struct segment *seg;
+
+	spin_lock(&segment_lock);
+	for (seg = jobs->next; seg != jobs->head; seg = seg->next)
+		if (seg->loaded)
+			break;
+	jobs->next = seg == jobs->head ? seg : seg->next;
+	spin_unlock(&segment_lock);
+
+	return seg == jobs->head ? NULL : seg;
+}
+
+static void run_segment_jobs(struct segment_jobs *jobs, void *scratch)
+{
+	struct segment *seg;
+
+	while ((seg = claim_segment(jobs)) != NULL) {
+		unsigned char *dest = (unsigned char *)seg->s_dstaddr;
+		size_t len;
+
+		len = load_segment_data(jobs->rdev, seg, dest, scratch, NULL);
+		if (!len) {
+			spin_lock(&segment_lock);
+			jobs->failed = 1;
+			spin_unlock(&segment_lock);
+			continue;
+		}
+		if (len < seg->s_memsz)
+			memset(dest + len, 0, seg->s_memsz - len);
+	}
+}
+
+static void segment_worker(void *arg)
+{
+	struct segment_jobs *jobs = arg;
+	int slot = -1;
+
+	spin_lock(&segment_lock);
+	if (jobs->workers < SEGMENT_WORKERS)
+		slot = jobs->workers++;
+	spin_unlock(&segment_lock);
+
+	if (slot >= 0)
+		run_segment_jobs(jobs, segment_scratch[slot]);
+
+	/* Last access to jobs, the BSP may return right after this. */
+	spin_lock(&segment_lock);
+	jobs->finished++;
+	spin_unlock(&segment_lock);
+}
+
+static int segments_overlap(struct segment *a, struct segment *b)
+{
+	return a->s_dstaddr < b->s_dstaddr + b->s_memsz &&
+		b->s_dstaddr < a->s_dstaddr + a->s_memsz;
+}
+
+/*
+ * Load the independent segments ahead of the main loop, marking them as
+ * loaded. Returns 0 on error.
+ */
+static int load_independent_segments(struct segment *head,
+				     const struct region_device *rdev)
+{
+	struct segment_jobs jobs = {
+		.rdev = rdev,
+		.head = head,
+		.next = head->next,
+	};
+	struct segment *ptr, *other;
+	int queued = 0;
+	int started, finished;
+
+	for (ptr = head->next; ptr != head; ptr = ptr->next) {
+		if (ptr->compression == CBFS_COMPRESS_NONE || !ptr->s_filesz ||
+		    overlaps_coreboot(ptr))
+			continue;
+		for (other = head->next; other != head; other = other->next)
+			if (other != ptr && segments_overlap(ptr, other))
+				break;
+		if (other != head)
+			continue;
+		ptr->loaded = 1;
+		queued++;
+	}
+
+	/* A single segment is better left to the main loop. */
+	if (queued < 2) {
+		for (ptr = head->next; ptr != head; ptr = ptr->next)
+			ptr->loaded = 0;
+		return 1;
+	}
+
+	started = arch_run_on_idle_cpus(segment_worker, &jobs);
+	printk(BIOS_DEBUG, "Decompressing %d segments on %d CPUs\n", queued,
+	       min(started, SEGMENT_WORKERS) + 1);
+
+	run_segment_jobs(&jobs, NULL);
+
+	/* jobs lives on this stack, wait until every worker is done with it. */
+	do {
+		cpu_relax();
+		spin_lock(&segment_lock);
+		finished = jobs.finished;
+		spin_unlock(&segment_lock);
+	} while (finished < started);
+
+	if (jobs.failed) {
+		printk(BIOS_ERR, "Could not decompress payload segments\n");
+		return 0;
 	}
 
 	return 1;
@@ -304,7 +575,8 @@ static int build_self_segment_list(
 
 static int load_self_segments(
 	struct segment *head,
-	struct prog *payload)
+	const struct region_device *rdev,
+	struct payload_verify *pv)
 {
 	struct segment *ptr;
 	struct segment *last_non_empty;
@@ -349,6 +621,13 @@ static int load_self_segments(
 
 		if (!overlaps_coreboot(ptr))
 			continue;
+		/*
+		 * Uncompressed segments get sliced in relocate_segment(), so
+		 * only their part inside coreboot is ever bounced. Compressed
+		 * ones have to be decompressed into the buffer as a whole.
+		 */
+		if (ptr->compression == CBFS_COMPRESS_NONE)
+			continue;
 		if (ptr->s_dstaddr + ptr->s_memsz > bounce_high)
 			bounce_high = ptr->s_dstaddr + ptr->s_memsz;
 	}
@@ -358,8 +637,14 @@ static int load_self_segments(
 		return 0;
 	}
 
+	/* The hash is built in file order, so verified payloads are loaded
+	 * on this CPU only. */
+	if (IS_ENABLED(CONFIG_PAYLOAD_PARALLEL_DECOMPRESS) && pv == NULL &&
+	    !load_independent_segments(head, rdev))
+		return 0;
+
 	for(ptr = head->next; ptr != head; ptr = ptr->next) {
-		unsigned char *dest, *src;
+		unsigned char *dest;
 		printk(BIOS_DEBUG, "Loading Segment: addr: 0x%016lx memsz: 0x%016lx filesz: 0x%016lx\n",
 			ptr->s_dstaddr, ptr->s_memsz, ptr->s_filesz);
 
@@ -375,48 +660,31 @@ static int load_self_segments(
 
 		/* Compute the boundaries of the segment */
 		dest = (unsigned char *)(ptr->s_dstaddr);
-		src = (unsigned char *)(ptr->s_srcaddr);
 
-		/* Copy data from the initial buffer */
+		/* Already decompressed by load_independent_segments(). */
+		if (ptr->loaded) {
+			arch_segment_loaded((uintptr_t)dest, ptr->s_memsz,
+					last_non_empty == ptr ? SEG_FINAL : 0);
+			continue;
+		}
+
+		/* Stream the data in from the boot media */
 		if (ptr->s_filesz) {
 			unsigned char *middle, *end;
-			size_t len = ptr->s_filesz;
+			size_t len;
 			size_t memsz = ptr->s_memsz;
-			switch(ptr->compression) {
-				case CBFS_COMPRESS_LZMA: {
-					printk(BIOS_DEBUG, "using LZMA\n");
-					timestamp_add_now(TS_START_ULZMA);
-					len = ulzman(src, len, dest, memsz);
-					timestamp_add_now(TS_END_ULZMA);
-					if (!len) /* Decompression Error. */
-						return 0;
-					break;
-				}
-				case CBFS_COMPRESS_LZ4: {
-					printk(BIOS_DEBUG, "using LZ4\n");
-					timestamp_add_now(TS_START_ULZ4F);
-					len = ulz4fn(src, len, dest, memsz);
-					timestamp_add_now(TS_END_ULZ4F);
-					if (!len) /* Decompression Error. */
-						return 0;
-					break;
-				}
-				case CBFS_COMPRESS_NONE: {
-					printk(BIOS_DEBUG, "it's not compressed!\n");
-					memcpy(dest, src, len);
-					break;
-				}
-				default:
-					printk(BIOS_INFO,  "CBFS:  Unknown compression type %d\n", ptr->compression);
-					return -1;
-			}
+
+			len = load_segment_data(rdev, ptr, dest, NULL, pv);
+			if (!len) /* Read or decompression error. */
+				return 0;
+
 			end = dest + memsz;
 			middle = dest + len;
 			printk(BIOS_SPEW, "[ 0x%08lx, %08lx, 0x%08lx) <- %08lx\n",
 				(unsigned long)dest,
 				(unsigned long)middle,
 				(unsigned long)end,
-				(unsigned long)src);
+				ptr->s_srcaddr);
 
 			/* Zero the extra bytes between middle & end */
 			if (middle < end) {
@@ -459,36 +727,39 @@ static int load_self_segments(
 
 void *selfload(struct prog *payload)
 {
+	const struct region_device *rdev = prog_rdev(payload);
 	uintptr_t entry = 0;
 	struct segment head;
-	void *data;
-
-	data = rdev_mmap_full(prog_rdev(payload));
+	struct payload_verify verify = { .offset = 0 };
+	struct payload_verify *pv = NULL;
 
-	if (data == NULL)
-		return NULL;
+	if (cbfs_prog_needs_verify(payload)) {
+		pv = &verify;
+		if (cbfs_verify_start(&pv->hash, &payload->metadata))
+			return NULL;
+	}
 
 	/* Preprocess the self segments */
-	if (!build_self_segment_list(&head, data, &entry))
-		goto out;
+	if (!build_self_segment_list(&head, rdev, &entry, pv))
+		return NULL;
 
 	/* Load the segments */
-	if (!load_self_segments(&head, payload))
-		goto out;
-
-	printk(BIOS_SPEW, "Loaded segments\n");
+	if (!load_self_segments(&head, rdev, pv))
+		return NULL;
 
-	rdev_munmap(prog_rdev(payload), data);
+	/* Nothing loaded may be run unless the whole payload matched. */
+	if (pv != NULL &&
+	    (verify_skip_to(pv, rdev, region_device_sz(rdev)) ||
+	     cbfs_verify_finish(&pv->hash, NULL, 0))) {
+		printk(BIOS_ERR, "'%s' failed verification.\n",
+		       prog_name(payload));
+		return NULL;
+	}
 
-	/* Update the payload's area with the bounce buffer information. */
-	prog_set_area(payload, (void *)(uintptr_t)bounce_buffer, bounce_size);
+	printk(BIOS_SPEW, "Loaded segments\n");
 
 	/* Update the payload's area with the bounce buffer information. */
 	prog_set_area(payload, (void *)(uintptr_t)bounce_buffer, bounce_size);
 
 	return (void *)entry;
-
-out:
-	rdev_munmap(prog_rdev(payload), data);
-	return NULL;
 }
@@ -0,0 +1,103 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <cbfs.h>
+#include <commonlib/compression.h>
+#include <commonlib/fnv.h>
+#include <console/console.h>
+#include <stage_cache.h>
+#include <string.h>
+#include <timestamp.h>
+
+/*
+ * It only has to catch the cache having been overwritten, e.g. by the OS, so
+ * it favours speed on the resume path.
+ */
+static uint32_t stage_cache_checksum(const void *data, size_t size)
+{
+	return fnv1a32_words(FNV32_OFFSET, data, size);
+}
+
+size_t stage_cache_prepare(struct stage_cache *meta, const struct prog *stage)
+{
+	size_t csize;
+
+	memset(meta, 0, sizeof(*meta));
+	meta->load_addr = (uintptr_t)prog_start(stage);
+	meta->entry_addr = (uintptr_t)prog_entry(stage);
+	meta->size = prog_size(stage);
+	meta->compression = CBFS_COMPRESS_NONE;
+
+	if (!IS_ENABLED(CONFIG_STAGE_CACHE_LZ4))
+		return meta->size;
+
+	/* Sizing pass, nothing is written. */
+	csize = lz4_compress_block(prog_start(stage), meta->size, NULL, 0);
+	if (csize >= meta->size)
+		return meta->size;
+
+	meta->compression = CBFS_COMPRESS_LZ4;
+	return csize;
+}
+
+void stage_cache_store(struct stage_cache *meta, const struct prog *stage,
+			void *c, size_t size)
+{
+	if (meta->compression == CBFS_COMPRESS_LZ4) {
+		lz4_compress_block(prog_start(stage), meta->size, c, size);
+		printk(BIOS_DEBUG, "Stage cache: %u bytes stored in %zu\n",
+		       meta->size, size);
+	} else {
+		memcpy(c, prog_start(stage), size);
+	}
+
+	meta->checksum = stage_cache_checksum(c, size);
+}
+
+int stage_cache_restore(const struct stage_cache *meta, const void *c,
+			size_t size)
+{
+	void *load_addr = (void *)(uintptr_t)meta->load_addr;
+	size_t len;
+
+	timestamp_add_now(TS_START_STAGE_CACHE);
+
+	if (stage_cache_checksum(c, size) != meta->checksum) {
+		printk(BIOS_ERR, "Stage cache: checksum mismatch\n");
+		return -1;
+	}
+
+	switch (meta->compression) {
+	case CBFS_COMPRESS_NONE:
+		len = MIN(size, meta->size);
+		memcpy(load_addr, c, len);
+		break;
+	case CBFS_COMPRESS_LZ4:
+		len = ulz4n(c, size, load_addr, meta->size);
+		break;
+	default:
+		len = 0;
+		break;
+	}
+
+	if (len != meta->size) {
+		printk(BIOS_ERR, "Stage cache: could not restore stage\n");
+		return -1;
+	}
+
+	timestamp_add_now(TS_END_STAGE_CACHE);
+
+	return 0;
+}
@@ -14,11 +14,21 @@
  */
 
 #include <types.h>
+#include <cbmem.h>
+#include <commonlib/helpers.h>
+#include <commonlib/trace_serialized.h>
 #include <console/console.h>
+#include <timestamp.h>
 #include <trace.h>
 
+#if IS_ENABLED(CONFIG_ARCH_RAMSTAGE_X86_32)
+#include <arch/cpu.h>
+#endif
+
 int volatile trace_dis = 0;
 
+#if !IS_ENABLED(CONFIG_TRACE_CBMEM)
+
 void __cyg_profile_func_enter( void *func, void *callsite)
 {
 
@@ -33,3 +43,136 @@ void __cyg_profile_func_enter( void *func, void *callsite)
 void __cyg_profile_func_exit( void *func, void *callsite )
 {
 }
+
+#else /* CONFIG_TRACE_CBMEM */
+
+#define NO_TRACE	__attribute__((no_instrument_function))
+
+/* Deeper frames are counted but not kept for samples. */
+#define TRACE_MAX_DEPTH	64
+
+static struct trace_buffer *trace_buf;
+static uint64_t trace_period;
+static uint64_t trace_next_sample;
+static uint32_t trace_stack[TRACE_MAX_DEPTH];
+static int trace_depth;
+
+/*
+ * The hooks only record on the BSP. cpu_info() is open-coded because the
+ * inline function would be instrumented as well.
+ */
+static inline NO_TRACE int trace_on_this_cpu(void)
+{
+#if IS_ENABLED(CONFIG_ARCH_RAMSTAGE_X86_32)
+	struct cpu_info *ci;
+
+	__asm__("andl %%esp,%0; orl %2, %0"
+		: "=r" (ci)
+		: "0" (~(CONFIG_STACK_SIZE - 1)),
+		  "r" (CONFIG_STACK_SIZE - sizeof(struct cpu_info)));
+
+	return ci->index == 0;
+#else
+	return 1;
+#endif
+}
+
+static inline NO_TRACE void trace_add(uint64_t tsc, void *func, void *caller,
+				      int type, int depth)
+{
+	struct trace_record *r;
+
+	r = &trace_buf->records[trace_buf->written % trace_buf->num_records];
+	r->tsc = tsc;
+	r->func = (uintptr_t)func;
+	r->caller = (uintptr_t)caller;
+	r->type = type;
+	r->depth = depth;
+	trace_buf->written++;
+}
+
+static NO_TRACE void trace_sample(uint64_t tsc, void *func, void *caller)
+{
+	int depth = MIN(trace_depth, TRACE_MAX_DEPTH);
+	int i;
+
+	if (tsc < trace_next_sample)
+		return;
+	trace_next_sample = tsc + trace_period;
+
+	trace_add(tsc, func, caller, TRACE_SAMPLE, depth);
+	for (i = 0; i < depth; i++)
+		trace_add(tsc, (void *)(uintptr_t)trace_stack[i], NULL,
+			  TRACE_FRAME, i);
+}
+
+void __cyg_profile_func_enter(void *func, void *callsite)
+{
+	uint64_t tsc;
+
+	if (trace_dis || trace_buf == NULL || !trace_on_this_cpu())
+		return;
+
+	DISABLE_TRACE
+	tsc = timestamp_get();
+
+	if (trace_depth < TRACE_MAX_DEPTH)
+		trace_stack[trace_depth] = (uintptr_t)func;
+
+	if (trace_buf->mode == TRACE_MODE_SAMPLES) {
+		trace_depth++;
+		trace_sample(tsc, func, callsite);
+	} else {
+		trace_add(tsc, func, callsite, TRACE_ENTER, trace_depth);
+		trace_depth++;
+	}
+	ENABLE_TRACE
+}
+
+void __cyg_profile_func_exit(void *func, void *callsite)
+{
+	if (trace_dis || trace_buf == NULL || !trace_on_this_cpu())
+		return;
+
+	DISABLE_TRACE
+	if (trace_depth > 0)
+		trace_depth--;
+
+	if (trace_buf->mode == TRACE_MODE_CALLS)
+		trace_add(timestamp_get(), func, callsite, TRACE_EXIT,
+			  trace_depth);
+	ENABLE_TRACE
+}
+
+static void trace_init(int is_recovery)
+{
+	struct trace_buffer *buf;
+	size_t size = CONFIG_TRACE_CBMEM_SIZE;
+
+	buf = cbmem_add(CBMEM_ID_TRACE, size);
+	if (buf == NULL) {
+		printk(BIOS_ERR, "Trace: could not allocate buffer\n");
+		return;
+	}
+
+	buf->num_records = (size - sizeof(*buf)) / sizeof(buf->records[0]);
+	buf->written = 0;
+	buf->tick_freq_mhz = timestamp_tick_freq_mhz();
+	buf->reserved = 0;
+
+	if (CONFIG_TRACE_SAMPLE_PERIOD_US) {
+		buf->mode = TRACE_MODE_SAMPLES;
+		trace_period = (uint64_t)CONFIG_TRACE_SAMPLE_PERIOD_US *
+			       buf->tick_freq_mhz;
+	} else {
+		buf->mode = TRACE_MODE_CALLS;
+	}
+
+	/* The calls leading here are not known, start from the bottom. */
+	trace_depth = 0;
+	trace_buf = buf;
+}
+
+RAMSTAGE_CBMEM_INIT_HOOK(trace_init)
+
+#endif /* CONFIG_TRACE_CBMEM */
@@ -199,10 +199,10 @@ static void asmlinkage cpu_smm_do_relocation(void *arg)
 	wrmsr(SMRR_PHYS_MASK, smrr);
 
 	/* The relocated handler runs with all CPUs concurrently. Therefore
-	 * stagger the entry points adjusting SMBASE downwards by save state
-	 * size * CPU num. */
+	 * stagger the entry points as laid out by the SMM module
+	 * loader. */
 	smm_state = (void *)(SMM_EM64T100_SAVE_STATE_OFFSET + runtime->smbase);
-	smm_state->smbase = relo_attrs.smbase - cpu * runtime->save_state_size;
+	smm_state->smbase = smm_get_cpu_smbase(cpu);
 	printk(BIOS_DEBUG, "New SMBASE 0x%08x\n", smm_state->smbase);
 }
 
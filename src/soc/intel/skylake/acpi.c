@@ -21,6 +21,7 @@
 #include <arch/io.h>
 #include <arch/ioapic.h>
 #include <arch/smp/mpspec.h>
+#include <arch/table_cache.h>
 #include <cbmem.h>
 #include <chip.h>
 #include <console/console.h>
@@ -482,6 +483,21 @@ static void generate_p_state_entries(int core, int cores_per_package)
 	acpigen_pop_len();
 }
 
+/* The MSRs generate_P_state_entries() reads, see table_cache.h. */
+const u32 *table_cache_cpu_msrs(size_t *count)
+{
+	static const u32 msrs[] = {
+		MSR_IA32_MISC_ENABLES, MSR_MISC_PWR_MGMT, MSR_PLATFORM_INFO,
+		MSR_PKG_POWER_SKU_UNIT, MSR_PKG_POWER_SKU,
+		MSR_TURBO_RATIO_LIMIT,
+		/* Only exists with configurable TDP, so it goes last. */
+		MSR_CONFIG_TDP_NOMINAL,
+	};
+
+	*count = ARRAY_SIZE(msrs) - !cpu_config_tdp_levels();
+	return msrs;
+}
+
 void generate_cpu_entries(device_t device)
 {
 	int core_id, cpu_id, pcontrol_blk = ACPI_BASE_ADDRESS, plen = 6;
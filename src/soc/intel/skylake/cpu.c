@@ -401,6 +401,7 @@ static void enable_smis(void *unused)
 	 * Now that all APs have been relocated as well as the BSP let SMIs
 	 * start flowing.
 	 */
+	smm_wait_for_relocation(1000 /* 1 ms */);
 	southbridge_smm_enable_smi();
 
 	/* Lock down the SMRAM space. */
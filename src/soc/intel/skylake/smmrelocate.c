@@ -63,10 +63,10 @@ static void update_save_state(int cpu,
 
 	/*
 	 * The relocated handler runs with all CPUs concurrently. Therefore
-	 * stagger the entry points adjusting SMBASE downwards by save state
-	 * size * CPU num.
+	 * stagger the entry points as laid out by the SMM module
+	 * loader.
 	 */
-	smbase = relo_params->smram_base - cpu * runtime->save_state_size;
+	smbase = smm_get_cpu_smbase(cpu);
 	iedbase = relo_params->ied_base;
 
 	printk(BIOS_DEBUG, "New SMBASE=0x%08x IEDBASE=0x%08x\n",
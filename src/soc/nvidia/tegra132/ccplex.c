@@ -71,10 +71,8 @@ static int ccplex_start(void)
 
 int ccplex_load_mts(void)
 {
-	ssize_t nread;
+	size_t nread;
 	struct stopwatch sw;
-	struct cbfsf mts_file;
-	struct region_device fh;
 
 	/*
 	 * MTS location is hard coded to this magic address. The hardware will
@@ -84,19 +82,11 @@ int ccplex_load_mts(void)
 	void * const mts = (void *)(uintptr_t)MTS_LOAD_ADDRESS;
 
 	stopwatch_init(&sw);
-	if (cbfs_boot_locate(&mts_file, MTS_FILE_NAME, NULL)) {
-		printk(BIOS_DEBUG, "MTS file not found: %s\n", MTS_FILE_NAME);
-		return -1;
-	}
-
-	cbfs_file_data(&fh, &mts_file);
-
-	/* Read MTS file into the carveout region. */
-	nread = rdev_readat(&fh, mts, 0, region_device_sz(&fh));
+	/* Read MTS file into the carveout region, it has no size limit. */
+	nread = cbfs_boot_load_file(MTS_FILE_NAME, mts, ~(size_t)0, NULL);
 
-	if (nread != region_device_sz(&fh)) {
-		printk(BIOS_DEBUG, "MTS bytes read (%zu) != file length(%u)!\n",
-			nread, region_device_sz(&fh));
+	if (nread == 0) {
+		printk(BIOS_DEBUG, "MTS file not loaded: %s\n", MTS_FILE_NAME);
 		return -1;
 	}
 
@@ -27,27 +27,17 @@ static size_t mtc_table_size;
 
 int tegra210_run_mtc(void)
 {
-	ssize_t nread;
-	struct region_device fh;
-	struct cbfsf mtc_file;
+	size_t nread;
 
 	void * const mtc = (void *)(uintptr_t)CONFIG_MTC_ADDRESS;
 	void *dvfs_table;
 	size_t (*mtc_fw)(void **dvfs_table) = (void *)mtc;
 
-	if (cbfs_boot_locate(&mtc_file, "tegra_mtc.bin", NULL)) {
-		printk(BIOS_ERR, "MTC file not found: tegra_mtc.bin\n");
-		return -1;
-	}
-
-	cbfs_file_data(&fh, &mtc_file);
-
-	/* Read MTC file into predefined region. */
-	nread = rdev_readat(&fh, mtc, 0, region_device_sz(&fh));
+	/* Read MTC file into predefined region, it has no size limit. */
+	nread = cbfs_boot_load_file("tegra_mtc.bin", mtc, ~(size_t)0, NULL);
 
-	if (nread != region_device_sz(&fh)) {
-		printk(BIOS_ERR, "MTC bytes read (%zu) != file length(%zu)!\n",
-		       nread, region_device_sz(&fh));
+	if (nread == 0) {
+		printk(BIOS_ERR, "MTC file not loaded: tegra_mtc.bin\n");
 		return -1;
 	}
 
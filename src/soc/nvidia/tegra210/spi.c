@@ -897,12 +897,39 @@ tegra_spi_cbfs_read_exit:
 	return ret;
 }
 
+/*
+ * The controller only does x2 transfers with bit interleaving for received
+ * data, so this is limited to 1-1-2 reads.
+ */
+static int tegra_spi_xfer_multi_io(struct spi_slave *slave, const void *dout,
+		unsigned int out_bytes, unsigned int addr_lines, void *din,
+		unsigned int in_bytes, unsigned int data_lines)
+{
+	struct tegra_spi_channel *channel = to_tegra_spi(slave->bus);
+	int ret;
+
+	if (addr_lines != 1 || data_lines != 2)
+		return -1;
+
+	if (spi_xfer(slave, dout, out_bytes, NULL, 0) < 0)
+		return -1;
+
+	setbits_le32(&channel->regs->command1, SPI_CMD1_BOTH_EN_BIT);
+	ret = spi_xfer(slave, NULL, 0, din, in_bytes);
+	clrbits_le32(&channel->regs->command1, SPI_CMD1_BOTH_EN_BIT);
+
+	return ret;
+}
+
 struct spi_slave *spi_setup_slave(unsigned int bus, unsigned int cs)
 {
 	struct tegra_spi_channel *channel = to_tegra_spi(bus);
 	if (!channel)
 		return NULL;
 
+	channel->slave.read_modes = SPI_READ_MODE_1_1_2;
+	channel->slave.xfer_multi_io = tegra_spi_xfer_multi_io;
+
 	return &channel->slave;
 }
 
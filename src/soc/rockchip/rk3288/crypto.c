@@ -67,6 +67,8 @@ struct rk3288_crypto {
 } *crypto = (void *)CRYPTO_BASE;
 check_member(rk3288_crypto, trng_dout[7], 0x220);
 
+static int dma_pending;
+
 int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
 			       uint32_t data_size)
 {
@@ -76,6 +78,8 @@ int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
 		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
 	}
 
+	dma_pending = 0;
+
 	write32(&crypto->ctrl, RK_SETBITS(1 << 6));	/* Assert HASH_FLUSH */
 	udelay(1);					/* for 10+ cycles to */
 	write32(&crypto->ctrl, RK_CLRBITS(1 << 6));	/* clear out old hash */
@@ -93,24 +97,49 @@ int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
 	return VB2_SUCCESS;
 }
 
-int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size)
+/* Wait for the DMA started by the last digest_extend() call, if any. */
+static int hash_dma_wait(void)
 {
 	uint32_t intsts;
 
-	write32(&crypto->intsts, HRDMA_ERR | HRDMA_DONE); /* clear interrupts */
+	if (!dma_pending)
+		return VB2_SUCCESS;
 
-	/* NOTE: This assumes that the DMA is reading from uncached SRAM. */
-	write32(&crypto->hrdmas, (uint32_t)buf);
-	write32(&crypto->hrdmal, size / sizeof(uint32_t));
-	write32(&crypto->ctrl, RK_SETBITS(1 << 3));	/* Set HASH_START */
 	do {
 		intsts = read32(&crypto->intsts);
 		if (intsts & HRDMA_ERR) {
 			printk(BIOS_ERR, "ERROR: DMA error during HW crypto\n");
+			dma_pending = 0;
 			return VB2_ERROR_UNKNOWN;
 		}
 	} while (!(intsts & HRDMA_DONE));	/* wait for DMA to finish */
 
+	dma_pending = 0;
+	return VB2_SUCCESS;
+}
+
+/*
+ * With VBOOT_HWCRYPTO_ASYNC only start the DMA here and let it run while the
+ * caller reads the next block. The buffer must stay untouched until the next
+ * call to this function or to digest_finalize(), which is what hash_body()
+ * guarantees. Otherwise the DMA is done when this returns.
+ */
+int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size)
+{
+	if (hash_dma_wait())
+		return VB2_ERROR_UNKNOWN;
+
+	write32(&crypto->intsts, HRDMA_ERR | HRDMA_DONE); /* clear interrupts */
+
+	/* NOTE: This assumes that the DMA is reading from uncached SRAM. */
+	write32(&crypto->hrdmas, (uint32_t)buf);
+	write32(&crypto->hrdmal, size / sizeof(uint32_t));
+	write32(&crypto->ctrl, RK_SETBITS(1 << 3));	/* Set HASH_START */
+	dma_pending = 1;
+
+	if (!IS_ENABLED(CONFIG_VBOOT_HWCRYPTO_ASYNC))
+		return hash_dma_wait();
+
 	return VB2_SUCCESS;
 }
 
@@ -120,6 +149,9 @@ int vb2ex_hwcrypto_digest_finalize(uint8_t *digest, uint32_t digest_size)
 	uint32_t *src = crypto->hash_dout;
 	assert(digest_size == sizeof(crypto->hash_dout));
 
+	if (hash_dma_wait())
+		return VB2_ERROR_UNKNOWN;
+
 	while (!(read32(&crypto->hash_sts) & 0x1))
 		/* wait for crypto engine to set HASH_DONE bit */;
 
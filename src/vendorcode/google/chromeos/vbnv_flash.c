@@ -214,10 +214,11 @@ void save_vbnv_flash(const uint8_t *vbnv_copy)
 		}
 	}
 
+	/* Only the bytes that differ from what's in flash get programmed. */
 	if (!vbnv_flash_probe() &&
-	    !ctx->flash->write(ctx->flash,
-			       region_device_offset(&ctx->region) + new_offset,
-			       BLOB_SIZE, vbnv_copy)) {
+	    !spi_flash_update(ctx->flash,
+			      region_device_offset(&ctx->region) + new_offset,
+			      BLOB_SIZE, vbnv_copy, NULL)) {
 		/* write was successful. safely move pointer forward */
 		ctx->blob_offset = new_offset;
 		memcpy(ctx->cache, vbnv_copy, BLOB_SIZE);
@@ -96,7 +96,6 @@ static void vboot_prepare(void)
 		verstage_main();
 		car_set_var(vboot_executed, 1);
 	} else if (verstage_should_load()) {
-		struct cbfsf file;
 		struct prog verstage =
 			PROG_INIT(PROG_VERSTAGE,
 				CONFIG_CBFS_PREFIX "/verstage");
@@ -104,11 +103,9 @@ static void vboot_prepare(void)
 		printk(BIOS_DEBUG, "VBOOT: Loading verstage.\n");
 
 		/* load verstage from RO */
-		if (cbfs_boot_locate(&file, prog_name(&verstage), NULL))
+		if (cbfs_boot_locate_prog(&verstage, NULL))
 			die("failed to load verstage");
 
-		cbfs_file_data(prog_rdev(&verstage), &file);
-
 		if (cbfs_prog_stage_load(&verstage))
 			die("failed to load verstage");
 
@@ -151,6 +148,7 @@ static int vboot_locate(struct cbfs_props *props)
 
 	props->offset = region_offset(&selected_region);
 	props->size = region_sz(&selected_region);
+	props->verify_files = IS_ENABLED(CONFIG_VBOOT_CBFS_FILE_HASHES);
 
 	return 0;
 }
@@ -16,6 +16,7 @@
 #include <antirollback.h>
 #include <arch/exception.h>
 #include <assert.h>
+#include <cbfs.h>
 #include <console/console.h>
 #include <console/vtxprintf.h>
 #include <delay.h>
@@ -170,15 +171,93 @@ static int handle_digest_result(void *slot_hash, size_t slot_hash_sz)
 	return 0;
 }
 
+/* Read the next block of the body, accounting the time spent to loading. */
+static int read_body_block(struct region_device *fw_main, uint8_t *block,
+			   size_t offset, size_t size, uint64_t *load_ts)
+{
+	uint64_t temp_ts;
+
+	temp_ts = timestamp_get();
+	if (rdev_readat(fw_main, block, offset, size) < 0)
+		return -1;
+	*load_ts += timestamp_get() - temp_ts;
+
+	return 0;
+}
+
+/*
+ * With VBOOT_HWCRYPTO_ASYNC the body is double-buffered: block N+1 is read
+ * while the engine hashes block N. vb2ex_hwcrypto_digest_extend() may return
+ * before it is done with its buffer; that buffer is only refilled after the
+ * next extend call, which waits for it. Otherwise nothing can overlap and a
+ * single buffer keeps the reads as large as possible.
+ *
+ * The engine is only waited for in vb2api_check_hash_get_digest(), after
+ * hash_body_blocks() has returned, so the asynchronous buffers can't be on
+ * its stack.
+ */
+#if IS_ENABLED(CONFIG_VBOOT_HWCRYPTO_ASYNC)
+#define BODY_BUFFERS 2
+static uint8_t body_block[BODY_BUFFERS][TODO_BLOCK_SIZE / BODY_BUFFERS];
+#else
+#define BODY_BUFFERS 1
+#endif
+
+static int hash_body_blocks(struct vb2_context *ctx,
+			    struct region_device *fw_main, size_t size,
+			    uint64_t *load_ts, uint64_t *hash_ts)
+{
+#if IS_ENABLED(CONFIG_VBOOT_HWCRYPTO_ASYNC)
+	uint8_t (*block)[TODO_BLOCK_SIZE / BODY_BUFFERS] = body_block;
+#else
+	uint8_t block[BODY_BUFFERS][TODO_BLOCK_SIZE / BODY_BUFFERS];
+#endif
+	size_t block_size, next_size;
+	size_t offset;
+	int cur;
+	int rv;
+
+	cur = 0;
+	offset = 0;
+	block_size = MIN(sizeof(block[0]), size);
+	if (read_body_block(fw_main, block[cur], offset, block_size, load_ts))
+		return VB2_ERROR_UNKNOWN;
+
+	while (block_size) {
+		uint64_t temp_ts;
+
+		temp_ts = timestamp_get();
+		rv = vb2api_extend_hash(ctx, block[cur], block_size);
+		if (rv)
+			return rv;
+		*hash_ts += timestamp_get() - temp_ts;
+
+		size -= block_size;
+		offset += block_size;
+
+		cur = (cur + 1) % BODY_BUFFERS;
+		next_size = MIN(sizeof(block[0]), size);
+		if (next_size && read_body_block(fw_main, block[cur], offset,
+						 next_size, load_ts))
+			return VB2_ERROR_UNKNOWN;
+
+		block_size = next_size;
+	}
+
+	return VB2_SUCCESS;
+}
+
+static int extend_body_hash(void *arg, const void *buf, size_t size)
+{
+	return vb2api_extend_hash(arg, buf, size);
+}
+
 static int hash_body(struct vb2_context *ctx, struct region_device *fw_main)
 {
-	uint64_t load_ts;
+	uint64_t start_ts, load_ts, hash_ts;
 	uint32_t expected_size;
-	uint8_t block[TODO_BLOCK_SIZE];
 	uint8_t hash_digest[VBOOT_MAX_HASH_SIZE];
 	const size_t hash_digest_sz = sizeof(hash_digest);
-	size_t block_size = sizeof(block);
-	size_t offset;
 	int rv;
 
 	/* Clear the full digest so that any hash digests less than the
@@ -190,50 +269,55 @@ static int hash_body(struct vb2_context *ctx, struct region_device *fw_main)
 	 * we use this little trick to measure them separately and pretend it
 	 * was first loaded and then hashed in one piece with the timestamps.
 	 * (This split won't make sense with memory-mapped media like on x86.)
+	 * Reading and hashing are pipelined below, so with a hardware hash
+	 * engine TS_DONE_LOADING..TS_DONE_HASHING only covers the hashing
+	 * time that could not be hidden behind the reads.
 	 */
-	load_ts = timestamp_get();
-	timestamp_add(TS_START_HASH_BODY, load_ts);
+	start_ts = load_ts = timestamp_get();
+	timestamp_add(TS_START_HASH_BODY, start_ts);
+	hash_ts = 0;
 
 	expected_size = region_device_sz(fw_main);
-	offset = 0;
 
 	/* Start the body hash */
 	rv = vb2api_init_hash(ctx, VB2_HASH_TAG_FW_BODY, &expected_size);
 	if (rv)
 		return rv;
 
-	/*
-	 * Honor vboot's RW slot size. The expected size is pulled out of
-	 * the preamble and obtained through vb2api_init_hash() above. By
-	 * creating sub region the RW slot portion of the boot media is
-	 * limited.
-	 */
-	if (rdev_chain(fw_main, fw_main, 0, expected_size)) {
-		printk(BIOS_ERR, "Unable to restrict CBFS size.\n");
-		return VB2_ERROR_UNKNOWN;
-	}
-
-	/* Extend over the body */
-	while (expected_size) {
-		uint64_t temp_ts;
-		if (block_size > expected_size)
-			block_size = expected_size;
-
-		temp_ts = timestamp_get();
-		if (rdev_readat(fw_main, block, offset, block_size) < 0)
+	if (IS_ENABLED(CONFIG_VBOOT_CBFS_FILE_HASHES)) {
+		/*
+		 * The body signature only covers the CBFS metadata. The
+		 * contents of each file are checked against the hash
+		 * attribute in there when the file gets loaded.
+		 */
+		rv = cbfs_extend_metadata(fw_main, extend_body_hash, ctx);
+		if (rv)
+			return rv;
+	} else {
+		/*
+		 * Honor vboot's RW slot size. The expected size is pulled out
+		 * of the preamble and obtained through vb2api_init_hash()
+		 * above. By creating sub region the RW slot portion of the
+		 * boot media is limited.
+		 */
+		if (rdev_chain(fw_main, fw_main, 0, expected_size)) {
+			printk(BIOS_ERR, "Unable to restrict CBFS size.\n");
 			return VB2_ERROR_UNKNOWN;
-		load_ts += timestamp_get() - temp_ts;
+		}
 
-		rv = vb2api_extend_hash(ctx, block, block_size);
+		rv = hash_body_blocks(ctx, fw_main, expected_size, &load_ts,
+				      &hash_ts);
 		if (rv)
 			return rv;
-
-		expected_size -= block_size;
-		offset += block_size;
 	}
 
 	timestamp_add(TS_DONE_LOADING, load_ts);
 	timestamp_add_now(TS_DONE_HASHING);
+	printk(BIOS_DEBUG, "Hashed %u byte body: read %llu, hash %llu, "
+	       "total %llu ticks\n", expected_size,
+	       (unsigned long long)(load_ts - start_ts),
+	       (unsigned long long)hash_ts,
+	       (unsigned long long)(timestamp_get() - start_ts));
 
 	/* Check the result (with RSA signature verification) */
 	rv = vb2api_check_hash_get_digest(ctx, hash_digest, hash_digest_sz);
@@ -63,8 +63,35 @@ void xdr_get_seg(struct cbfs_payload_segment *out,
 	out->mem_len = xdr_be.get32(&inheader);
 }
 
+/*
+ * Store len bytes of segment data at out, compressed unless that fails or
+ * makes the data bigger.
+ */
+static void fill_payload_segment(struct cbfs_payload_segment *seg,
+				 comp_func_ptr compress, enum comp_algo algo,
+				 char *data, uint32_t len, char *out)
+{
+	int clen;
+
+	if (compress(data, len, out, &clen) || (unsigned int)clen > len) {
+		WARN("Compression failed or would make the data bigger "
+		     "- disabled.\n");
+		seg->compression = 0;
+		seg->len = len;
+		memcpy(out, data, len);
+	} else {
+		seg->compression = algo;
+		seg->len = clen;
+	}
+}
+
+/*
+ * With a non-zero split_size, the file data of each PT_LOAD segment is
+ * stored as consecutive chunks of at most split_size bytes, compressed
+ * independently so that they can be decompressed in parallel.
+ */
 int parse_elf_to_payload(const struct buffer *input, struct buffer *output,
-			 enum comp_algo algo)
+			 enum comp_algo algo, uint32_t split_size)
 {
 	Elf64_Phdr *phdr;
 	Elf64_Ehdr ehdr;
@@ -127,6 +154,8 @@ int parse_elf_to_payload(const struct buffer *input, struct buffer *output,
 		isize += phdr[i].p_filesz;
 
 		segments++;
+		if (split_size && phdr[i].p_filesz > split_size)
+			segments += (phdr[i].p_filesz - 1) / split_size;
 	}
 	/* allocate the segment header array */
 	segs = calloc(segments, sizeof(*segs));
@@ -196,36 +225,36 @@ int parse_elf_to_payload(const struct buffer *input, struct buffer *output,
 			continue;
 		}
 
-		if (phdr[i].p_flags & PF_X)
-			segs[segments].type = PAYLOAD_SEGMENT_CODE;
-		else
-			segs[segments].type = PAYLOAD_SEGMENT_DATA;
-		segs[segments].load_addr = phdr[i].p_paddr;
-		segs[segments].mem_len = phdr[i].p_memsz;
-		segs[segments].offset = doffset;
-
-		/* If the compression failed or made the section is larger,
-		   use the original stuff */
-
-		int len;
-		if (compress((char *)&header[phdr[i].p_offset],
-			     phdr[i].p_filesz, output->data + doffset, &len) ||
-		    (unsigned int)len > phdr[i].p_filesz) {
-			WARN("Compression failed or would make the data bigger "
-			     "- disabled.\n");
-			segs[segments].compression = 0;
-			segs[segments].len = phdr[i].p_filesz;
-			memcpy(output->data + doffset,
-			       &header[phdr[i].p_offset], phdr[i].p_filesz);
-		} else {
-			segs[segments].compression = algo;
-			segs[segments].len = len;
-		}
+		uint32_t chunk = phdr[i].p_filesz;
+		uint32_t done, len;
+
+		if (split_size && split_size < chunk)
+			chunk = split_size;
+
+		for (done = 0; done < phdr[i].p_filesz; done += len) {
+			len = MIN(chunk, phdr[i].p_filesz - done);
+
+			if (phdr[i].p_flags & PF_X)
+				segs[segments].type = PAYLOAD_SEGMENT_CODE;
+			else
+				segs[segments].type = PAYLOAD_SEGMENT_DATA;
+			segs[segments].load_addr = phdr[i].p_paddr + done;
+			/* The last chunk also covers the zero filled tail. */
+			if (done + len == phdr[i].p_filesz)
+				segs[segments].mem_len = phdr[i].p_memsz - done;
+			else
+				segs[segments].mem_len = len;
+			segs[segments].offset = doffset;
 
-		doffset += segs[segments].len;
-		osize += segs[segments].len;
+			fill_payload_segment(&segs[segments], compress, algo,
+					&header[phdr[i].p_offset + done], len,
+					output->data + doffset);
 
-		segments++;
+			doffset += segs[segments].len;
+			osize += segs[segments].len;
+
+			segments++;
+		}
 	}
 
 	segs[segments].type = PAYLOAD_SEGMENT_ENTRY;
@@ -15,10 +15,14 @@
 
 #include <commonlib/cbfs.h>
 #include <commonlib/region.h>
+#include <stdlib.h>
+#include <string.h>
 
 int cbfs_calculate_hash(void *cbfs, size_t cbfs_sz,
 			enum vb2_hash_algorithm hash_algo,
 			void *digest, size_t digest_sz);
+int cbfs_metadata_stream(void *cbfs, size_t cbfs_sz, void **stream,
+			size_t *stream_sz);
 
 int cbfs_calculate_hash(void *cbfs, size_t cbfs_sz,
 			enum vb2_hash_algorithm hash_algo,
@@ -31,3 +35,43 @@ int cbfs_calculate_hash(void *cbfs, size_t cbfs_sz,
 	return cbfs_vb2_hash_contents(&mdev.rdev,
 				hash_algo, digest, digest_sz);
 }
+
+struct metadata_stream {
+	uint8_t *data;
+	size_t size;
+};
+
+static int metadata_stream_append(void *arg, const void *buf, size_t sz)
+{
+	struct metadata_stream *ms = arg;
+	uint8_t *data;
+
+	data = realloc(ms->data, ms->size + sz);
+	if (data == NULL)
+		return -1;
+
+	memcpy(data + ms->size, buf, sz);
+	ms->data = data;
+	ms->size += sz;
+
+	return 0;
+}
+
+int cbfs_metadata_stream(void *cbfs, size_t cbfs_sz, void **stream,
+			size_t *stream_sz)
+{
+	struct mem_region_device mdev;
+	struct metadata_stream ms = { NULL, 0 };
+
+	mem_region_device_init(&mdev, cbfs, cbfs_sz);
+
+	if (cbfs_extend_metadata(&mdev.rdev, metadata_stream_append, &ms)) {
+		free(ms.data);
+		return -1;
+	}
+
+	*stream = ms.data;
+	*stream_sz = ms.size;
+
+	return 0;
+}
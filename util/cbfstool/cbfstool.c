@@ -67,6 +67,7 @@ static struct param {
 	uint32_t size;
 	uint32_t alignment;
 	uint32_t pagesize;
+	uint32_t split_size;
 	uint32_t cbfsoffset;
 	uint32_t cbfsoffset_assigned;
 	uint32_t arch;
@@ -524,7 +525,8 @@ static int cbfstool_convert_mkpayload(struct buffer *buffer,
 	struct buffer output;
 	int ret;
 	/* per default, try and see if payload is an ELF binary */
-	ret = parse_elf_to_payload(buffer, &output, param.compression);
+	ret = parse_elf_to_payload(buffer, &output, param.compression,
+				   param.split_size);
 
 	/* If it's not an ELF, see if it's a UEFI FV */
 	if (ret != 0)
@@ -850,6 +852,8 @@ static int cbfs_print(void)
 int cbfs_calculate_hash(void *cbfs, size_t cbfs_sz,
 			enum vb2_hash_algorithm hash_algo,
 			void *digest, size_t digest_sz);
+int cbfs_metadata_stream(void *cbfs, size_t cbfs_sz, void **stream,
+			size_t *stream_sz);
 
 static int cbfs_hash(void)
 {
@@ -1000,6 +1004,36 @@ static int cbfs_read(void)
 	return buffer_write_file(param.image_region, param.filename);
 }
 
+static int cbfs_read_metadata(void)
+{
+	struct buffer metadata;
+	void *stream;
+	size_t stream_sz;
+	int ret;
+
+	if (!param.filename) {
+		ERROR("You need to specify a valid output -f/--file.\n");
+		return 1;
+	}
+	if (!partitioned_file_is_partitioned(param.image_file)) {
+		ERROR("This operation isn't valid on legacy images having CBFS master headers\n");
+		return 1;
+	}
+
+	if (cbfs_metadata_stream(buffer_get(param.image_region),
+				buffer_size(param.image_region),
+				&stream, &stream_sz)) {
+		ERROR("Couldn't walk CBFS metadata (are all files hashed?)\n");
+		return 1;
+	}
+
+	buffer_init(&metadata, NULL, stream, stream_sz);
+	ret = buffer_write_file(&metadata, param.filename);
+	free(stream);
+
+	return ret;
+}
+
 static int cbfs_update_fit(void)
 {
 	if (!param.name) {
@@ -1068,7 +1102,7 @@ static const struct command commands[] = {
 	{"add", "H:r:f:n:t:c:b:a:vA:gh?", cbfs_add, true, true},
 	{"add-flat-binary", "H:r:f:n:l:e:c:b:vA:gh?", cbfs_add_flat_binary,
 				true, true},
-	{"add-payload", "H:r:f:n:t:c:b:C:I:vA:gh?", cbfs_add_payload,
+	{"add-payload", "H:r:f:n:t:c:b:C:I:z:vA:gh?", cbfs_add_payload,
 				true, true},
 	{"add-stage", "a:H:r:f:n:t:c:b:P:S:yvA:gh?", cbfs_add_stage,
 				true, true},
@@ -1082,6 +1116,7 @@ static const struct command commands[] = {
 	{"layout", "wvh?", cbfs_layout, false, false},
 	{"print", "H:r:vkh?", cbfs_print, true, false},
 	{"read", "r:f:vh?", cbfs_read, true, false},
+	{"read-metadata", "r:f:vh?", cbfs_read_metadata, true, false},
 	{"remove", "H:r:n:vh?", cbfs_remove, true, true},
 	{"update-fit", "H:r:n:x:vh?", cbfs_update_fit, true, true},
 	{"write", "r:f:udvh?", cbfs_write, true, true},
@@ -1113,6 +1148,7 @@ static struct option long_options[] = {
 	{"offset",        required_argument, 0, 'o' },
 	{"page-size",     required_argument, 0, 'P' },
 	{"size",          required_argument, 0, 's' },
+	{"split-size",    required_argument, 0, 'z' },
 	{"top-aligned",   required_argument, 0, 'T' },
 	{"type",          required_argument, 0, 't' },
 	{"verbose",       no_argument,       0, 'v' },
@@ -1192,7 +1228,7 @@ static void usage(char *name)
 	     "        [-c compression] [-b base-address | -a alignment]    "
 			"Add a component\n"
 	     " add-payload [-r image,regions] -f FILE -n NAME [-A hash] \\\n"
-	     "        [-c compression] [-b base-address] \\\n"
+	     "        [-c compression] [-b base-address] [-z split-size] \\\n"
 	     "        (linux specific: [-C cmdline] [-I initrd])           "
 			"Add a payload to the ROM\n"
 	     " add-stage [-r image,regions] -f FILE -n NAME [-A hash] \\\n"
@@ -1233,6 +1269,8 @@ static void usage(char *name)
 			"Write file into same-size [or larger] raw region\n"
 	     " read [-r fmap-region] -f file                               "
 			"Extract raw region contents into binary file\n"
+	     " read-metadata [-r fmap-region] -f file                      "
+			"Write the CBFS metadata stream into binary file\n"
 	     " update-fit [-r image,regions] -n MICROCODE_BLOB_NAME \\\n"
 	     "        -x EMTPY_FIT_ENTRIES                                 "
 			"Updates the FIT table with microcode entries\n"
@@ -1367,6 +1405,15 @@ int main(int argc, char **argv)
 					param.size *= 1024 * 1024;
 				}
 				break;
+			case 'z':
+				param.split_size = strtoul(optarg, &suffix, 0);
+				if (tolower((int)suffix[0])=='k') {
+					param.split_size *= 1024;
+				}
+				if (tolower((int)suffix[0])=='m') {
+					param.split_size *= 1024 * 1024;
+				}
+				break;
 			case 'B':
 				param.bootblock = optarg;
 				break;
@@ -178,7 +178,7 @@ uint64_t intfiletype(const char *name);
 
 /* cbfs-mkpayload.c */
 int parse_elf_to_payload(const struct buffer *input, struct buffer *output,
-			 enum comp_algo algo);
+			 enum comp_algo algo, uint32_t split_size);
 int parse_fv_to_payload(const struct buffer *input, struct buffer *output,
 			enum comp_algo algo);
 int parse_bzImage_to_payload(const struct buffer *input,
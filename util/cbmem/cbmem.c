@@ -31,8 +31,10 @@
 #include <sys/mman.h>
 #include <libgen.h>
 #include <assert.h>
+#include <elf.h>
 #include <commonlib/cbmem_id.h>
 #include <commonlib/timestamp_serialized.h>
+#include <commonlib/trace_serialized.h>
 #include <commonlib/coreboot_tables.h>
 
 #ifdef __OpenBSD__
@@ -502,6 +504,11 @@ static const struct timestamp_id_to_name {
 	{ TS_END_ULZMA,		"finished LZMA decompress (ignore for x86)" },
 	{ TS_START_ULZ4F,	"starting LZ4 decompress (ignore for x86)" },
 	{ TS_END_ULZ4F,		"finished LZ4 decompress (ignore for x86)" },
+	{ TS_START_STAGE_CACHE,	"starting to load stage from cache" },
+	{ TS_END_STAGE_CACHE,	"finished loading stage from cache" },
+	{ TS_START_MP_INIT,	"starting MP init" },
+	{ TS_MP_APS_STARTED,	"APs started" },
+	{ TS_END_MP_INIT,	"finished MP init" },
 	{ TS_DEVICE_ENUMERATE,	"device enumeration" },
 	{ TS_DEVICE_CONFIGURE,	"device configuration" },
 	{ TS_DEVICE_ENABLE,	"device enable" },
@@ -969,6 +976,268 @@ static void dump_coverage(void)
 	unmap_memory();
 }
 
+/* Function symbols of the traced stage, sorted by address. */
+struct trace_symbol {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;
+};
+
+static struct trace_symbol *trace_syms;
+static size_t trace_num_syms;
+
+static int trace_symbol_cmp(const void *a, const void *b)
+{
+	const struct trace_symbol *sa = a, *sb = b;
+
+	return sa->addr < sb->addr ? -1 : sa->addr > sb->addr;
+}
+
+static void trace_add_symbol(uint64_t addr, uint64_t size, const char *name)
+{
+	trace_syms = realloc(trace_syms,
+			     (trace_num_syms + 1) * sizeof(*trace_syms));
+	if (trace_syms == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	trace_syms[trace_num_syms].addr = addr;
+	trace_syms[trace_num_syms].size = size;
+	trace_syms[trace_num_syms].name = name;
+	trace_num_syms++;
+}
+
+/* Collect the function symbols of a 32 or 64 bit ELF file. */
+static int load_trace_symbols(const char *filename)
+{
+	struct stat st;
+	uint8_t *elf;
+	size_t i, j;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(filename);
+		return -1;
+	}
+	elf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (elf == MAP_FAILED || st.st_size < EI_NIDENT ||
+	    memcmp(elf, ELFMAG, SELFMAG)) {
+		fprintf(stderr, "%s is not an ELF file\n", filename);
+		return -1;
+	}
+
+#define LOAD_SYMBOLS(Ehdr, Shdr, Sym, ST_TYPE) do { \
+	const Ehdr *eh = (const void *)elf; \
+	const Shdr *sh = (const void *)(elf + eh->e_shoff); \
+	for (i = 0; i < eh->e_shnum; i++) { \
+		const Sym *sym; \
+		const char *strtab; \
+		if (sh[i].sh_type != SHT_SYMTAB) \
+			continue; \
+		sym = (const void *)(elf + sh[i].sh_offset); \
+		strtab = (const char *)elf + sh[sh[i].sh_link].sh_offset; \
+		for (j = 0; j < sh[i].sh_size / sizeof(*sym); j++) { \
+			if (ST_TYPE(sym[j].st_info) != STT_FUNC) \
+				continue; \
+			trace_add_symbol(sym[j].st_value, sym[j].st_size, \
+					 strtab + sym[j].st_name); \
+		} \
+	} \
+} while (0)
+
+	if (elf[EI_CLASS] == ELFCLASS64)
+		LOAD_SYMBOLS(Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, ELF64_ST_TYPE);
+	else
+		LOAD_SYMBOLS(Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, ELF32_ST_TYPE);
+
+#undef LOAD_SYMBOLS
+
+	if (trace_num_syms == 0) {
+		fprintf(stderr, "No function symbols in %s\n", filename);
+		return -1;
+	}
+
+	qsort(trace_syms, trace_num_syms, sizeof(*trace_syms),
+	      trace_symbol_cmp);
+	return 0;
+}
+
+/* Append the name of the function containing addr to buf. */
+static void trace_symbolize(char *buf, size_t size, uint32_t addr)
+{
+	size_t lo = 0, hi = trace_num_syms;
+	size_t len = strlen(buf);
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+
+		if (trace_syms[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if (addr == 0)
+		snprintf(buf + len, size - len, "[unknown]");
+	else if (trace_syms[lo].addr <= addr &&
+		 (addr == trace_syms[lo].addr ||
+		  addr < trace_syms[lo].addr + trace_syms[lo].size))
+		snprintf(buf + len, size - len, "%s", trace_syms[lo].name);
+	else
+		snprintf(buf + len, size - len, "0x%08x", addr);
+}
+
+/* Folded stacks with their weight, merged before printing. */
+struct trace_stack {
+	char *frames;
+	uint64_t weight;
+};
+
+static struct trace_stack *trace_stacks;
+static size_t trace_num_stacks;
+
+static void trace_add_stack(const uint32_t *funcs, int depth, uint64_t weight)
+{
+	char buf[4096] = "";
+	int i;
+
+	if (depth <= 0 || weight == 0)
+		return;
+
+	for (i = 0; i < depth; i++) {
+		if (i)
+			strncat(buf, ";", sizeof(buf) - strlen(buf) - 1);
+		trace_symbolize(buf, sizeof(buf), funcs[i]);
+	}
+
+	trace_stacks = realloc(trace_stacks,
+			       (trace_num_stacks + 1) * sizeof(*trace_stacks));
+	if (trace_stacks == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	trace_stacks[trace_num_stacks].frames = strdup(buf);
+	trace_stacks[trace_num_stacks].weight = weight;
+	trace_num_stacks++;
+}
+
+static int trace_stack_cmp(const void *a, const void *b)
+{
+	const struct trace_stack *sa = a, *sb = b;
+
+	return strcmp(sa->frames, sb->frames);
+}
+
+#define TRACE_MAX_DEPTH 256
+
+/*
+ * Print the trace buffer in the folded stack format of flamegraph.pl. Call
+ * traces are weighted by the microseconds spent in the innermost function,
+ * samples count once each.
+ */
+static void dump_trace(const char *elf_filename)
+{
+	const struct trace_buffer *tb;
+	uint32_t stack[TRACE_MAX_DEPTH];
+	uint64_t start, prev_tsc = 0;
+	int have_prev = 0;
+	uint32_t i, first, count;
+	size_t size;
+	int depth = 0;
+	int frames = -1;
+	int freq;
+	int mode;
+
+	if (load_trace_symbols(elf_filename))
+		return;
+
+	if (find_cbmem_entry(CBMEM_ID_TRACE, &start, &size)) {
+		fprintf(stderr, "No trace buffer found\n");
+		return;
+	}
+
+	tb = map_memory_size(start, size, 1);
+	if (sizeof(*tb) + tb->num_records * sizeof(tb->records[0]) > size) {
+		fprintf(stderr, "Trace buffer is corrupted\n");
+		unmap_memory();
+		return;
+	}
+
+	if (tb->written > tb->num_records) {
+		count = tb->num_records;
+		first = tb->written % tb->num_records;
+	} else {
+		count = tb->written;
+		first = 0;
+	}
+	freq = tb->tick_freq_mhz ? tb->tick_freq_mhz : 1;
+	mode = tb->mode;
+	memset(stack, 0, sizeof(stack));
+
+	for (i = 0; i < count; i++) {
+		const struct trace_record *r;
+		int d;
+
+		r = &tb->records[(first + i) % tb->num_records];
+		d = r->depth < TRACE_MAX_DEPTH ? r->depth : TRACE_MAX_DEPTH - 1;
+
+		switch (r->type) {
+		case TRACE_ENTER:
+		case TRACE_EXIT:
+			/* The time since the last event went to the top. */
+			if (have_prev && r->tsc >= prev_tsc)
+				trace_add_stack(stack, depth,
+						r->tsc - prev_tsc);
+			prev_tsc = r->tsc;
+			have_prev = 1;
+			stack[d] = r->func;
+			depth = r->type == TRACE_ENTER ? d + 1 : d;
+			break;
+		case TRACE_SAMPLE:
+			frames = d;
+			depth = 0;
+			/* A sample without frames at the bottom of the stack. */
+			if (frames == 0) {
+				stack[0] = r->func;
+				trace_add_stack(stack, 1, 1);
+				frames = -1;
+			}
+			break;
+		case TRACE_FRAME:
+			/* Frames cut off by the ring wrapping are skipped. */
+			if (frames < 0 || d != depth)
+				break;
+			stack[depth++] = r->func;
+			if (depth == frames) {
+				trace_add_stack(stack, depth, 1);
+				frames = -1;
+			}
+			break;
+		}
+	}
+
+	unmap_memory();
+
+	qsort(trace_stacks, trace_num_stacks, sizeof(*trace_stacks),
+	      trace_stack_cmp);
+	for (i = 0; i < trace_num_stacks; i++) {
+		uint64_t weight = trace_stacks[i].weight;
+
+		while (i + 1 < trace_num_stacks &&
+		       !strcmp(trace_stacks[i].frames,
+			       trace_stacks[i + 1].frames))
+			weight += trace_stacks[++i].weight;
+
+		if (mode == TRACE_MODE_CALLS)
+			weight /= freq;
+		if (weight)
+			printf("%s %" PRIu64 "\n", trace_stacks[i].frames,
+			       weight);
+	}
+}
+
 static void print_version(void)
 {
 	printf("cbmem v%s -- ", CBMEM_VERSION);
@@ -985,10 +1254,12 @@ static void print_version(void)
 
 static void print_usage(const char *name)
 {
-	printf("usage: %s [-cCltTxVvh?]\n", name);
+	printf("usage: %s [-cCltTxVvh?] [-p ELF]\n", name);
 	printf("\n"
 	     "   -c | --console:                   print cbmem console\n"
 	     "   -C | --coverage:                  dump coverage information\n"
+	     "   -p | --profile ELF:               print the trace buffer as folded stacks\n"
+	     "                                     symbolized against the stage ELF\n"
 	     "   -l | --list:                      print cbmem table of contents\n"
 	     "   -x | --hexdump:                   print hexdump of cbmem area\n"
 	     "   -r | --rawdump ID:                print rawdump of specific ID (in hex) of cbtable\n"
@@ -1127,11 +1398,13 @@ int main(int argc, char** argv)
 	int print_timestamps = 0;
 	int machine_readable_timestamps = 0;
 	unsigned int rawdump_id = 0;
+	const char *profile_elf = NULL;
 
 	int opt, option_index = 0;
 	static struct option long_options[] = {
 		{"console", 0, 0, 'c'},
 		{"coverage", 0, 0, 'C'},
+		{"profile", required_argument, 0, 'p'},
 		{"list", 0, 0, 'l'},
 		{"timestamps", 0, 0, 't'},
 		{"parseable-timestamps", 0, 0, 'T'},
@@ -1142,7 +1415,7 @@ int main(int argc, char** argv)
 		{"help", 0, 0, 'h'},
 		{0, 0, 0, 0}
 	};
-	while ((opt = getopt_long(argc, argv, "cCltTxVvh?r:",
+	while ((opt = getopt_long(argc, argv, "cCltTxVvh?r:p:",
 				  long_options, &option_index)) != EOF) {
 		switch (opt) {
 		case 'c':
@@ -1153,6 +1426,10 @@ int main(int argc, char** argv)
 			print_coverage = 1;
 			print_defaults = 0;
 			break;
+		case 'p':
+			profile_elf = optarg;
+			print_defaults = 0;
+			break;
 		case 'l':
 			print_list = 1;
 			print_defaults = 0;
@@ -1267,6 +1544,9 @@ int main(int argc, char** argv)
 	if (print_coverage)
 		dump_coverage();
 
+	if (profile_elf)
+		dump_trace(profile_elf);
+
 	if (print_list)
 		dump_cbmem_toc();
 
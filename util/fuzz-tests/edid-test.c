@@ -0,0 +1,183 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Runs src/lib/edid.c on the host. With one argument it decodes the file
+ * twice, the second time through the CBMEM cache, and aborts if the two
+ * results differ or the mode table is not sorted. With an iteration count
+ * it also reports the time per uncached and per cached decode.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#include "edid.h"
+
+static int verbose;
+static int cache_enabled = 1;
+static void *cache;
+
+/* Minimal stand-ins for the coreboot services edid.c uses. */
+int console_log_level(int msg_level)
+{
+	return verbose;
+}
+
+int do_printk(int msg_level, const char *fmt, ...)
+{
+	va_list args;
+	int i;
+
+	if (!verbose)
+		return 0;
+	va_start(args, fmt);
+	i = vprintf(fmt, args);
+	va_end(args);
+	return i;
+}
+
+void *cbmem_find(u32 id)
+{
+	return cache_enabled ? cache : NULL;
+}
+
+void *cbmem_add(u32 id, u64 size)
+{
+	if (!cache_enabled)
+		return NULL;
+	if (!cache)
+		cache = malloc(size);
+	return cache;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check_modes(const struct edid *e)
+{
+	unsigned int i;
+
+	if (e->num_modes > EDID_MAX_TIMINGS)
+		abort();
+	for (i = 1; i < e->num_modes; i++) {
+		const struct edid_timing *a = &e->modes[i - 1];
+		const struct edid_timing *b = &e->modes[i];
+
+		if ((b->flags & EDID_TIMING_PREFERRED) &&
+		    !(a->flags & EDID_TIMING_PREFERRED))
+			abort();
+	}
+}
+
+static void check_same(const struct edid *a, const struct edid *b)
+{
+	if (a->num_modes != b->num_modes ||
+	    memcmp(a->modes, b->modes, sizeof(a->modes)) ||
+	    a->mode.pixel_clock != b->mode.pixel_clock ||
+	    a->mode.ha != b->mode.ha || a->mode.va != b->mode.va ||
+	    a->x_resolution != b->x_resolution ||
+	    a->bytes_per_line != b->bytes_per_line ||
+	    a->hdmi_monitor_detected != b->hdmi_monitor_detected ||
+	    memcmp(a->mode_is_supported, b->mode_is_supported,
+		   sizeof(a->mode_is_supported)))
+		abort();
+}
+
+int main(int argc, char **argv)
+{
+	FILE *f;
+	long len, size;
+	unsigned char *buf, *work;
+	struct edid first, second;
+	int ret, i, iterations = 0;
+	double start;
+
+	if (argc < 2)
+		return 1;
+	if (argc > 2)
+		iterations = atoi(argv[2]);
+	verbose = getenv("EDID_VERBOSE") != NULL;
+
+	f = fopen(argv[1], "rb");
+	if (!f)
+		return 1;
+	if (fseek(f, 0, SEEK_END) != 0)
+		return 1;
+	len = ftell(f);
+	if (fseek(f, 0, SEEK_SET) != 0)
+		return 1;
+
+	/* The decoder reads whole 128 byte blocks, pad the input up to that. */
+	size = len < 128 ? 128 : (len + 127) & ~127;
+	buf = calloc(1, size);
+	work = malloc(size);
+	if (len && fread(buf, len, 1, f) != 1)
+		return 1;
+	fclose(f);
+
+	memcpy(work, buf, size);
+	ret = decode_edid(work, size, &first);
+	memcpy(work, buf, size);
+	if (decode_edid(work, size, &second) != ret)
+		abort();
+	check_modes(&first);
+	check_same(&first, &second);
+
+	for (i = 0; i < first.num_modes; i++)
+		printf("%4ux%-4u@%3uHz%s%s%s\n", first.modes[i].ha,
+		       first.modes[i].va, first.modes[i].refresh,
+		       first.modes[i].flags & EDID_TIMING_PREFERRED ?
+				" preferred" : "",
+		       first.modes[i].flags & EDID_TIMING_NATIVE ?
+				" native" : "",
+		       first.modes[i].flags & EDID_TIMING_DETAILED ?
+				" detailed" : "");
+
+	if (iterations <= 0)
+		return 0;
+
+	cache_enabled = 0;
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		memcpy(work, buf, size);
+		decode_edid(work, size, &second);
+	}
+	printf("uncached: %.0f ns/decode\n",
+	       (now() - start) * 1e9 / iterations);
+
+	cache_enabled = 1;
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		memcpy(work, buf, size);
+		decode_edid(work, size, &second);
+	}
+	printf("cached:   %.0f ns/decode\n",
+	       (now() - start) * 1e9 / iterations);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * The SPI flash and FMAP services elog.c uses, backed by the simulated flash
+ * of elog-test.c. Built against the coreboot headers.
+ */
+
+#include <fmap.h>
+#include <spi_flash.h>
+#include "elog-sim.h"
+
+static int flash_read(struct spi_flash *flash, u32 offset, size_t len,
+		      void *buf)
+{
+	return sim_read(offset, len, buf);
+}
+
+static int flash_write(struct spi_flash *flash, u32 offset, size_t len,
+		       const void *buf)
+{
+	return sim_write(offset, len, buf);
+}
+
+static int flash_erase(struct spi_flash *flash, u32 offset, size_t len)
+{
+	return sim_erase(offset, len);
+}
+
+static struct spi_flash flash = {
+	.name = "simulated",
+	.size = SIM_FLASH_SIZE,
+	.sector_size = SIM_SECTOR_SIZE,
+	.read = flash_read,
+	.write = flash_write,
+	.erase = flash_erase,
+};
+
+struct spi_flash *spi_flash_probe(unsigned int bus, unsigned int cs)
+{
+	return &flash;
+}
+
+/* Only the classic format rewrites the log. */
+int spi_flash_update(struct spi_flash *flash, u32 offset, size_t len,
+		     const void *buf, struct spi_flash_update_stats *stats)
+{
+	return -1;
+}
+
+int fmap_locate_area(const char *name, struct region *r)
+{
+	return -1;
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Shared by elog-test.c, which is built against libc, and elog-flash.c,
+ * which is built against the coreboot headers like elog.c.
+ */
+
+#ifndef ELOG_SIM_H
+#define ELOG_SIM_H
+
+#include <stddef.h>
+
+/* Must match CONFIG_ELOG_FLASH_BASE and CONFIG_ELOG_AREA_SIZE. */
+#define SIM_FLASH_SIZE		0x100000
+#define SIM_SECTOR_SIZE		0x1000
+#define SIM_ELOG_BASE		0x10000
+#define SIM_ELOG_SIZE		0x4000
+
+/* The simulated flash, implemented in elog-test.c. Return 0 on success. */
+int sim_read(unsigned int offset, size_t len, void *buf);
+int sim_write(unsigned int offset, size_t len, const void *buf);
+int sim_erase(unsigned int offset, size_t len);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Runs the segmented format of src/drivers/elog/elog.c on a simulated NOR
+ * flash and cuts the power during a boot, once at every flash write and
+ * sector erase it does. The interrupted operation either didn't start or
+ * changed the first half of its range. After each cut another boot has to
+ * add an event, and the log has to hold the newest event from before the
+ * interrupted boot and the new one, with all events in order.
+ *
+ * Every boot runs in a child process, so elog.c starts from scratch as it
+ * would after a reset. Only the flash is shared.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#define CONFIG_ELOG 1
+#include "elog.h"
+#include "elog_internal.h"
+#include "elog-sim.h"
+
+#define TEST_EVENT		ELOG_TYPE_OS_EVENT
+#define POWER_CUT_EXIT		3
+
+struct sim {
+	u8 flash[SIM_FLASH_SIZE];
+	long ops;		/* writes and sector erases so far */
+};
+
+static struct sim *sim;
+static int verbose;
+
+/* Per boot, in the child process. */
+static long power_cut = -1;	/* operation that loses power, -1 for none */
+static int torn;		/* it gets half done instead of not at all */
+
+int console_log_level(int msg_level)
+{
+	return verbose;
+}
+
+int do_printk(int msg_level, const char *fmt, ...)
+{
+	va_list args;
+	int i;
+
+	if (!verbose)
+		return 0;
+	va_start(args, fmt);
+	i = vprintf(fmt, args);
+	va_end(args);
+	return i;
+}
+
+static int in_range(unsigned int offset, size_t len)
+{
+	return offset <= SIM_FLASH_SIZE && len <= SIM_FLASH_SIZE - offset;
+}
+
+/* Count an operation. Returns how much of len it gets to do. */
+static size_t sim_op(size_t len)
+{
+	if (sim->ops++ != power_cut)
+		return len;
+
+	return torn ? len / 2 : 0;
+}
+
+static void sim_power_lost(void)
+{
+	if (verbose)
+		printf("power cut at operation %ld\n", power_cut);
+	_exit(POWER_CUT_EXIT);
+}
+
+int sim_read(unsigned int offset, size_t len, void *buf)
+{
+	if (!in_range(offset, len))
+		abort();
+	memcpy(buf, &sim->flash[offset], len);
+	return 0;
+}
+
+/* NOR flash: programming can only clear bits. */
+int sim_write(unsigned int offset, size_t len, const void *buf)
+{
+	const u8 *data = buf;
+	size_t i, done;
+
+	if (!in_range(offset, len))
+		abort();
+	done = sim_op(len);
+	for (i = 0; i < done; i++)
+		sim->flash[offset + i] &= data[i];
+	if (done != len)
+		sim_power_lost();
+	return 0;
+}
+
+int sim_erase(unsigned int offset, size_t len)
+{
+	size_t done;
+
+	if (!in_range(offset, len) || offset % SIM_SECTOR_SIZE ||
+	    len % SIM_SECTOR_SIZE)
+		abort();
+	for (; len; offset += SIM_SECTOR_SIZE, len -= SIM_SECTOR_SIZE) {
+		done = sim_op(SIM_SECTOR_SIZE);
+		memset(&sim->flash[offset], 0xff, done);
+		if (done != SIM_SECTOR_SIZE)
+			sim_power_lost();
+	}
+	return 0;
+}
+
+/*
+ * Boot once and add 'events' test events numbered from 'id'. Returns 1 if
+ * the power was cut, 0 otherwise.
+ */
+static int boot(u32 id, int events, long cut, int tear)
+{
+	int status, i;
+	pid_t pid;
+
+	sim->ops = 0;
+	pid = fork();
+	if (pid < 0)
+		abort();
+	if (pid == 0) {
+		power_cut = cut;
+		torn = tear;
+		for (i = 0; i < events; i++)
+			elog_add_event_dword(TEST_EVENT, id + i);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		abort();
+	if (WEXITSTATUS(status) == POWER_CUT_EXIT)
+		return 1;
+	if (WEXITSTATUS(status) != 0)
+		abort();
+	return 0;
+}
+
+static int valid_segment(const struct elog_segment_header *seg)
+{
+	return seg->header.magic == ELOG_SIGNATURE &&
+		seg->header.version == ELOG_SEGMENT_VERSION &&
+		seg->header.header_size == sizeof(*seg) &&
+		seg->sequence == (u32)~seg->sequence_inv;
+}
+
+/*
+ * Walk the valid segments by sequence number and their events up to the
+ * first one that doesn't check out. The test events have to be in order and
+ * include 'kept', unless it is 0, and end with 'newest'.
+ */
+static void check_log(const char *name, long cut, int tear, u32 kept,
+		      u32 newest)
+{
+	const u8 *area = &sim->flash[SIM_ELOG_BASE];
+	const int count = SIM_ELOG_SIZE / SIM_SECTOR_SIZE;
+	const struct elog_segment_header *seg;
+	int order[SIM_ELOG_SIZE / SIM_SECTOR_SIZE];
+	int n = 0, i, j, found_kept = 0;
+	u32 last = 0, id;
+
+	for (i = 0; i < count; i++) {
+		seg = (const void *)&area[i * SIM_SECTOR_SIZE];
+		if (!valid_segment(seg))
+			continue;
+		for (j = n; j > 0; j--) {
+			const struct elog_segment_header *prev = (const void *)
+				&area[order[j - 1] * SIM_SECTOR_SIZE];
+			if (prev->sequence < seg->sequence)
+				break;
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+		n++;
+	}
+
+	for (i = 0; i < n; i++) {
+		const u8 *base = &area[order[i] * SIM_SECTOR_SIZE];
+		size_t offset = sizeof(*seg);
+
+		while (offset + sizeof(struct event_header) < SIM_SECTOR_SIZE) {
+			const struct event_header *event = (const void *)
+				&base[offset];
+			u8 sum = 0;
+
+			if (event->type == ELOG_TYPE_EOL ||
+			    event->length < sizeof(*event) + 1 ||
+			    event->length > SIM_SECTOR_SIZE - offset)
+				break;
+			for (j = 0; j < event->length; j++)
+				sum += base[offset + j];
+			if (sum)
+				break;
+
+			if (event->type == TEST_EVENT) {
+				memcpy(&id, &event[1], sizeof(id));
+				if (id <= last) {
+					printf("%s: cut %ld%s: event %u after "
+					       "%u\n", name, cut,
+					       tear ? " torn" : "", id, last);
+					exit(1);
+				}
+				last = id;
+				found_kept |= id == kept;
+			}
+			offset += event->length;
+		}
+	}
+
+	if (last != newest || (kept && !found_kept)) {
+		printf("%s: cut %ld%s: newest event %u, expected %u, event %u "
+		       "%s\n", name, cut, tear ? " torn" : "", last, newest,
+		       kept, found_kept ? "kept" : "lost");
+		exit(1);
+	}
+}
+
+/*
+ * Fill the log with 'boots' boots of 'events' events, then cut the power at
+ * every operation of a boot adding 'cut_events' events.
+ */
+static void scenario(const char *name, int boots, int events, int cut_events)
+{
+	static u8 snapshot[SIM_FLASH_SIZE];
+	u32 id = 1, first;
+	long ops, cut;
+	int i, tear;
+
+	memset(sim->flash, 0xff, sizeof(sim->flash));
+	for (i = 0; i < boots; i++, id += events)
+		if (boot(id, events, -1, 0))
+			abort();
+
+	memcpy(snapshot, sim->flash, sizeof(snapshot));
+	first = id;
+	boot(first, cut_events, -1, 0);
+	ops = sim->ops;
+	check_log(name, -1, 0, first - 1, first + cut_events - 1);
+
+	for (cut = 0; cut < ops; cut++) {
+		for (tear = 0; tear < 2; tear++) {
+			memcpy(sim->flash, snapshot, sizeof(snapshot));
+			if (!boot(first, cut_events, cut, tear)) {
+				printf("%s: cut %ld not reached\n", name, cut);
+				exit(1);
+			}
+			id = first + cut_events;
+			if (boot(id, 1, -1, 0))
+				abort();
+			check_log(name, cut, tear, first - 1, id);
+		}
+	}
+
+	printf("%s: %ld power cuts recovered\n", name, ops * 2);
+}
+
+int main(int argc, char **argv)
+{
+	verbose = getenv("ELOG_VERBOSE") != NULL;
+
+	sim = mmap(NULL, sizeof(*sim), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sim == MAP_FAILED)
+		return 1;
+
+	/* The first boot writes the first segment header. */
+	scenario("empty", 0, 0, 4);
+	/* Crossing from the first into the second segment. */
+	scenario("next", 3, 100, 40);
+	/* Once the ring is full, crossing drops the oldest segment. */
+	scenario("wrap", 13, 100, 330);
+
+	return 0;
+}
@@ -18,6 +18,7 @@
 #include "jpeg.h"
 
 const int depth = 16;
+const int fb_width = 320, fb_height = 200;
 
 int main(int argc, char **argv)
 {
@@ -45,5 +46,12 @@ int main(int argc, char **argv)
 	char *pic = malloc(depth / 8 * width * height);
 	int ret = jpeg_decode(buf, pic, width, height, depth, decdata);
 	//printf("ret: %x\n", ret);
-	return ret;
+
+	/* Also decode into a padded framebuffer, clipped on both sides. */
+	const int pitch = depth / 8 * (fb_width + 7);
+	char *fb = malloc(pitch * fb_height);
+	int fbret = jpeg_decode_fb(buf, fb, fb_width, fb_height, pitch, depth,
+				   decdata);
+	//printf("fbret: %x\n", fbret);
+	return ret ? ret : fbret;
 }
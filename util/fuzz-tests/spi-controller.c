@@ -0,0 +1,137 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * A SPI controller and timer for spi_flash.c, connected to the simulated
+ * chip of spi-flash-test.c, and wrappers for the calls the test makes. Built
+ * against the coreboot headers.
+ */
+
+#include <spi-generic.h>
+#include <spi_flash.h>
+#include <stdlib.h>
+#include <string.h>
+#include <timer.h>
+#include "spi-sim.h"
+
+static struct spi_slave slave;
+static struct spi_flash *flash;
+
+/* What the controller of the next spi_setup_slave() supports */
+static unsigned int controller_read_modes;
+static unsigned int controller_max_transfer_size;
+
+static int xfer_multi_io(struct spi_slave *slave, const void *dout,
+			 unsigned int bytesout, unsigned int addr_lines,
+			 void *din, unsigned int bytesin,
+			 unsigned int data_lines)
+{
+	chip_xfer(dout, bytesout, addr_lines, din, bytesin, data_lines);
+	return 0;
+}
+
+struct spi_slave *spi_setup_slave(unsigned int bus, unsigned int cs)
+{
+	memset(&slave, 0, sizeof(slave));
+	slave.bus = bus;
+	slave.cs = cs;
+	slave.max_transfer_size = controller_max_transfer_size;
+	slave.read_modes = controller_read_modes;
+	if (controller_read_modes)
+		slave.xfer_multi_io = xfer_multi_io;
+	return &slave;
+}
+
+int spi_claim_bus(struct spi_slave *slave)
+{
+	chip_select(1);
+	return 0;
+}
+
+void spi_release_bus(struct spi_slave *slave)
+{
+	chip_select(0);
+}
+
+int spi_xfer(struct spi_slave *slave, const void *dout, unsigned int bytesout,
+	     void *din, unsigned int bytesin)
+{
+	chip_xfer(dout, bytesout, 1, din, bytesin, 1);
+	return 0;
+}
+
+unsigned int spi_crop_chunk(unsigned int cmd_len, unsigned int buf_len)
+{
+	if (!slave.max_transfer_size)
+		return buf_len;
+	return min(slave.max_transfer_size - cmd_len, buf_len);
+}
+
+void timer_monotonic_get(struct mono_time *mt)
+{
+	mono_time_set_usecs(mt, chip_time_us());
+}
+
+int sim_probe(unsigned int read_modes, unsigned int max_transfer_size)
+{
+	controller_read_modes = read_modes;
+	controller_max_transfer_size = max_transfer_size;
+	flash = spi_flash_probe(0, 0);
+	return flash ? 0 : -1;
+}
+
+int sim_erase_types(struct sim_erase_type *types)
+{
+	int i;
+
+	for (i = 0; i < flash->num_erase_types; i++) {
+		types[i].size = flash->erase_types[i].size;
+		types[i].opcode = flash->erase_types[i].opcode;
+		types[i].timeout = flash->erase_types[i].timeout;
+	}
+
+	return flash->num_erase_types;
+}
+
+void sim_read_mode(struct sim_read_mode *mode)
+{
+	mode->opcode = flash->read_mode.opcode;
+	mode->addr_lines = flash->read_mode.addr_lines;
+	mode->data_lines = flash->read_mode.data_lines;
+	mode->dummy_bytes = flash->read_mode.dummy_bytes;
+}
+
+int sim_flash_read(uint32_t offset, size_t len, void *buf)
+{
+	return flash->read(flash, offset, len, buf);
+}
+
+int sim_flash_erase(uint32_t offset, size_t len)
+{
+	return flash->erase(flash, offset, len);
+}
+
+int sim_flash_update(uint32_t offset, size_t len, const void *buf,
+		     struct sim_update_stats *stats)
+{
+	struct spi_flash_update_stats s;
+	int ret;
+
+	ret = spi_flash_update(flash, offset, len, buf, &s);
+	stats->erased = s.erased;
+	stats->programmed = s.programmed;
+	stats->skipped = s.skipped;
+	return ret;
+}
@@ -0,0 +1,1053 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Runs src/drivers/spi/spi_flash.c and winbond.c against a simulated W25Q16.
+ * The chip answers RDID, SFDP and status reads, reads in the multi-I/O modes
+ * its SFDP table lists, is busy for the typical time of each erase and page
+ * program and reports any command that a real part would reject or
+ * misinterpret: anything but a status read while busy, an erase or program
+ * without write enable, an erase that isn't aligned to its size, a read with
+ * the wrong lines or dummy bytes, a quad read with Quad Enable clear or a
+ * status register read the part doesn't have.
+ *
+ * The checks cover the erase types spi_flash_probe() takes from SFDP, the
+ * erase plans spi_flash_cmd_erase() makes with them, the read mode picked
+ * for each controller and part, and what spi_flash_update() falls back to
+ * for each kind of change.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spi-generic.h"
+#include "spi-sim.h"
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define KiB			1024
+#define CHIP_SIZE		(2 * 1024 * KiB)
+#define PAGE_SIZE		256
+#define POLL_US			20	/* time a status read takes */
+#define PROGRAM_US		700	/* time a page program takes */
+#define MAX_COMMAND		(4 + PAGE_SIZE)
+#define MAX_OPS			(CHIP_SIZE / (4 * KiB))
+
+#define CMD_RDID		0x9f
+#define CMD_RDSR		0x05
+#define CMD_RDSR2		0x35
+#define CMD_RDSR2_ALT		0x3f
+#define CMD_WREN		0x06
+#define CMD_PP			0x02
+#define CMD_READ		0x03
+#define CMD_FAST_READ		0x0b
+#define CMD_READ_SFDP		0x5a
+
+#define SFDP_BFPT		0x30	/* where the table sits in SFDP space */
+
+/* Fast reads in BFPT DWORD 1 */
+#define SFDP_1_1_2		(1 << 16)
+#define SFDP_1_4_4		(1 << 21)
+#define SFDP_1_1_4		(1 << 22)
+
+/* BFPT fast read descriptors: opcode, mode clocks, wait states */
+#define READ_DESC(opcode, mode, wait)	((opcode) << 8 | (mode) << 5 | (wait))
+#define DESC_1_4_4		READ_DESC(0xeb, 2, 4)
+#define DESC_1_1_4		READ_DESC(0x6b, 0, 8)
+#define DESC_1_1_2		READ_DESC(0x3b, 0, 8)
+
+/* The erase operations of the chip, whether SFDP lists them or not. */
+static const struct chip_erase {
+	u8 opcode;
+	u32 size;
+	u32 typ_ms;
+} chip_erases[] = {
+	{ 0x20, 4 * KiB, 32 },
+	{ 0x52, 32 * KiB, 128 },
+	{ 0xd8, 64 * KiB, 160 },
+};
+
+struct part {
+	const char *name;
+	int sfdp;		/* has SFDP */
+	u8 erase_types[4];	/* opcodes in BFPT order, 0 for an empty slot */
+	u8 mult;		/* maximum erase time is 2 * (mult + 1) * typical */
+	int slowdown;		/* erases take this % of typical, 0 for 100 */
+	u32 fast_reads;		/* SFDP_1_* read modes */
+	u16 desc_1_4_4;
+	u16 desc_1_1_4;
+	u16 desc_1_1_2;
+	int bfpt_dwords;	/* length of the BFPT, 0 for 16 */
+	int qer;		/* Quad Enable Requirements, BFPT DWORD 15 */
+	u8 sr1;			/* status registers, without WIP and WEL */
+	u8 sr2;
+};
+
+struct erase_op {
+	u8 opcode;
+	u32 offset;
+};
+
+static struct {
+	const struct part *part;
+	u8 mem[CHIP_SIZE];
+	u8 sfdp[SFDP_BFPT + 16 * 4];
+	long now_us;
+	long busy_until_us;
+	int wel;		/* write enable latch */
+	int selected;
+	u8 cmd[MAX_COMMAND];
+	size_t cmd_len;
+	size_t din_pos;
+	struct erase_op ops[MAX_OPS];
+	int num_ops;
+	int num_programs;
+	u8 read_opcode;		/* of the last array read */
+	int num_reads;
+	long clocks;		/* bus clocks spent on array reads */
+	char error[128];	/* first protocol violation */
+} chip;
+
+static u8 ref[CHIP_SIZE];
+static int verbose;
+
+int console_log_level(int msg_level)
+{
+	return verbose;
+}
+
+int do_printk(int msg_level, const char *fmt, ...)
+{
+	va_list args;
+	int i;
+
+	if (!verbose)
+		return 0;
+	va_start(args, fmt);
+	i = vprintf(fmt, args);
+	va_end(args);
+	return i;
+}
+
+static void chip_error(const char *fmt, ...)
+{
+	va_list args;
+
+	if (chip.error[0])
+		return;
+	va_start(args, fmt);
+	vsnprintf(chip.error, sizeof(chip.error), fmt, args);
+	va_end(args);
+}
+
+static int chip_busy(void)
+{
+	return chip.now_us < chip.busy_until_us;
+}
+
+static u32 chip_addr(void)
+{
+	return chip.cmd[1] << 16 | chip.cmd[2] << 8 | chip.cmd[3];
+}
+
+long chip_time_us(void)
+{
+	return chip.now_us;
+}
+
+static void chip_erase(const struct chip_erase *e)
+{
+	const u32 offset = chip_addr();
+	const int slowdown = chip.part->slowdown ? chip.part->slowdown : 100;
+
+	if (chip.cmd_len != 4) {
+		chip_error("erase %02x with %zu bytes", e->opcode, chip.cmd_len);
+		return;
+	}
+	if (!chip.wel) {
+		chip_error("erase %02x without write enable", e->opcode);
+		return;
+	}
+	if (offset % e->size) {
+		chip_error("erase %02x at misaligned %#x", e->opcode, offset);
+		return;
+	}
+
+	memset(&chip.mem[offset % CHIP_SIZE], 0xff, e->size);
+	chip.ops[chip.num_ops].opcode = e->opcode;
+	chip.ops[chip.num_ops].offset = offset;
+	if (chip.num_ops < MAX_OPS - 1)
+		chip.num_ops++;
+	chip.busy_until_us = chip.now_us + e->typ_ms * 10L * slowdown;
+	chip.wel = 0;
+}
+
+/* Like a real part, wrap around within the page. */
+static void chip_program(void)
+{
+	const u32 offset = chip_addr() % CHIP_SIZE;
+	const size_t len = chip.cmd_len - 4;
+	size_t i;
+
+	if (chip.cmd_len < 4) {
+		chip_error("page program with %zu bytes", chip.cmd_len);
+		return;
+	}
+	if (!chip.wel) {
+		chip_error("page program without write enable");
+		return;
+	}
+	if (offset % PAGE_SIZE + len > PAGE_SIZE) {
+		chip_error("page program across a page at %#x", offset);
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		chip.mem[offset + i] &= chip.cmd[4 + i];
+	chip.num_programs++;
+	chip.busy_until_us = chip.now_us + PROGRAM_US;
+	chip.wel = 0;
+}
+
+/* Commands without a data phase take effect when the chip is deselected. */
+static void chip_execute(void)
+{
+	int i;
+
+	if (!chip.cmd_len || chip.din_pos)
+		return;
+
+	if (chip_busy()) {
+		chip_error("command %02x while busy", chip.cmd[0]);
+		return;
+	}
+
+	if (chip.cmd[0] == CMD_WREN) {
+		chip.wel = 1;
+		return;
+	}
+	if (chip.cmd[0] == CMD_PP) {
+		chip_program();
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(chip_erases); i++)
+		if (chip.cmd[0] == chip_erases[i].opcode) {
+			chip_erase(&chip_erases[i]);
+			return;
+		}
+
+	chip_error("unknown command %02x", chip.cmd[0]);
+}
+
+void chip_select(int active)
+{
+	if (active == chip.selected) {
+		chip_error("chip select already %s", active ? "on" : "off");
+		return;
+	}
+	chip.selected = active;
+	if (active) {
+		chip.cmd_len = 0;
+		chip.din_pos = 0;
+	} else {
+		chip_execute();
+	}
+}
+
+static int chip_quad_enabled(void)
+{
+	switch (chip.part->qer) {
+	case 0:
+		return 1;
+	case 2:
+		return !!(chip.part->sr1 & (1 << 6));
+	case 3:
+		return !!(chip.part->sr2 & (1 << 7));
+	default:
+		return !!(chip.part->sr2 & (1 << 1));
+	}
+}
+
+/*
+ * Look up a multi-I/O read opcode in the SFDP table. Returns 0 if the part
+ * lists it, with its lines and dummy bytes.
+ */
+static int chip_read_mode(u8 opcode, unsigned int *addr_lines,
+			  unsigned int *data_lines, size_t *dummy_bytes)
+{
+	const struct {
+		u32 flag;
+		u16 desc;
+		unsigned int addr_lines, data_lines;
+	} modes[] = {
+		{ SFDP_1_4_4, chip.part->desc_1_4_4, 4, 4 },
+		{ SFDP_1_1_4, chip.part->desc_1_1_4, 1, 4 },
+		{ SFDP_1_1_2, chip.part->desc_1_1_2, 1, 2 },
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(modes); i++) {
+		const u16 desc = modes[i].desc;
+
+		if (!chip.part->sfdp || !(chip.part->fast_reads & modes[i].flag)
+		    || desc >> 8 != opcode)
+			continue;
+		*addr_lines = modes[i].addr_lines;
+		*data_lines = modes[i].data_lines;
+		*dummy_bytes = ((desc & 0x1f) + (desc >> 5 & 0x7)) *
+			modes[i].addr_lines / 8;
+		return 0;
+	}
+	return -1;
+}
+
+/* Check the lines and length of a command when its data phase starts. */
+static void chip_check_command(unsigned int addr_lines,
+			       unsigned int data_lines)
+{
+	unsigned int mode_addr_lines, mode_data_lines;
+	size_t dummy_bytes;
+
+	if (!chip_read_mode(chip.cmd[0], &mode_addr_lines, &mode_data_lines,
+			    &dummy_bytes)) {
+		if (addr_lines != mode_addr_lines ||
+		    data_lines != mode_data_lines ||
+		    chip.cmd_len != 4 + dummy_bytes)
+			chip_error("read %02x as 1-%u-%u with %zu bytes",
+				   chip.cmd[0], addr_lines, data_lines,
+				   chip.cmd_len);
+		if (mode_data_lines == 4 && !chip_quad_enabled())
+			chip_error("quad read %02x with QE clear",
+				   chip.cmd[0]);
+		return;
+	}
+
+	if (addr_lines != 1 || data_lines != 1)
+		chip_error("command %02x as 1-%u-%u", chip.cmd[0], addr_lines,
+			   data_lines);
+	if (chip.cmd[0] == CMD_RDSR2 &&
+	    (chip.part->qer == 1 || chip.part->qer == 4))
+		chip_error("status register 2 read with QER %d",
+			   chip.part->qer);
+	if (chip.cmd[0] == CMD_RDSR2_ALT && chip.part->qer != 3)
+		chip_error("status register 2 read with %02x, QER %d",
+			   chip.cmd[0], chip.part->qer);
+}
+
+static int chip_is_read(u8 opcode)
+{
+	unsigned int addr_lines, data_lines;
+	size_t dummy_bytes;
+
+	return opcode == CMD_READ || opcode == CMD_FAST_READ ||
+		!chip_read_mode(opcode, &addr_lines, &data_lines,
+				&dummy_bytes);
+}
+
+static u8 chip_read_byte(size_t pos)
+{
+	static const u8 id[] = { 0xef, 0x40, 0x15 };
+
+	switch (chip.cmd[0]) {
+	case CMD_RDID:
+		return pos < sizeof(id) ? id[pos] : 0;
+	case CMD_RDSR:
+		chip.now_us += POLL_US;
+		return (chip.part->sr1 & ~0x03) | (chip_busy() ? 0x01 : 0) |
+			(chip.wel ? 0x02 : 0);
+	case CMD_RDSR2:
+	case CMD_RDSR2_ALT:
+		return chip.part->sr2;
+	case CMD_READ_SFDP:
+		if (chip.cmd_len != 5)
+			chip_error("SFDP read with %zu bytes", chip.cmd_len);
+		if (!chip.part->sfdp || chip_addr() + pos >= sizeof(chip.sfdp))
+			return 0xff;
+		return chip.sfdp[chip_addr() + pos];
+	case CMD_READ:
+	case CMD_FAST_READ:
+		if (chip.cmd_len != (chip.cmd[0] == CMD_READ ? 4 : 5))
+			chip_error("read %02x with %zu bytes", chip.cmd[0],
+				   chip.cmd_len);
+		return chip.mem[(chip_addr() + pos) % CHIP_SIZE];
+	default:
+		/* chip_check_command() checked the multi-I/O reads. */
+		if (chip_is_read(chip.cmd[0]))
+			return chip.mem[(chip_addr() + pos) % CHIP_SIZE];
+		chip_error("unknown read command %02x", chip.cmd[0]);
+		return 0xff;
+	}
+}
+
+void chip_xfer(const void *dout, size_t bytesout, unsigned int addr_lines,
+	       void *din, size_t bytesin, unsigned int data_lines)
+{
+	u8 *data = din;
+	size_t i;
+
+	if (!chip.selected) {
+		chip_error("transfer without chip select");
+		return;
+	}
+
+	if (bytesout) {
+		if (chip.din_pos || chip.cmd_len + bytesout > MAX_COMMAND) {
+			chip_error("unexpected %zu byte output", bytesout);
+			return;
+		}
+		memcpy(&chip.cmd[chip.cmd_len], dout, bytesout);
+		chip.cmd_len += bytesout;
+	}
+
+	if (bytesin && !chip.cmd_len) {
+		chip_error("input without a command");
+		return;
+	}
+	if (bytesin && chip.cmd[0] != CMD_RDSR && chip_busy()) {
+		chip_error("command %02x while busy", chip.cmd[0]);
+		return;
+	}
+	if (bytesin && !chip.din_pos) {
+		chip_check_command(addr_lines, data_lines);
+		if (chip_is_read(chip.cmd[0])) {
+			chip.read_opcode = chip.cmd[0];
+			chip.num_reads++;
+			chip.clocks += 8 + (chip.cmd_len - 1) * 8 / addr_lines;
+		}
+	}
+	if (chip_is_read(chip.cmd[0]))
+		chip.clocks += bytesin * 8 / data_lines;
+	for (i = 0; i < bytesin; i++)
+		data[i] = chip_read_byte(chip.din_pos++);
+}
+
+static const struct chip_erase *find_erase(u8 opcode)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(chip_erases); i++)
+		if (chip_erases[i].opcode == opcode)
+			return &chip_erases[i];
+	abort();
+}
+
+static int log2_of(u32 x)
+{
+	int i;
+
+	for (i = 0; x > 1; i++)
+		x >>= 1;
+	return i;
+}
+
+/* BFPT DWORD 10 count and units for a typical erase time, in ms. */
+static u32 sfdp_erase_time(u32 ms)
+{
+	static const u32 unit_ms[] = { 1, 16, 128, 1000 };
+	u32 units;
+
+	for (units = 0; units < ARRAY_SIZE(unit_ms); units++)
+		if (ms % unit_ms[units] == 0 && ms / unit_ms[units] <= 32)
+			return (ms / unit_ms[units] - 1) | units << 5;
+	abort();
+}
+
+static void put_le32(u8 *p, u32 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void build_sfdp(const struct part *part)
+{
+	u32 dw[16];
+	int i;
+
+	memset(chip.sfdp, 0xff, sizeof(chip.sfdp));
+	memset(dw, 0, sizeof(dw));
+
+	/* SFDP header, then the BFPT parameter header, JESD216B */
+	memcpy(&chip.sfdp[0], "SFDP", 4);
+	chip.sfdp[4] = 6;
+	chip.sfdp[5] = 1;
+	chip.sfdp[6] = 0;
+	chip.sfdp[8] = 0x00;
+	chip.sfdp[9] = 6;
+	chip.sfdp[10] = 1;
+	chip.sfdp[11] = part->bfpt_dwords ? part->bfpt_dwords : ARRAY_SIZE(dw);
+	chip.sfdp[12] = SFDP_BFPT;
+	chip.sfdp[13] = 0;
+	chip.sfdp[14] = 0;
+	chip.sfdp[15] = 0xff;
+
+	dw[0] = 0x01 | 0x20 << 8 | part->fast_reads;	/* 4K erase, 20 */
+	dw[1] = CHIP_SIZE * 8 - 1;
+	dw[2] = part->desc_1_4_4 | part->desc_1_1_4 << 16;
+	dw[3] = part->desc_1_1_2;
+	dw[14] = part->qer << 20;
+	dw[9] = part->mult;
+	for (i = 0; i < 4; i++) {
+		const struct chip_erase *e;
+
+		if (!part->erase_types[i])
+			continue;
+		e = find_erase(part->erase_types[i]);
+		dw[7 + i / 2] |= (log2_of(e->size) | e->opcode << 8) <<
+			(16 * (i % 2));
+		dw[9] |= sfdp_erase_time(e->typ_ms) << (4 + 7 * i);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(dw); i++)
+		put_le32(&chip.sfdp[SFDP_BFPT + 4 * i], dw[i]);
+}
+
+static void check_chip(const char *what)
+{
+	if (chip.error[0]) {
+		printf("%s: %s: %s\n", chip.part->name, what, chip.error);
+		exit(1);
+	}
+}
+
+/*
+ * Power up the chip with ref as its contents and probe it through a
+ * controller with the given SPI_READ_MODE_* flags and transfer size limit.
+ */
+static void power_on(const struct part *part, unsigned int read_modes,
+		     unsigned int max_transfer_size)
+{
+	memset(&chip, 0, sizeof(chip));
+	chip.part = part;
+	memcpy(chip.mem, ref, sizeof(chip.mem));
+	if (part->sfdp)
+		build_sfdp(part);
+
+	if (sim_probe(read_modes, max_transfer_size)) {
+		printf("%s: probe failed\n", part->name);
+		exit(1);
+	}
+	check_chip("probe");
+}
+
+/* Compare the erase types found with 'expected', {size, opcode, timeout}. */
+static void check_erase_types(const struct part *part, const u32 *expected,
+			      int count)
+{
+	struct sim_erase_type types[4];
+	int i, n;
+
+	n = sim_erase_types(types);
+	for (i = 0; i < n && i < count; i++)
+		if (types[i].size != expected[3 * i] ||
+		    types[i].opcode != expected[3 * i + 1] ||
+		    types[i].timeout != expected[3 * i + 2])
+			break;
+	if (n != count || i != count) {
+		printf("%s: wrong erase type %d of %d\n", part->name, i, n);
+		exit(1);
+	}
+}
+
+/* The fewest erase operations covering [offset, offset + len). */
+static int min_erase_ops(const struct part *part, u32 offset, u32 len)
+{
+	static int best[CHIP_SIZE / (4 * KiB) + 1];
+	struct sim_erase_type types[4];
+	u32 pos, units = len / (4 * KiB);
+	int i, j, n;
+
+	n = sim_erase_types(types);
+	best[units] = 0;
+	for (i = units - 1; i >= 0; i--) {
+		pos = offset + i * 4 * KiB;
+		best[i] = MAX_OPS + 1;
+		for (j = 0; j < n; j++)
+			if (pos % types[j].size == 0 &&
+			    i + types[j].size / (4 * KiB) <= units &&
+			    best[i + types[j].size / (4 * KiB)] + 1 < best[i])
+				best[i] = best[i + types[j].size / (4 * KiB)] + 1;
+	}
+	return best[0];
+}
+
+/*
+ * Erase [offset, offset + len) and check that it took the fewest operations,
+ * in order, and changed nothing outside of the range. Restores the range
+ * from ref afterwards. Returns the number of operations.
+ */
+static int erase_range(const struct part *part, u32 offset, u32 len)
+{
+	u32 pos = offset;
+	int i;
+
+	chip.num_ops = 0;
+	if (sim_flash_erase(offset, len)) {
+		printf("%s: erase %#x+%#x failed\n", part->name, offset, len);
+		exit(1);
+	}
+	check_chip("erase");
+
+	for (i = 0; i < chip.num_ops; i++) {
+		if (chip.ops[i].offset != pos)
+			break;
+		pos += find_erase(chip.ops[i].opcode)->size;
+	}
+	if (i != chip.num_ops || pos != offset + len ||
+	    chip.num_ops != min_erase_ops(part, offset, len)) {
+		printf("%s: erase %#x+%#x: bad plan at op %d of %d\n",
+		       part->name, offset, len, i, chip.num_ops);
+		exit(1);
+	}
+
+	for (i = 0; i < len; i++)
+		if (chip.mem[offset + i] != 0xff)
+			break;
+	if (i != len || memcmp(chip.mem, ref, offset) ||
+	    memcmp(&chip.mem[offset + len], &ref[offset + len],
+		   CHIP_SIZE - offset - len)) {
+		printf("%s: erase %#x+%#x: wrong contents\n", part->name,
+		       offset, len);
+		exit(1);
+	}
+
+	memcpy(&chip.mem[offset], &ref[offset], len);
+	return chip.num_ops;
+}
+
+/* Compare the erase operations of the last erase with 'expected'. */
+static void check_plan(const struct part *part, const u8 *expected, int count)
+{
+	int i;
+
+	for (i = 0; i < count && i < chip.num_ops; i++)
+		if (chip.ops[i].opcode != expected[i])
+			break;
+	if (i != count || chip.num_ops != count) {
+		printf("%s: unexpected erase plan at op %d\n", part->name, i);
+		exit(1);
+	}
+}
+
+static void erase_random(const struct part *part, int rounds)
+{
+	u32 offset, len;
+	int i;
+
+	srand(1);
+	for (i = 0; i < rounds; i++) {
+		offset = rand() % (CHIP_SIZE / (4 * KiB)) * 4 * KiB;
+		len = (rand() % (128 + 1)) * 4 * KiB;
+		if (len > CHIP_SIZE - offset)
+			len = CHIP_SIZE - offset;
+		erase_range(part, offset, len);
+	}
+}
+
+/* Erases that aren't aligned to the smallest erase size must be refused. */
+static void erase_misaligned(const struct part *part)
+{
+	static const u32 ranges[][2] = {
+		{ 0x800, 0x1000 },
+		{ 0x1000, 0x800 },
+		{ 0x10000 - 0x100, 0x10000 },
+	};
+	int i;
+
+	chip.num_ops = 0;
+	for (i = 0; i < ARRAY_SIZE(ranges); i++)
+		if (!sim_flash_erase(ranges[i][0], ranges[i][1])) {
+			printf("%s: misaligned erase %#x+%#x accepted\n",
+			       part->name, ranges[i][0], ranges[i][1]);
+			exit(1);
+		}
+	check_chip("misaligned erase");
+	if (chip.num_ops) {
+		printf("%s: misaligned erase erased\n", part->name);
+		exit(1);
+	}
+}
+
+static void erase_1mib(const struct part *part)
+{
+	long start = chip.now_us;
+	int ops;
+
+	ops = erase_range(part, 0, 1024 * KiB);
+	printf("%s: 1 MiB erased with %d operations in %ld ms\n", part->name,
+	       ops, (chip.now_us - start) / 1000);
+}
+
+static void test_no_sfdp(void)
+{
+	static const struct part part = {
+		.name = "no SFDP",
+	};
+	/* The driver's sector erase with its generic timeout */
+	static const u32 types[] = { 4 * KiB, 0x20, 500 };
+
+	power_on(&part, 0, 0);
+	check_erase_types(&part, types, 1);
+	erase_1mib(&part);
+	erase_misaligned(&part);
+	erase_random(&part, 100);
+}
+
+static void test_sfdp(void)
+{
+	/* Listed out of order, the driver sorts them by size. */
+	static const struct part part = {
+		.name = "SFDP 4K/32K/64K",
+		.sfdp = 1,
+		.erase_types = { 0xd8, 0x20, 0, 0x52 },
+		.mult = 2,
+	};
+	/* Maximum times are 2 * (mult + 1) times the typical ones */
+	static const u32 types[] = {
+		4 * KiB, 0x20, 6 * 32,
+		32 * KiB, 0x52, 6 * 128,
+		64 * KiB, 0xd8, 6 * 160,
+	};
+	/* Unaligned head and tail around two 32K and one 64K block */
+	static const u8 plan[] = {
+		0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x52,
+		0xd8, 0x52, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	};
+	/* Only the head and the tail are unaligned */
+	static const u8 plan_head_tail[] = { 0x20, 0xd8, 0xd8, 0x20 };
+
+	power_on(&part, 0, 0);
+	check_erase_types(&part, types, ARRAY_SIZE(types) / 3);
+	erase_1mib(&part);
+
+	erase_range(&part, 0x1000, 0x2e000);
+	check_plan(&part, plan, ARRAY_SIZE(plan));
+	erase_range(&part, 0xf000, 0x22000);
+	check_plan(&part, plan_head_tail, ARRAY_SIZE(plan_head_tail));
+
+	erase_misaligned(&part);
+	erase_random(&part, 1000);
+}
+
+/*
+ * Callers align erases to the 4K sector size of the driver, so an SFDP
+ * table without an erase that small has to be ignored.
+ */
+static void test_sfdp_no_4k(void)
+{
+	static const struct part part = {
+		.name = "SFDP 64K only",
+		.sfdp = 1,
+		.erase_types = { 0xd8 },
+	};
+	static const u32 types[] = { 4 * KiB, 0x20, 500 };
+
+	power_on(&part, 0, 0);
+	check_erase_types(&part, types, 1);
+	erase_random(&part, 100);
+}
+
+/* A part slower than its SFDP maximum erase time has to time out. */
+static void test_erase_timeout(void)
+{
+	static const struct part part = {
+		.name = "slow part",
+		.sfdp = 1,
+		.erase_types = { 0x20, 0x52, 0xd8 },
+		.slowdown = 300,
+	};
+
+	power_on(&part, 0, 0);
+	if (!sim_flash_erase(0, 128 * KiB)) {
+		printf("%s: erase didn't time out\n", part.name);
+		exit(1);
+	}
+	check_chip("timed out erase");
+	if (chip.num_ops != 1) {
+		printf("%s: %d erases after timeout\n", part.name,
+		       chip.num_ops);
+		exit(1);
+	}
+}
+
+#define SFDP_ALL_READS \
+	.sfdp = 1, \
+	.erase_types = { 0x20, 0x52, 0xd8 }, \
+	.fast_reads = SFDP_1_1_2 | SFDP_1_1_4 | SFDP_1_4_4, \
+	.desc_1_4_4 = DESC_1_4_4, \
+	.desc_1_1_4 = DESC_1_1_4, \
+	.desc_1_1_2 = DESC_1_1_2
+
+#define ALL_READ_MODES \
+	(SPI_READ_MODE_1_1_2 | SPI_READ_MODE_1_1_4 | SPI_READ_MODE_1_4_4)
+
+static const struct read_case {
+	struct part part;
+	unsigned int read_modes;	/* of the controller */
+	u8 opcode;			/* expected, 0 for 1-1-1 */
+} read_cases[] = {
+	{ { .name = "single I/O controller", SFDP_ALL_READS }, 0, 0 },
+	{ { .name = "no QE bit", SFDP_ALL_READS }, ALL_READ_MODES, 0xeb },
+	{ { .name = "1-1-4 controller", SFDP_ALL_READS },
+	  SPI_READ_MODE_1_1_2 | SPI_READ_MODE_1_1_4, 0x6b },
+	{ { .name = "1-1-2 controller", SFDP_ALL_READS },
+	  SPI_READ_MODE_1_1_2, 0x3b },
+	{ { .name = "QE clear in SR1", SFDP_ALL_READS, .qer = 2 },
+	  ALL_READ_MODES, 0x3b },
+	{ { .name = "QE set in SR1", SFDP_ALL_READS, .qer = 2,
+	    .sr1 = 1 << 6 }, ALL_READ_MODES, 0xeb },
+	/* Status register 2 can't be read, so QE counts as clear. */
+	{ { .name = "QER 1", SFDP_ALL_READS, .qer = 1, .sr2 = 1 << 1 },
+	  ALL_READ_MODES, 0x3b },
+	{ { .name = "QER 4", SFDP_ALL_READS, .qer = 4, .sr2 = 1 << 1 },
+	  ALL_READ_MODES, 0x3b },
+	{ { .name = "QE clear in SR2", SFDP_ALL_READS, .qer = 5 },
+	  ALL_READ_MODES, 0x3b },
+	{ { .name = "QE set in SR2", SFDP_ALL_READS, .qer = 5,
+	    .sr2 = 1 << 1 }, ALL_READ_MODES, 0xeb },
+	{ { .name = "QE set in SR2 bit 7", SFDP_ALL_READS, .qer = 3,
+	    .sr2 = 1 << 7 }, ALL_READ_MODES, 0xeb },
+	/* JESD216 tables end before the QER field. */
+	{ { .name = "9 DWORD BFPT", SFDP_ALL_READS, .bfpt_dwords = 9 },
+	  ALL_READ_MODES, 0x3b },
+	/* 5 clocks on 4 lines aren't a whole number of bytes. */
+	{ { .name = "odd 1-4-4 dummy", SFDP_ALL_READS,
+	    .desc_1_4_4 = READ_DESC(0xeb, 1, 4) }, ALL_READ_MODES, 0x6b },
+	{ { .name = "no SFDP fast reads", SFDP_ALL_READS, .fast_reads = 0 },
+	  ALL_READ_MODES, 0 },
+	{ { .name = "no SFDP" }, ALL_READ_MODES, 0 },
+};
+
+/*
+ * Probe through each controller and check the read mode picked and that
+ * reads in it, split by the controller's transfer size, return the right
+ * data.
+ */
+static void test_read_modes(void)
+{
+	static u8 buf[64 * KiB];
+	const u32 offset = 0x12345;
+	struct sim_read_mode mode;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(read_cases); i++) {
+		const struct read_case *c = &read_cases[i];
+
+		power_on(&c->part, c->read_modes, 1000);
+		sim_read_mode(&mode);
+		if (mode.opcode != c->opcode) {
+			printf("%s: read opcode %02x, expected %02x\n",
+			       c->part.name, mode.opcode, c->opcode);
+			exit(1);
+		}
+
+		chip.num_reads = 0;
+		chip.clocks = 0;
+		if (sim_flash_read(offset, sizeof(buf), buf) ||
+		    memcmp(buf, &ref[offset], sizeof(buf))) {
+			printf("%s: read failed\n", c->part.name);
+			exit(1);
+		}
+		check_chip("read");
+		if (chip.read_opcode != (c->opcode ? c->opcode : CMD_FAST_READ)
+		    || chip.num_reads != (sizeof(buf) + 999) / 1000) {
+			printf("%s: read with %d commands %02x\n",
+			       c->part.name, chip.num_reads, chip.read_opcode);
+			exit(1);
+		}
+
+		printf("%s: 64 KiB read as 1-%d-%d in %ld clocks\n",
+		       c->part.name, c->opcode ? mode.addr_lines : 1,
+		       c->opcode ? mode.data_lines : 1, chip.clocks);
+	}
+}
+
+static u8 want[CHIP_SIZE];
+
+/*
+ * Update [offset, offset + len) from want and check the result. Returns
+ * what spi_flash_update() returned.
+ */
+static int update(const struct part *part, const char *what, u32 offset,
+		  u32 len, struct sim_update_stats *stats)
+{
+	u8 before[CHIP_SIZE];
+	int ret;
+
+	memcpy(before, chip.mem, sizeof(before));
+	chip.num_ops = 0;
+	chip.num_programs = 0;
+	ret = sim_flash_update(offset, len, &want[offset], stats);
+	check_chip(what);
+
+	if (ret)
+		memcpy(want, before, sizeof(want));
+	if (memcmp(chip.mem, want, sizeof(want))) {
+		printf("%s: %s: wrong contents\n", part->name, what);
+		exit(1);
+	}
+	return ret;
+}
+
+/* Check that the last update erased the given ranges with the fewest ops. */
+static void check_erased(const struct part *part, const char *what,
+			 const u32 (*ranges)[2], int count)
+{
+	int i, op = 0, n;
+	u32 pos;
+
+	for (i = 0; i < count; i++) {
+		pos = ranges[i][0];
+		for (n = 0; op < chip.num_ops && chip.ops[op].offset == pos &&
+			     pos < ranges[i][0] + ranges[i][1]; n++, op++)
+			pos += find_erase(chip.ops[op].opcode)->size;
+		if (pos != ranges[i][0] + ranges[i][1] ||
+		    n != min_erase_ops(part, ranges[i][0], ranges[i][1]))
+			break;
+	}
+	if (i != count || op != chip.num_ops) {
+		printf("%s: %s: wrong erases at range %d\n", part->name, what,
+		       i);
+		exit(1);
+	}
+}
+
+static void check_stats(const struct part *part, const char *what,
+			const struct sim_update_stats *stats, size_t erased,
+			size_t programmed, size_t skipped)
+{
+	if (stats->erased != erased || stats->programmed != programmed ||
+	    stats->skipped != skipped) {
+		printf("%s: %s: %zu erased, %zu programmed, %zu skipped\n",
+		       part->name, what, stats->erased, stats->programmed,
+		       stats->skipped);
+		exit(1);
+	}
+}
+
+/*
+ * spi_flash_update() has to skip sectors that match, only program sectors
+ * where bits need clearing, erase runs of sectors where bits need setting
+ * with the largest erase types and refuse to erase a partial sector.
+ */
+static void test_update(const struct part *part, unsigned int read_modes)
+{
+	const u32 base = 0x40000, size = 0x30000;
+	static const u32 erased_all[][2] = { { 0x40000, 0x30000 } };
+	static const u32 erased_some[][2] = {
+		{ 0x41000, 0x1000 },
+		{ 0x43000, 0x1000 },
+		{ 0x50000, 0x11000 },
+	};
+	struct sim_update_stats stats;
+	u32 i;
+
+	power_on(part, read_modes, 0);
+	memcpy(want, ref, sizeof(want));
+
+	/* The new data needs bits set nearly everywhere. */
+	for (i = base; i < base + size; i++)
+		want[i] = i * 13 + 5;
+	if (update(part, "new image", base, size, &stats))
+		goto failed;
+	check_erased(part, "new image", erased_all, ARRAY_SIZE(erased_all));
+	if (stats.erased != size || stats.skipped)
+		goto bad_stats;
+
+	if (update(part, "same image", base, size, &stats))
+		goto failed;
+	check_stats(part, "same image", &stats, 0, 0, size);
+	if (chip.num_ops || chip.num_programs)
+		goto bad_stats;
+
+	/* Clear bits in a few bytes of one page: program just those. */
+	for (i = base + 0x110; i < base + 0x120; i++)
+		want[i] &= 0x0f;
+	want[base + 0x110] = 0;
+	want[base + 0x11f] = 0;
+	if (update(part, "clear bits", base, size, &stats))
+		goto failed;
+	check_stats(part, "clear bits", &stats, 0, 0x10, size - 0x1000);
+	if (chip.num_ops || chip.num_programs != 1)
+		goto bad_stats;
+
+	/*
+	 * Sectors needing an erase around one that only needs programming,
+	 * then a 64K block and the sector after it in one run.
+	 */
+	for (i = 0x41000; i < 0x44000; i++)
+		want[i] = i < 0x42000 || i >= 0x43000 ? ~want[i] : 0;
+	for (i = 0x50000; i < 0x61000; i++)
+		want[i] = ~want[i];
+	if (update(part, "set bits", base, size, &stats))
+		goto failed;
+	check_erased(part, "set bits", erased_some, ARRAY_SIZE(erased_some));
+	if (stats.erased != 0x13000 || stats.skipped != size - 0x14000)
+		goto bad_stats;
+
+	/* A partial sector only works without an erase. */
+	want[0x40900] = ~want[0x40900];
+	want[0x40901] = 0;
+	if (!update(part, "partial sector erase", 0x40800, 0x1800, &stats)) {
+		printf("%s: partial sector erased\n", part->name);
+		exit(1);
+	}
+	if (chip.num_ops || chip.num_programs)
+		goto bad_stats;
+	want[0x40901] = 0;
+	i = chip.mem[0x40901] != 0;
+	if (update(part, "partial sector program", 0x40880, 0x100, &stats))
+		goto failed;
+	check_stats(part, "partial sector program", &stats, 0, i,
+		    i ? 0 : 0x100);
+
+	printf("%s: updates passed\n", part->name);
+	return;
+
+failed:
+	printf("%s: update failed\n", part->name);
+	exit(1);
+bad_stats:
+	printf("%s: update did more than needed\n", part->name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	verbose = getenv("SPI_VERBOSE") != NULL;
+
+	for (i = 0; i < CHIP_SIZE; i++)
+		ref[i] = i * 7 + (i >> 12);
+
+	test_no_sfdp();
+	test_sfdp();
+	test_sfdp_no_4k();
+	test_erase_timeout();
+	test_read_modes();
+	test_update(&read_cases[1].part, ALL_READ_MODES);
+	test_update(&read_cases[ARRAY_SIZE(read_cases) - 1].part, 0);
+
+	printf("spi-flash-test passed\n");
+	return 0;
+}
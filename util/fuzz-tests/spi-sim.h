@@ -0,0 +1,77 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * Copyright 2016 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Shared by spi-flash-test.c, which is built against libc, and
+ * spi-controller.c, which is built against the coreboot headers like
+ * spi_flash.c.
+ */
+
+#ifndef SPI_SIM_H
+#define SPI_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The simulated flash chip, implemented in spi-flash-test.c. */
+
+/* Chip select: commands take effect when it goes inactive. */
+void chip_select(int active);
+/*
+ * Shift out dout, then shift in din. The first byte of dout always goes out
+ * on one line, the rest on addr_lines lines, din comes in on data_lines.
+ */
+void chip_xfer(const void *dout, size_t bytesout, unsigned int addr_lines,
+	       void *din, size_t bytesin, unsigned int data_lines);
+/* Simulated time, in microseconds. */
+long chip_time_us(void);
+
+/* The spi_flash.c calls, wrapped by spi-controller.c. */
+
+struct sim_erase_type {
+	uint32_t size;
+	uint8_t opcode;
+	uint32_t timeout;	/* in ms */
+};
+
+struct sim_read_mode {
+	uint8_t opcode;		/* 0 for the 1-1-1 fast read */
+	uint8_t addr_lines;
+	uint8_t data_lines;
+	uint8_t dummy_bytes;
+};
+
+struct sim_update_stats {
+	size_t erased;
+	size_t programmed;
+	size_t skipped;
+};
+
+/*
+ * Probe the chip through a controller with the given SPI_READ_MODE_* flags
+ * and transfer size limit, 0 for none. Returns 0 on success.
+ */
+int sim_probe(unsigned int read_modes, unsigned int max_transfer_size);
+/* What the probe found. Returns the number of erase types. */
+int sim_erase_types(struct sim_erase_type *types);
+void sim_read_mode(struct sim_read_mode *mode);
+
+/* flash->read(), flash->erase() and spi_flash_update(). 0 on success. */
+int sim_flash_read(uint32_t offset, size_t len, void *buf);
+int sim_flash_erase(uint32_t offset, size_t len);
+int sim_flash_update(uint32_t offset, size_t len, const void *buf,
+		     struct sim_update_stats *stats);
+
+#endif
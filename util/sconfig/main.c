@@ -296,6 +296,7 @@ void alias_siblings(struct device *d) {
 					cmp->name = d->name;
 					cmp->used = 1;
 					cmp->link = ++link;
+					d->defer_init |= cmp->defer_init;
 				}
 			}
 			cmp = cmp->next_sibling;
@@ -358,6 +359,17 @@ void add_pci_subsystem_ids(struct device *dev, int vendor, int device, int inher
 	dev->inherit_subsystem = inherit;
 }
 
+void add_device_flag(struct device *dev, char *flag)
+{
+	if (!strcmp(flag, "defer_init")) {
+		dev->defer_init = 1;
+		return;
+	}
+
+	printf("ERROR: unknown device flag '%s' at line %d\n", flag, linenum + 1);
+	exit(1);
+}
+
 void add_ioapic_info(struct device *dev, int apicid, const char *_srcpin, int irqpin)
 {
 
@@ -416,6 +428,8 @@ static void pass1(FILE *fil, struct device *ptr)
 		fprintf(fil, "\t.on_mainboard = 1,\n");
 		if (ptr->subsystem_vendor > 0)
 			fprintf(fil, "\t.subsystem_vendor = 0x%04x,\n", ptr->subsystem_vendor);
+		if (ptr->defer_init)
+			fprintf(fil, "\t.defer_init = 1,\n");
 
 		for(pin = 0; pin < 4; pin++) {
 			if (ptr->pci_irq_info[pin].ioapic_irq_pin > 0)
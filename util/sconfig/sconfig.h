@@ -55,6 +55,7 @@ struct device {
 	int subsystem_vendor;
 	int subsystem_device;
 	int inherit_subsystem;
+	int defer_init;
 	char *ops;
 	char *name;
 	char *name_underscore;
@@ -96,3 +97,4 @@ void alias_siblings(struct device *d);
 void add_resource(struct device *dev, int type, int index, int base);
 void add_register(struct device *dev, char *name, char *val);
 void add_pci_subsystem_ids(struct device *dev, int vendor, int device, int inherit);
+void add_device_flag(struct device *dev, char *flag);
@@ -32,7 +32,7 @@ devtree: { cur_parent = cur_bus = head; } chip { postprocess_devtree(); } ;
 
 chipchildren: chipchildren device | chipchildren chip | chipchildren registers | /* empty */ ;
 
-devicechildren: devicechildren device | devicechildren chip | devicechildren resource | devicechildren subsystemid | devicechildren ioapic_irq | /* empty */ ;
+devicechildren: devicechildren device | devicechildren chip | devicechildren resource | devicechildren subsystemid | devicechildren ioapic_irq | devicechildren flag | /* empty */ ;
 
 chip: CHIP STRING /* == path */ {
 	$<device>$ = new_chip(cur_parent, cur_bus, $<string>2);
@@ -70,4 +70,8 @@ subsystemid: SUBSYSTEMID NUMBER NUMBER INHERIT
 
 ioapic_irq: IOAPIC_IRQ NUMBER PCIINT NUMBER
 	{ add_ioapic_info(cur_parent, strtol($<string>2, NULL, 16), $<string>3, strtol($<string>4, NULL, 16)); };
+
+/* Flags are plain words, the lexer hands them over as strings. */
+flag: STRING
+	{ add_device_flag(cur_parent, $<string>1); };
 %%